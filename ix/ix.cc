@@ -11,9 +11,9 @@ IndexManager &IndexManager::instance() {
   return _index_manager;
 }
 
-RC IndexManager::createFile(const std::string &fileName) {
+RC IndexManager::createFile(const std::string &fileName, size_t pageSize) {
   IXFileHandle handler;
-  return handler.createFile(fileName);
+  return handler.createFile(fileName, pageSize);
 }
 
 RC IndexManager::destroyFile(const std::string &fileName) {
@@ -21,11 +21,13 @@ RC IndexManager::destroyFile(const std::string &fileName) {
     DB_WARNING << "try to delete non-exist file " << fileName;
     return -1;
   }
-  return remove(fileName.c_str());
+  RC ret = remove(fileName.c_str());
+  if (ret == 0) LogManager::instance().logDrop(fileName);
+  return ret;
 }
 
-RC IndexManager::openFile(const std::string &fileName, IXFileHandle &ixFileHandle) {
-  return ixFileHandle.openFile(fileName);
+RC IndexManager::openFile(const std::string &fileName, IXFileHandle &ixFileHandle, OpenMode mode) {
+  return ixFileHandle.openFile(fileName, mode);
 }
 
 RC IndexManager::closeFile(IXFileHandle &ixFileHandle) {
@@ -186,7 +188,7 @@ RC IXFileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePa
   return 0;
 }
 
-RC IXFileHandle::openFile(const std::string &fileName) {
+RC IXFileHandle::openFile(const std::string &fileName, OpenMode mode) {
   if (!PagedFileManager::ifFileExists(fileName)) {
 //    DB_WARNING << "try to open non-exist file " << fileName;
     return -1;
@@ -197,7 +199,7 @@ RC IXFileHandle::openFile(const std::string &fileName) {
     return -1;
   }
   name = fileName;
-  mgr = IXFileManager::getMgr(name);
+  mgr = IXFileManager::getMgr(name, mode);
   if (!mgr) return -1;
   else {
     updateCounter();
@@ -224,22 +226,29 @@ RC IXFileHandle::updateCounter() {
   return 0;
 }
 
-RC IXFileHandle::createFile(const std::string &fileName) {
+RC IXFileHandle::createFile(const std::string &fileName, size_t pageSize) {
 
   if (PagedFileManager::ifFileExists(fileName)) {
     return -1;
   }
 
-  std::fstream file(fileName, std::ios::out | std::ios::binary);
-  if (!file.good()) {
+  if (!PageIO::isValidPageSize(pageSize)) {
+    DB_WARNING << "invalid page size " << pageSize;
+    return -1;
+  }
+
+  PageIO io;
+  if (io.create(fileName)) {
     DB_WARNING << "failed to create file " << fileName;
     return -1;
   }
-  int init_size = PAGE_SIZE + sizeof(int);
-  char buf[init_size];
-  memset(buf, 0, init_size);
-  file.write(buf, init_size);
-  file.close();
+  // header page with zero counters and page size, followed by an empty free page list
+  std::vector<char> buf(pageSize + sizeof(int), 0);
+  unsigned page_size = pageSize;
+  memcpy(buf.data() + 3 * sizeof(unsigned), &page_size, sizeof(unsigned));
+  // synced since logged writes of the file might be replayed onto it
+  if (io.writeAt(0, buf.data(), buf.size()) || io.sync()) return -1;
+  LogManager::instance().logCreate(fileName);
   return 0;
 }
 
@@ -401,11 +410,14 @@ void LFUCache::setCap(int c) {
   cap = c;
 }
 
-const size_t IXPage::MAX_DATA_SIZE = PAGE_SIZE - sizeof(int);
 const size_t IXPage::DEFAULT_DATA_BEGIN = sizeof(int);
 
 IXPage::IXPage(PID page_id, IXFileManager *mgr) : pid(page_id), data(nullptr), dirty(false), file_mgr(mgr) {
-  data = static_cast<char *>(malloc(PAGE_SIZE));
+  data = PageIO::allocAligned(mgr->getPageSize());
+}
+
+size_t IXPage::maxDataSize() const {
+  return file_mgr->getPageSize() - DEFAULT_DATA_BEGIN;
 }
 
 const char *IXPage::dataConst() const {
@@ -414,6 +426,10 @@ const char *IXPage::dataConst() const {
 
 char *IXPage::dataNonConst() {
   dirty = true;
+  if (file_mgr->unlogged_.insert(pid).second && LogManager::instance().isOpen()) {
+    before_.reset(new char[file_mgr->getPageSize()]);
+    memcpy(before_.get(), data, file_mgr->getPageSize());
+  }
   return data;
 }
 
@@ -421,6 +437,8 @@ RC IXPage::dump() {
   if (dirty) {
 //    DB_INFO << "dump IXPage " << pid;
 //    DB_DEBUG << print_bytes(data, 50);
+    LogManager &log = LogManager::instance();
+    if (log.flushTo(log.committedLsn())) return -1;
     RC ret = file_mgr->writePage(pid, data);
     dirty = false;
     return ret;
@@ -430,7 +448,7 @@ RC IXPage::dump() {
 
 IXPage::~IXPage() {
   dump();
-  if (data) free(data);
+  if (data) PageIO::freeAligned(data);
 }
 
 /**********************************************************
@@ -730,7 +748,7 @@ RC Node::dumpToPage() {
       *((int *) data_pt) = 1; // type1 `data page`
       data_pt += sizeof(int);
       offset = IXPage::DEFAULT_DATA_BEGIN;
-      free_space = IXPage::MAX_DATA_SIZE;
+      free_space = next_page->maxDataSize();
     }
     entry.first.dump(data_pt);
     data_pt += entry_size;
@@ -858,13 +876,15 @@ BPlusTree *BPlusTree::createTreeOrLoadIfExist(IXFileManager *mgr, const Attribut
       // exist
       tree = loadTreeFromFile(mgr, attr);
     } else {
-      tree = createTree(mgr, DEFAULT_ORDER_M, attr);
+      // node meta page grows with order, so order scales with page size
+      tree = createTree(mgr, DEFAULT_ORDER_M * int(mgr->getPageSize() / PAGE_SIZE), attr);
     }
     global_map[mgr->name] = tree;
   }
   auto tree = global_map[mgr->name].get();
   tree->lfu.setCap(4 * tree->M);
-  mgr->lfu.setCap(9 * tree->M);
+  // order grows with page size, keep memory of cached pages the same as for default page size
+  mgr->lfu.setCap(9 * tree->M * PAGE_SIZE / int(mgr->getPageSize()));
   return global_map[mgr->name].get();
 }
 
@@ -1491,10 +1511,13 @@ BPlusTree::~BPlusTree() {
 const int IXFileManager::LFU_CAP = 10000; // 10000 page, which is 40MB
 std::unordered_map<std::string, std::shared_ptr<IXFileManager>> IXFileManager::global_map;
 
-IXFileManager *IXFileManager::getMgr(const std::string &file) {
+IXFileManager *IXFileManager::getMgr(const std::string &file, OpenMode mode) {
+  static bool hooked = (LogManager::instance().addCheckpointHook(&IXFileManager::checkpoint),
+                        LogManager::instance().addCommitHook(&IXFileManager::writeHeld), true);
+  (void) hooked;
   if (!global_map.count(file)) {
     auto mgr = std::make_shared<IXFileManager>(file);
-    if (mgr->init()) return nullptr;
+    if (mgr->init(mode)) return nullptr;
     global_map[file] = mgr;
   }
   return global_map[file].get();
@@ -1504,19 +1527,23 @@ void IXFileManager::removeMgr(const std::string &file) {
   if (global_map.count(file)) global_map.erase(file);
 }
 
-RC IXFileManager::init() {
+RC IXFileManager::init(OpenMode mode) {
   if (!PagedFileManager::ifFileExists(name)) {
     DB_WARNING << "try to open non-exist file " << name;
     return -1;
   }
 
-  if (_file.is_open()) {
+  if (io_.isOpen()) {
     DB_WARNING << "file " << name << "already open!";
     return -1;
   }
 
-  _file.open(name, std::ios::in | std::ios::out | std::ios::binary);
-  if (!_file.good()) {
+  if (mode == OPEN_MMAP_READ_ONLY) {
+    DB_WARNING << "index file " << name << " can not be opened read-only";
+    return -1;
+  }
+
+  if (io_.open(name, mode)) {
 //    DB_WARNING << "failed to open file " << fileName;
     return -1;
   }
@@ -1528,11 +1555,18 @@ IXFileManager::IXFileManager(std::string file) : name(std::move(file)), lfu(LFU_
 }
 
 IXFileManager::~IXFileManager() {
-  if (_file.is_open()) _file.close();
+  if (io_.isOpen()) io_.close();
 }
 
 void IXFileManager::popOut(int id) {
   //  no need to dump, will dump when dtor
+  // with write-ahead log, a page modified by current operation can not be written before it's logged, nor before
+  // the log scope of caller commits
+  LogManager &log = LogManager::instance();
+  auto it = pages.find(id);
+  if (it != pages.end() && it->second->dirty && log.isOpen() && (unlogged_.count(id) || log.inScope())) {
+    held_[id] = it->second;
+  }
   pages.erase(id);
   if (free_pages.count(id))
     free_pages.erase(id);
@@ -1540,31 +1574,31 @@ void IXFileManager::popOut(int id) {
 
 RC IXFileManager::readPage(PageNum pageNum, void *data) {
   // pageNum exceed total number of pages
-  if (pageNum >= getNumberOfPages() || !_file.is_open())
+  if (pageNum >= getNumberOfPages() || !io_.isOpen())
     return -1;
-  _file.seekg(getPos(pageNum));
-  _file.read((char *) data, PAGE_SIZE);
+  if (io_.readPage(pageNum, data)) return -1;
   readPageCounter++;
   return 0;
 }
 RC IXFileManager::writePage(PageNum pageNum, const void *data) {
-  if (pageNum >= getNumberOfPages() || !_file.is_open())
+  if (pageNum >= getNumberOfPages() || !io_.isOpen())
     return -1;
   meta_modified_ = true;
-  _file.seekp(getPos(pageNum));
-  _file.write((char *) data, PAGE_SIZE);
+  if (io_.writePage(pageNum, data)) return -1;
   writePageCounter++;
   return 0;
 }
 std::pair<RC, IXPage *> IXFileManager::appendPage() {
-  if (!_file.is_open()) {
+  if (!io_.isOpen()) {
 //    DB_WARNING << "File is not opened!";
     return {-1, nullptr};
   }
   meta_modified_ = true;
-  _file.seekp(getPos(appendPageCounter)); // this will overwrite the tailing meta pages
-  char data[PAGE_SIZE];
-  _file.write((char *) data, PAGE_SIZE);
+  // only reserve space on disk, content is written when the page is dumped
+  char *data = PageIO::allocAligned(getPageSize());
+  RC ret = io_.writePage(appendPageCounter, data); // this will overwrite the tailing meta pages
+  PageIO::freeAligned(data);
+  if (ret) return {-1, nullptr};
 
   std::shared_ptr<IXPage> cur_page = std::make_shared<IXPage>(appendPageCounter++, this);
   pages[cur_page->pid] = cur_page;
@@ -1587,9 +1621,15 @@ std::pair<RC, IXPage *> IXFileManager::getPage(int pid) {
       // pop out
       popOut(pop_out.first);
     }
-    auto cur_page = std::make_shared<IXPage>(pid, this);
-    readPage(pid, cur_page->data);
-    pages[pid] = cur_page;
+    auto held_it = held_.find(pid);
+    if (held_it != held_.end()) {
+      pages[pid] = held_it->second;
+      held_.erase(held_it);
+    } else {
+      auto cur_page = std::make_shared<IXPage>(pid, this);
+      readPage(pid, cur_page->data);
+      pages[pid] = cur_page;
+    }
   }
   return {0, pages[pid].get()};
 }
@@ -1628,61 +1668,129 @@ RC IXFileManager::dumpToFile() {
   for (auto &p : pages) {
     if (p.second->dump()) return -1;
   }
+  for (auto &p : held_) {
+    if (p.second->dump()) return -1;
+  }
   return dumpMeta();
 }
 
+RC IXFileManager::commit() {
+  if (!LogManager::instance().isOpen()) {
+    unlogged_.clear();
+    return dumpToFile();
+  }
+  // held pages are written back by writeHeld once the scope of caller commits
+  return logChanges();
+}
+
+RC IXFileManager::logChanges() {
+  if (unlogged_.empty()) return 0;
+  LogManager &log = LogManager::instance();
+  LogScope scope;
+  for (int pid : unlogged_) {
+    IXPage *page = nullptr;
+    auto it = pages.find(pid);
+    if (it != pages.end()) page = it->second.get();
+    else if ((it = held_.find(pid)) != held_.end()) page = it->second.get();
+    if (!page || !page->dirty) continue; // released
+    size_t begin = 0, end = getPageSize();
+    if (page->before_) {
+      while (begin < end && page->data[begin] == page->before_[begin]) ++begin;
+      while (end > begin && page->data[end - 1] == page->before_[end - 1]) --end;
+      page->before_.reset();
+    }
+    log.logPage(name, io_.getPos(pid), page->data, getPageSize(), {{begin, end}});
+  }
+  unlogged_.clear();
+
+  // counters, page size and the free page list at tail, as dumpMeta writes them
+  unsigned counters[4] = {readPageCounter, writePageCounter, appendPageCounter, unsigned(getPageSize())};
+  log.logWrite(name, 0, counters, sizeof(counters));
+  std::vector<int> tail;
+  tail.reserve(free_pages.size() + 1);
+  tail.push_back(free_pages.size());
+  tail.insert(tail.end(), free_pages.begin(), free_pages.end());
+  log.logWrite(name, io_.getPos(getNumberOfPages()), tail.data(), tail.size() * sizeof(int));
+  return 0;
+}
+
+RC IXFileManager::writeHeld() {
+  for (auto &kv : global_map) {
+    auto &held = kv.second->held_;
+    for (auto it = held.begin(); it != held.end();) {
+      // pages of an operation not ended yet are logged by its commit
+      if (kv.second->unlogged_.count(it->first)) {
+        ++it;
+        continue;
+      }
+      if (it->second->dump()) return -1;
+      it = held.erase(it);
+    }
+  }
+  return 0;
+}
+
+RC IXFileManager::checkpoint() {
+  for (auto &kv : global_map) {
+    if (kv.second->dumpToFile()) return -1;
+  }
+  return 0;
+}
+
 RC IXFileManager::close() {
   // lalala I just do nothing, come on and get me :))))
   return 0;
 }
 
 RC IXFileManager::loadMeta() {
-  _file.seekg(0, std::ios::end);
   meta_modified_ = false;
   free_pages.clear();
   pages.clear();
 
-  // load counter from metadata
-  _file.seekg(0);
-  _file.read((char *) &readPageCounter, sizeof(unsigned));
-  _file.read((char *) &writePageCounter, sizeof(unsigned));
-  _file.read((char *) &appendPageCounter, sizeof(unsigned));
+  // load counter and page size from metadata
+  unsigned counters[4];
+  if (io_.readAt(0, counters, sizeof(counters))) return -1;
+  readPageCounter = counters[0];
+  writePageCounter = counters[1];
+  appendPageCounter = counters[2];
+  size_t page_size = counters[3] ? counters[3] : PAGE_SIZE;
+  if (!PageIO::isValidPageSize(page_size)) {
+    DB_ERROR << name << " has invalid page size " << page_size;
+    return -1;
+  }
+  io_.setPageSize(page_size);
 
   // load free space for each page
   // meta pages store free space are always appended at the end
-  int num_pages = getNumberOfPages();
-  _file.seekg(getPos(num_pages));
+  size_t pos = io_.getPos(getNumberOfPages());
   int free_page_nums;
-  int free_page_id;
-  _file.read((char *) (&free_page_nums), sizeof(int));
-  for (int i = 0; i < free_page_nums; ++i) {
-    _file.read((char *) (char *) (&free_page_id), sizeof(int));
-    free_pages.insert(free_page_id);
-  }
+  if (io_.readAt(pos, &free_page_nums, sizeof(int))) return -1;
+  std::vector<int> free_page_ids(free_page_nums);
+  if (io_.readAt(pos + sizeof(int), free_page_ids.data(), free_page_nums * sizeof(int))) return -1;
+  free_pages.insert(free_page_ids.begin(), free_page_ids.end());
   return 0;
 }
 
 RC IXFileManager::dumpMeta() {
 
   // flush new counters to metadata
-  _file.seekp(0);
-  char meta_page[PAGE_SIZE];
-  memcpy(meta_page, &readPageCounter, sizeof(unsigned));
-  memcpy(meta_page + 1 * sizeof(unsigned), &writePageCounter, sizeof(unsigned));
-  memcpy(meta_page + 2 * sizeof(unsigned), &appendPageCounter, sizeof(unsigned));
-  _file.write(meta_page, PAGE_SIZE);
+  char *meta_page = PageIO::allocAligned(PAGE_SIZE);
+  unsigned counters[4] = {readPageCounter, writePageCounter, appendPageCounter, unsigned(getPageSize())};
+  memcpy(meta_page, counters, sizeof(counters));
+  RC ret = io_.writeAt(0, meta_page, PAGE_SIZE);
+  PageIO::freeAligned(meta_page);
+  if (ret) return -1;
 
   // flush pages free space to metadata at tail
   int page_num = getNumberOfPages();
 
   if (meta_modified_ || page_num == 0) {
-
-    _file.seekp(getPos(page_num));
-    int free_page_nums = free_pages.size();
-    _file.write((const char *) (&free_page_nums), sizeof(int));
-    for (int pid : free_pages) {
-      _file.write((const char *) (&pid), sizeof(int));
-    }
+    // free page count followed by page ids, written in one call
+    std::vector<int> tail;
+    tail.reserve(free_pages.size() + 1);
+    tail.push_back(free_pages.size());
+    tail.insert(tail.end(), free_pages.begin(), free_pages.end());
+    if (io_.writeAt(io_.getPos(page_num), tail.data(), tail.size() * sizeof(int))) return -1;
   }
   return 0;
 }
@@ -1714,5 +1822,5 @@ Context::~Context() {
   file_handle->updateCounter();
   btree->dumpToMgr();
   btree->popoutFromCache();
-  mgr->dumpToFile();
+  mgr->commit();
 }
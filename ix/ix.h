@@ -18,14 +18,15 @@ class IndexManager {
  public:
   static IndexManager &instance();
 
-  // Create an index file.
-  RC createFile(const std::string &fileName);
+  // Create an index file, larger pages give larger tree order
+  RC createFile(const std::string &fileName, size_t pageSize = PAGE_SIZE);
 
   // Delete an index file.
   RC destroyFile(const std::string &fileName);
 
   // Open an index and return an ixFileHandle.
-  RC openFile(const std::string &fileName, IXFileHandle &ixFileHandle);
+  // mode only takes effect when the index is not opened yet, since pages are shared by all handles of the file
+  RC openFile(const std::string &fileName, IXFileHandle &ixFileHandle, OpenMode mode = OPEN_READ_WRITE);
 
   // Close an ixFileHandle for an index.
   RC closeFile(IXFileHandle &ixFileHandle);
@@ -173,28 +174,31 @@ class BPlusTree;
 class IXFileManager {
   friend class IXFileHandle;
   friend class BPlusTree;
+  friend class IXPage;
   static const int LFU_CAP;
 
   // variables to keep counter for each operation
-  unsigned readPageCounter;
-  unsigned writePageCounter;
-  unsigned appendPageCounter;
+  std::atomic<unsigned> readPageCounter;
+  std::atomic<unsigned> writePageCounter;
+  std::atomic<unsigned> appendPageCounter;
 
   LFUCache lfu;
   std::unordered_map<int, std::shared_ptr<IXPage>> pages;
   std::unordered_set<int> free_pages; // some pages might be freed after entry deletion
-  std::fstream _file;
-
-  static inline size_t getPos(PageNum page_num) {
-    return (page_num + 1) * PAGE_SIZE;
-  }
+  PageIO io_;
+  std::unordered_set<int> unlogged_;  // pages modified by current operation, logged when it ends
+  std::unordered_map<int, std::shared_ptr<IXPage>> held_; // pages popped out before their log committed, see writeHeld
 
   void popOut(int id);
   RC dumpMeta();
   RC loadMeta();
+  RC logChanges();
+
+  static RC checkpoint();
+  static RC writeHeld();
  public:
   static std::unordered_map<std::string, std::shared_ptr<IXFileManager>> global_map;
-  static IXFileManager *getMgr(const std::string &file);
+  static IXFileManager *getMgr(const std::string &file, OpenMode mode = OPEN_READ_WRITE);
   static void removeMgr(const std::string &file);
 
   bool meta_modified_;
@@ -207,13 +211,19 @@ class IXFileManager {
   RC writePage(PageNum pageNum, const void *data);                    // Write a specific page
   std::pair<RC, IXPage *> appendPage();                                    // Append a specific page
   unsigned getNumberOfPages();                                        // Get the number of pages in the file
+  inline size_t getPageSize() const { return io_.getPageSize(); }
 
   std::pair<RC, IXPage *> getPage(int pid);
   std::pair<RC, IXPage *> requestNewPage();
   RC releasePage(int);
-  RC init();
-  // serialization to disk, should be call after each operation
+  RC init(OpenMode mode = OPEN_READ_WRITE);
+  // serialization to disk
   RC dumpToFile();
+  /**
+   * should be called after each operation. with write-ahead log, modified pages are logged as one group and stay
+   * cached until a checkpoint or eviction, otherwise they are written to disk immediately
+   */
+  RC commit();
   RC close();
 
   void updateFileHandle(IXFileHandle &handle) const;
@@ -221,7 +231,8 @@ class IXFileManager {
 };
 
 /**
- * first page is meta page store three counters
+ * first page is meta page store three counters and page size (0 for files created before page size is configurable,
+ * which means PAGE_SIZE)
  *
  * following the last data page are also some other meta pages:
  * first 4 bytes(int) indicate numbers of free pages, followed by page ids
@@ -248,8 +259,8 @@ class IXFileHandle {
   // Put the current counter values of associated PF FileHandles into variables
   RC collectCounterValues(unsigned &readPageCount, unsigned &writePageCount, unsigned &appendPageCount);
 
-  RC createFile(const std::string &fileName);
-  RC openFile(const std::string &fileName);
+  RC createFile(const std::string &fileName, size_t pageSize = PAGE_SIZE);
+  RC openFile(const std::string &fileName, OpenMode mode = OPEN_READ_WRITE);
   RC closeFile();
 
   RC updateCounter();
@@ -288,13 +299,13 @@ class IXPage {
   /*
    * for `data page`
    */
-  static const size_t MAX_DATA_SIZE;
   static const size_t DEFAULT_DATA_BEGIN;
 
   bool meta;
   PID pid;
 
   IXPage(PID page_id, IXFileManager *mgr);
+  size_t maxDataSize() const;
   const char *dataConst() const;
   char *dataNonConst();
 
@@ -304,6 +315,7 @@ class IXPage {
   bool dirty;
   char *data;
   IXFileManager *file_mgr;
+  std::unique_ptr<char[]> before_; // content before current operation modified it, only changed bytes are logged
 
   RC dump();
 
@@ -43,6 +43,23 @@ void Utils::concatRecords(const std::vector<Attribute> &left_attrs,
   attrs.insert(attrs.end(), left_attrs.begin(), left_attrs.end());
   attrs.insert(attrs.end(), right_attrs.begin(), right_attrs.end());
 }
+
+/******************************
+ *          Iterator
+ *****************************/
+
+RC Iterator::getNextTupleView(RecordView &view) {
+  if (view_attrs_.empty()) {
+    getAttributes(view_attrs_);
+    view_buffer_.resize(MAX_PAGE_SIZE);
+  }
+  if (getNextTuple(view_buffer_.data()) == QE_EOF) {
+    view.release();
+    return QE_EOF;
+  }
+  view.bind(view_attrs_, view_buffer_.data());
+  return 0;
+}
 /******************************
  *          Filter
  *****************************/
@@ -65,39 +82,35 @@ Filter::Filter(Iterator *input, const Condition &condition) : input_(input), con
     DB_ERROR << "types for left hand side and right hand side don't match!";
     throw std::runtime_error("Invalid condition");
   }
-
+  compare_ = RecordBasedFileManager::getComparator(condition.rhsValue.type, condition.op);
+  if (!compare_ && condition.op != NO_OP) {
+    DB_ERROR << "unrecognized CompOp " << condition.op;
+    throw std::runtime_error("Invalid condition");
+  }
 }
 
 Filter::~Filter() = default;
 
 RC Filter::getNextTuple(void *data) {
-  while (input_->getNextTuple(data) != QE_EOF) {
-    if (condition_.op == NO_OP) {
+  if (getNextTupleView(view_) == QE_EOF) return QE_EOF;
+  view_.copyTo(data);
+  // don't keep the page pinned between calls
+  view_.release();
+  return 0;
+}
+
+RC Filter::getNextTupleView(RecordView &view) {
+  while (input_->getNextTupleView(view) != QE_EOF) {
+    if (!compare_) {
       return 0;
     }
-    int indicator_bytes_num = int(ceil(double(attrs_.size()) / 8));
-    std::vector<bool>
-      null_indicators = RecordBasedFileManager::parseNullIndicator((const unsigned char *) data, attrs_.size());
     // corresponding field is NULL: cmp always result in false
-    if (null_indicators[attr_idx_]) {
+    if (view.isNull(attr_idx_)) {
       continue;
     }
-    const char *real_data = ((char *) data) + indicator_bytes_num;
-    for (int i = 0; i < attr_idx_; i++) {
-      if (!null_indicators[i]) {
-        if (attrs_[i].type == TypeVarChar) {
-          int char_len = *((int *) real_data);
-          real_data += sizeof(int) + char_len;
-        } else {
-          real_data += attrs_[i].length;
-        }
-      }
+    if (compare_(view.field(attr_idx_), condition_.rhsValue.data)) {
+      return 0;
     }
-    RC cmp = RecordBasedFileManager::cmpAttr(condition_.op,
-                                             condition_.rhsValue.type,
-                                             real_data,
-                                             condition_.rhsValue.data);
-    if (cmp) return 0;
   }
   return QE_EOF;
 }
@@ -128,7 +141,7 @@ Project::Project(Iterator *input, const std::vector<std::string> &attrNames) : i
 Project::~Project() = default;
 
 RC Project::getNextTuple(void * data) {
-  char buffer[PAGE_SIZE];
+  char buffer[MAX_PAGE_SIZE];
   if (input_->getNextTuple(buffer) != QE_EOF) {
     std::vector<bool> is_null = RecordBasedFileManager::parseNullIndicator(reinterpret_cast<const unsigned char *>(buffer),
                                                                                    input_attrs_.size());
@@ -216,7 +229,7 @@ BNLJoin::BNLJoin(Iterator *leftIn, TableScan *rightIn, const Condition &conditio
     throw std::runtime_error("attribute not found");
   }
   r_pos_ = it - r_attrs_.begin();
-  r_buffer_ = (char *) malloc(PAGE_SIZE);
+  r_buffer_ = (char *) malloc(MAX_PAGE_SIZE);
   l_buffer_ = (char *) malloc(numPages * PAGE_SIZE);
   loadLeftRecordBlocks();
 }
@@ -235,11 +248,12 @@ RC BNLJoin::loadLeftRecordBlocks() {
   memset(l_buffer_, 0, num_pages_ * PAGE_SIZE);
   char *output = l_buffer_;
   unsigned max_num_records = num_pages_ * PAGE_SIZE / left_record_length_;
+  RecordView view;
   for (int i = 0; i < max_num_records; ++i) {
-    if (l_in_->getNextTuple(output) != QE_EOF) {
-      auto res = Utils::parseCondValue(l_attrs_, l_pos_, output);
-      if (!res.first) continue; // null field, just skip
-      hash_map_[res.second].push_back(output);
+    if (l_in_->getNextTupleView(view) != QE_EOF) {
+      if (view.isNull(l_pos_)) continue; // null field, just skip
+      hash_map_[Key(l_attrs_[l_pos_].type, view.field(l_pos_), {0, 0})].push_back(output);
+      view.copyTo(output);
       output += left_record_length_;
     } else {
       break;
@@ -259,10 +273,13 @@ RC BNLJoin::getNextTuple(void * data) {
     same_key_in_left_ = false;
   }
   // finish output the same left records, fetch next right record
-  while (r_in_->getNextTuple(r_buffer_) != QE_EOF) {
-    auto key = Utils::parseCondValue(r_attrs_, r_pos_, r_buffer_);
-    if (!key.first || !hash_map_.count(key.second) || hash_map_.at(key.second).empty()) continue;
-    std::vector<char *> &left_records = hash_map_.at(key.second);
+  while (r_in_->getNextTupleView(r_view_) != QE_EOF) {
+    if (r_view_.isNull(r_pos_)) continue;
+    auto key = hash_map_.find(Key(r_attrs_[r_pos_].type, r_view_.field(r_pos_), {0, 0}));
+    if (key == hash_map_.end() || key->second.empty()) continue;
+    std::vector<char *> &left_records = key->second;
+    r_view_.copyTo(r_buffer_);
+    r_view_.release();
     Utils::concatRecords(l_attrs_, r_attrs_, left_records.at(0), r_buffer_, data);
     if (left_records.size() > 1) {
       same_key_iter_.first = left_records.begin() + 1;
@@ -300,7 +317,7 @@ INLJoin::INLJoin(Iterator *leftIn, IndexScan *rightIn, const Condition &conditio
     throw std::runtime_error("attribute not found");
   }
   l_pos_ = it - l_attrs_.begin();
-  l_buffer_ = (char *) malloc(PAGE_SIZE);
+  l_buffer_ = (char *) malloc(MAX_PAGE_SIZE);
  }
 
  INLJoin::~INLJoin() {
@@ -314,7 +331,7 @@ INLJoin::INLJoin(Iterator *leftIn, IndexScan *rightIn, const Condition &conditio
  }
 
 RC INLJoin::getNextTuple(void *data) {
-  char buffer[PAGE_SIZE];
+  char buffer[MAX_PAGE_SIZE];
   // current left key probes to multiple records in right B+ tree
   if (same_key_in_right_ && r_in_->getNextTuple(buffer) != QE_EOF) {
     Utils::concatRecords(l_attrs_, r_attrs_, l_buffer_, buffer, data);
@@ -354,7 +371,7 @@ Aggregate::Aggregate(Iterator *input, const Attribute &aggAttr, AggregateOp op)
   int pos = it - input_attrs.begin();
 
   // read data
-  char buffer[PAGE_SIZE];
+  char buffer[MAX_PAGE_SIZE];
   while (input->getNextTuple(buffer) != QE_EOF) {
     auto is_null = RecordBasedFileManager::parseNullIndicator((unsigned char *)buffer, input_attrs.size());
     if (is_null[pos]) continue;
@@ -381,7 +398,7 @@ Aggregate::Aggregate(Iterator *input, const Attribute &aggAttr, const Attribute
     throw std::runtime_error("groutAttr not found!");
   int group_pos = it - input_attrs.begin();
 
-  char buffer[PAGE_SIZE];
+  char buffer[MAX_PAGE_SIZE];
   while (input->getNextTuple(buffer) != QE_EOF) {
     auto is_null = RecordBasedFileManager::parseNullIndicator((unsigned char *)buffer, input_attrs.size());
     if (is_null.at(group_pos) || is_null.at(agg_pos)) continue;
@@ -558,7 +575,7 @@ GHJoin::GHJoin(Iterator *leftIn, Iterator *rightIn, const Condition &condition,
   // hash and dump each table to disk partition
   dumpPartitions(true);
   dumpPartitions(false);
-  r_buffer_ = (char *) malloc(PAGE_SIZE);
+  r_buffer_ = (char *) malloc(MAX_PAGE_SIZE);
 }
 
 GHJoin::~GHJoin() {
@@ -571,7 +588,7 @@ void GHJoin::dumpPartitions(bool is_left) {
   int pos = is_left ? l_pos_ : r_pos_;
   auto &fhs = is_left ? l_fhs_ : r_fhs_;
 
-  char buffer[PAGE_SIZE];
+  char buffer[MAX_PAGE_SIZE];
   RID rid;
   while (in->getNextTuple(buffer) != QE_EOF) {
     auto key = Utils::parseCondValue(attrs, pos, buffer);
@@ -586,13 +603,14 @@ RC GHJoin::loadLeftPartition(int num) {
   hash_map_.clear();
   RBFM_ScanIterator rmsi;
   rbfm_->scan(*l_fhs_.at(num), l_attrs_, "", CompOp::NO_OP, nullptr, {}, rmsi);
-  char buffer[PAGE_SIZE];
+  RecordView view;
   RID rid;
-  while (rmsi.getNextRecord(rid, buffer) != QE_EOF) {
-    auto res = Utils::parseCondValue(l_attrs_, l_pos_, buffer);
-    if (!res.first) continue; // null field, just skip
-    hash_map_[res.second].push_back({rid.pageNum, rid.slotNum});
+  while (rmsi.getNextRecordView(rid, view) != QE_EOF) {
+    // only the key is read, record stays on its page
+    if (view.isNull(l_pos_)) continue; // null field, just skip
+    hash_map_[Key(l_attrs_[l_pos_].type, view.field(l_pos_), {0, 0})].push_back({rid.pageNum, rid.slotNum});
   }
+  rmsi.close();
   if (hash_map_.empty()) return QE_EOF;
   return 0;
 }
@@ -600,7 +618,7 @@ RC GHJoin::loadLeftPartition(int num) {
 RC GHJoin::getNextTuple(void * data) {
   // multiple records in left partition mapped to the same record in right buffer
   if (same_key_in_left_ && same_key_iter_.first != same_key_iter_.second) {
-    char buffer[PAGE_SIZE];
+    char buffer[MAX_PAGE_SIZE];
     rbfm_->readRecord(*l_fhs_.at(curr_partition_), l_attrs_, *same_key_iter_.first, buffer);
     Utils::concatRecords(l_attrs_, r_attrs_, buffer, r_buffer_, data);
     ++same_key_iter_.first;
@@ -610,12 +628,15 @@ RC GHJoin::getNextTuple(void * data) {
   }
 
   RID rid;
-  while (r_iter_.getNextRecord(rid, r_buffer_) != QE_EOF) {
+  while (r_iter_.getNextRecordView(rid, r_view_) != QE_EOF) {
     // probe into left partition
-    auto key = Utils::parseCondValue(r_attrs_, r_pos_, r_buffer_);
-    if (!key.first || !hash_map_.count(key.second) || hash_map_.at(key.second).empty()) continue;
-    std::vector<RID> &left_rids = hash_map_.at(key.second);
-    char buffer[PAGE_SIZE];
+    if (r_view_.isNull(r_pos_)) continue;
+    auto key = hash_map_.find(Key(r_attrs_[r_pos_].type, r_view_.field(r_pos_), {0, 0}));
+    if (key == hash_map_.end() || key->second.empty()) continue;
+    std::vector<RID> &left_rids = key->second;
+    r_view_.copyTo(r_buffer_);
+    r_view_.release();
+    char buffer[MAX_PAGE_SIZE];
     rbfm_->readRecord(*l_fhs_.at(curr_partition_), l_attrs_, left_rids.at(0), buffer);
     Utils::concatRecords(l_attrs_, r_attrs_, buffer, r_buffer_, data);
     if (left_rids.size() > 1) {
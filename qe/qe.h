@@ -58,9 +58,19 @@ class Iterator {
  public:
   virtual RC getNextTuple(void *data) = 0;
 
+  /**
+   * bind `view` to the next tuple, so that fields are read without materialising it. scans view records on their
+   * pages, other operators produce the tuple into a buffer of the iterator which stays valid until the next call
+   */
+  virtual RC getNextTupleView(RecordView &view);
+
   virtual void getAttributes(std::vector<Attribute> &attrs) const = 0;
 
   virtual ~Iterator() = default;;
+
+ private:
+  std::vector<Attribute> view_attrs_;
+  std::vector<char> view_buffer_;
 };
 
 class TableScan : public Iterator {
@@ -109,10 +119,26 @@ class TableScan : public Iterator {
     rm.scan(tableName, conditionAttribute, compOp, value, attrNames, *iter);
   };
 
+  // Start a new iterator filtered by several predicates, evaluated inside the record based file scan
+  void setIterator(const ScanCondition &condition, const std::vector<Attribute> &attributes) {
+    iter->close();
+    delete iter;
+    iter = new RM_ScanIterator();
+    attrs = attributes;
+    attrNames.clear();
+    for (Attribute &attr : attrs)
+      attrNames.push_back(attr.name);
+    rm.scan(tableName, condition, attrNames, *iter);
+  };
+
   RC getNextTuple(void *data) override {
     return iter->getNextTuple(rid, data);
   };
 
+  RC getNextTupleView(RecordView &view) override {
+    return iter->getNextTupleView(rid, view);
+  };
+
   void getAttributes(std::vector<Attribute> &attributes) const override {
     attributes.clear();
     attributes = this->attrs;
@@ -139,7 +165,7 @@ class IndexScan : public Iterator {
   std::string tableName;
   std::string attrName;
   std::vector<Attribute> attrs;
-  char key[PAGE_SIZE]{};
+  char key[MAX_PAGE_SIZE]{};
   RID rid{};
 
   IndexScan(RelationManager &rm, const std::string &tableName, const std::string &attrName, const char *alias = NULL)
@@ -206,6 +232,9 @@ class Filter : public Iterator {
 
   RC getNextTuple(void *data) override;
 
+  // rejected tuples are never materialised
+  RC getNextTupleView(RecordView &view) override;
+
   // For attribute in std::vector<Attribute>, name it as rel.attr
   void getAttributes(std::vector<Attribute> &attrs) const override;
 
@@ -214,6 +243,8 @@ class Filter : public Iterator {
   const Condition condition_;
   std::vector<Attribute> attrs_;
   int attr_idx_;
+  Comparator compare_; // resolved from condition once, nullptr for NO_OP
+  RecordView view_;
 };
 
 class Project : public Iterator {
@@ -264,6 +295,7 @@ class BNLJoin : public Iterator {
   int r_pos_;
   char *l_buffer_; // in-memory buffer with size = num_pages * PAGE_SIZE, used for loading outer table into hash table
   char *r_buffer_;
+  RecordView r_view_; // right tuple is only copied into r_buffer_ when it matches
   std::unordered_map<Key, std::vector<char *>, KeyHash> hash_map_;
   bool same_key_in_left_; // true when going to iter multiple records in left table that matches the same key with current right record
   std::pair<std::vector<char *>::iterator, std::vector<char *>::iterator> same_key_iter_; // curr and end
@@ -330,6 +362,7 @@ class GHJoin : public Iterator {
   std::unordered_map<Key, std::vector<RID>, KeyHash> hash_map_;
   RBFM_ScanIterator r_iter_;
   char *r_buffer_;
+  RecordView r_view_; // right record is only copied into r_buffer_ when it matches
 
   bool same_key_in_left_;
   std::pair<std::vector<RID>::iterator, std::vector<RID>::iterator> same_key_iter_; // curr and end
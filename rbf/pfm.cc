@@ -1,5 +1,14 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <algorithm>
+
 #include "pfm.h"
-#include "rbfm.h"
 
 /**
  * ======= Logger =======
@@ -28,9 +37,17 @@ PagedFileManager::PagedFileManager(const PagedFileManager &) = default;
 
 PagedFileManager &PagedFileManager::operator=(const PagedFileManager &) = default;
 
-RC PagedFileManager::createFile(const std::string &fileName) {
+RC PagedFileManager::createFile(const std::string &fileName, size_t pageSize, PageLayout layout) {
   FileHandle handler;
-  return handler.createFile(fileName);
+  RC ret = handler.createFile(fileName, pageSize, layout);
+  if (ret) return ret;
+  // in case frames of a destroyed file with the same name are still cached
+  if (BufferPool::instance().discardFile(fileName)) {
+    remove(fileName.c_str());
+    return -1;
+  }
+  LogManager::instance().logCreate(fileName);
+  return 0;
 }
 
 RC PagedFileManager::destroyFile(const std::string &fileName) {
@@ -38,150 +55,616 @@ RC PagedFileManager::destroyFile(const std::string &fileName) {
     DB_WARNING << "try to delete non-exist file " << fileName;
     return -1;
   }
-  return remove(fileName.c_str());
+  if (BufferPool::instance().discardFile(fileName)) return -1;
+  RC ret = remove(fileName.c_str());
+  if (ret == 0) LogManager::instance().logDrop(fileName);
+  return ret;
 }
 
-RC PagedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle) {
-  return fileHandle.openFile(fileName);
+RC PagedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle, OpenMode mode) {
+  return fileHandle.openFile(fileName, mode);
 }
 
 RC PagedFileManager::closeFile(FileHandle &fileHandle) {
   return fileHandle.closeFile();
 }
 
+/**
+ * ======= PageIO ==========
+ */
+
+const size_t PageIO::ALIGNMENT = 4096;
+
+PageIO::PageIO() : fd_(-1), direct_(false), page_size_(PAGE_SIZE), map_(nullptr), map_size_(0), sequential_(false) {}
+
+PageIO::~PageIO() {
+  close();
+}
+
+RC PageIO::open(const std::string &fileName, OpenMode mode) {
+  if (fd_ >= 0) return -1;
+  direct_ = false;
+  if (mode == OPEN_DIRECT) {
+    fd_ = ::open(fileName.c_str(), O_RDWR | O_DIRECT);
+    if (fd_ >= 0) {
+      direct_ = true;
+      return 0;
+    }
+    if (errno != EINVAL) return -1;
+    // file system does not support O_DIRECT
+    DB_WARNING << "O_DIRECT not supported for " << fileName << ", fall back to buffered I/O";
+  }
+  fd_ = ::open(fileName.c_str(), mode == OPEN_MMAP_READ_ONLY ? O_RDONLY : O_RDWR);
+  return fd_ >= 0 ? 0 : -1;
+}
+
+RC PageIO::create(const std::string &fileName) {
+  if (fd_ >= 0) return -1;
+  fd_ = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  return fd_ >= 0 ? 0 : -1;
+}
+
+RC PageIO::close() {
+  if (fd_ < 0) return -1;
+  unmap();
+  sequential_ = false;
+  page_size_ = PAGE_SIZE;
+  RC ret = ::close(fd_);
+  fd_ = -1;
+  return ret;
+}
+
+bool PageIO::isOpen() const {
+  return fd_ >= 0;
+}
+
+RC PageIO::sync() const {
+  return fd_ >= 0 && fsync(fd_) == 0 ? 0 : -1;
+}
+
+RC PageIO::truncate(size_t size) const {
+  return fd_ >= 0 && ftruncate(fd_, size) == 0 ? 0 : -1;
+}
+
+void PageIO::setPageSize(size_t page_size) {
+  page_size_ = page_size;
+}
+
+bool PageIO::isValidPageSize(size_t page_size) {
+  // power of 2, so that pages stay aligned for O_DIRECT and offsets inside a page have a fixed bit width
+  return page_size >= PAGE_SIZE && page_size <= MAX_PAGE_SIZE && (page_size & (page_size - 1)) == 0;
+}
+
+RC PageIO::readPage(PageNum pageNum, void *data) const {
+  return readAt(getPos(pageNum), data, page_size_);
+}
+
+RC PageIO::writePage(PageNum pageNum, const void *data) const {
+  return writeAt(getPos(pageNum), data, page_size_);
+}
+
+RC PageIO::readPages(PageNum firstPage, const std::vector<char *> &pages) const {
+  for (char *page : pages) {
+    if (!needBounce(0, page, page_size_)) continue;
+    // every vector has to be aligned for O_DIRECT, read one by one instead
+    for (size_t i = 0; i < pages.size(); ++i) {
+      if (readPage(firstPage + i, pages[i])) return -1;
+    }
+    return 0;
+  }
+  std::vector<struct iovec> iov(pages.size());
+  for (size_t i = 0; i < pages.size(); ++i) iov[i] = {pages[i], page_size_};
+  size_t total = pages.size() * page_size_;
+  size_t done = 0;
+  off_t pos = getPos(firstPage);
+  size_t idx = 0;
+  while (done < total) {
+    ssize_t n = preadv(fd_, iov.data() + idx, std::min(iov.size() - idx, size_t(IOV_MAX)), pos + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    done += n;
+    // skip fully read vectors, and adjust the partially read one
+    while (idx < iov.size() && size_t(n) >= iov[idx].iov_len) n -= iov[idx++].iov_len;
+    if (n) {
+      iov[idx].iov_base = (char *) iov[idx].iov_base + n;
+      iov[idx].iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+RC PageIO::writePages(PageNum firstPage, const std::vector<const char *> &pages) const {
+  for (const char *page : pages) {
+    if (!needBounce(0, page, page_size_)) continue;
+    for (size_t i = 0; i < pages.size(); ++i) {
+      if (writePage(firstPage + i, pages[i])) return -1;
+    }
+    return 0;
+  }
+  std::vector<struct iovec> iov(pages.size());
+  for (size_t i = 0; i < pages.size(); ++i) iov[i] = {const_cast<char *>(pages[i]), page_size_};
+  size_t total = pages.size() * page_size_;
+  size_t done = 0;
+  off_t pos = getPos(firstPage);
+  size_t idx = 0;
+  while (done < total) {
+    ssize_t n = pwritev(fd_, iov.data() + idx, std::min(iov.size() - idx, size_t(IOV_MAX)), pos + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    done += n;
+    while (idx < iov.size() && size_t(n) >= iov[idx].iov_len) n -= iov[idx++].iov_len;
+    if (n) {
+      iov[idx].iov_base = (char *) iov[idx].iov_base + n;
+      iov[idx].iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+const char *PageIO::mappedPage(PageNum pageNum) {
+  size_t end = getPos(pageNum) + page_size_;
+  // file might grow after last mapping
+  if (end > map_size_ && remap()) return nullptr;
+  if (end > map_size_) return nullptr;
+  return map_ + getPos(pageNum);
+}
+
+void PageIO::adviseSequential() {
+  sequential_ = true;
+  if (map_) madvise(map_, map_size_, MADV_SEQUENTIAL);
+}
+
+RC PageIO::remap() {
+  struct stat st;
+  if (fd_ < 0 || fstat(fd_, &st)) return -1;
+  size_t size = st.st_size;
+  if (size == map_size_) return 0;
+  unmap();
+  if (size == 0) return 0;
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd_, 0);
+  if (addr == MAP_FAILED) {
+    DB_WARNING << "failed to mmap " << size << " bytes";
+    return -1;
+  }
+  map_ = (char *) addr;
+  map_size_ = size;
+  if (sequential_) madvise(map_, map_size_, MADV_SEQUENTIAL);
+  return 0;
+}
+
+void PageIO::unmap() {
+  if (map_) munmap(map_, map_size_);
+  map_ = nullptr;
+  map_size_ = 0;
+}
+
+RC PageIO::readAt(size_t pos, void *data, size_t size) const {
+  if (!needBounce(pos, data, size)) return rawRead(pos, data, size);
+  size_t begin = pos & ~(ALIGNMENT - 1);
+  size_t end = (pos + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  char *buf = allocAligned(end - begin);
+  RC ret = rawRead(begin, buf, end - begin);
+  if (!ret) memcpy(data, buf + pos - begin, size);
+  freeAligned(buf);
+  return ret;
+}
+
+RC PageIO::writeAt(size_t pos, const void *data, size_t size) const {
+  if (!needBounce(pos, data, size)) return rawWrite(pos, data, size);
+  // read-modify-write the aligned blocks covering [pos, pos + size)
+  size_t begin = pos & ~(ALIGNMENT - 1);
+  size_t end = (pos + size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  char *buf = allocAligned(end - begin);
+  RC ret = rawRead(begin, buf, end - begin);
+  if (!ret) {
+    memcpy(buf + pos - begin, data, size);
+    ret = rawWrite(begin, buf, end - begin);
+  }
+  freeAligned(buf);
+  return ret;
+}
+
+char *PageIO::allocAligned(size_t size) {
+  void *ptr = nullptr;
+  if (posix_memalign(&ptr, ALIGNMENT, size)) throw std::bad_alloc();
+  memset(ptr, 0, size);
+  return static_cast<char *>(ptr);
+}
+
+void PageIO::freeAligned(void *ptr) {
+  free(ptr);
+}
+
+RC PageIO::rawRead(size_t pos, void *data, size_t size) const {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pread(fd_, (char *) data + done, size - done, pos + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) return -1;
+    // read beyond EOF, treat as zero. with O_DIRECT a short read already means EOF, and reading on from an
+    // unaligned position would fail
+    if (n == 0 || (direct_ && size_t(n) < size - done)) {
+      memset((char *) data + done + n, 0, size - done - n);
+      break;
+    }
+    done += n;
+  }
+  return 0;
+}
+
+RC PageIO::rawWrite(size_t pos, const void *data, size_t size) const {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pwrite(fd_, (const char *) data + done, size - done, pos + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
 /**
  * ======= FileHandle ==========
  */
 
-FileHandle::FileHandle() : readPageCounter(0), writePageCounter(0), appendPageCounter(0), meta_modified_(false) {
+const unsigned FileHandle::FORMAT_VERSION = 5;
+static const unsigned PAGE_SIZE_HEADER_VERSION = 2; // first version with page size in header
+static const unsigned LAYOUT_HEADER_VERSION = 5;    // first version with page layout in header
+
+// only the first PAGE_SIZE bytes of header page are used, whatever the page size of file is
+static const size_t HEADER_LAYOUT_OFFSET = 5 * sizeof(unsigned);
+static const size_t HEADER_APPEND_COUNTER_OFFSET = 2 * sizeof(unsigned);
+
+FileHandle::FileHandle()
+    : readPageCounter(0), writePageCounter(0), appendPageCounter(0), meta_modified_(false), mode_(OPEN_READ_WRITE),
+      read_ahead_(nullptr), format_version_(FORMAT_VERSION), layout_(LAYOUT_ROW) {
 
 }
 
-FileHandle::~FileHandle() = default;
+FileHandle::~FileHandle() {
+  // dirty frames must not outlive the handle that is responsible to write them back, and with write-ahead log the
+  // counters in header must be written before the log is truncated, so close it
+  if (io_.isOpen()) closeFile();
+}
 
-RC FileHandle::openFile(const std::string &fileName) {
+RC FileHandle::openFile(const std::string &fileName, OpenMode mode) {
   if (!PagedFileManager::ifFileExists(fileName)) {
 //    DB_WARNING << "try to open non-exist file " << fileName;
     return -1;
   }
 
-  if (_file.is_open()) {
+  if (io_.isOpen()) {
     DB_WARNING << "file " << name << "already open!";
     return -1;
   }
 
-  _file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
-  if (!_file.good()) {
+  if (mode == OPEN_MMAP_READ_ONLY) {
+    // the mapping only sees what's on disk, so cached modifications made by other handles have to land first
+    if (BufferPool::instance().flushFile(fileName)) return -1;
+  }
+  if (io_.open(fileName, mode)) {
 //    DB_WARNING << "failed to open file " << fileName;
     return -1;
   }
+  mode_ = mode;
   meta_modified_ = false;
   name = fileName;
-  // load counter from metadata
-  _file.seekg(0);
-  _file.read((char *) &readPageCounter, sizeof(unsigned));
-  _file.read((char *) &writePageCounter, sizeof(unsigned));
-  _file.read((char *) &appendPageCounter, sizeof(unsigned));
-
-  // load free space for each page
-  // meta pages store free space are always appended at the end
-  int num_pages = getNumberOfPages();
-  _file.seekg(getPos(num_pages));
-  for (int i = 0; i < num_pages; ++i) {
-    // construct a Page object, read page to buffer, parse meta in corresponding data to initialize in-memory variables,
-    std::shared_ptr<Page> cur_page = std::make_shared<Page>(i);
-    _file.read((char *) (&cur_page->real_free_space_), sizeof(unsigned));
-    _file.read((char *) (&cur_page->free_space), sizeof(unsigned));
-
-    pages_.push_back(cur_page);
-  }
-
-  return 0;
+  RC ret = loadMeta();
+  if (!ret && !isMapped()) openHandles().insert(this);
+  if (!ret) BufferPool::instance().addHandle(*this);
+  return ret;
 }
 
 RC FileHandle::closeFile() {
-  if (!_file.is_open()) {
+  if (!io_.isOpen()) {
 //    DB_WARNING << "File not opened.";
     return -1;
   }
 
-  // flush new counters to metadata
-  _file.seekp(0);
-  _file.write((char *) &readPageCounter, sizeof(unsigned));
-  _file.write((char *) &writePageCounter, sizeof(unsigned));
-  _file.write((char *) &appendPageCounter, sizeof(unsigned));
-
-  // flush pages free space to metadata at tail
-  if (meta_modified_) {
-    int page_num = getNumberOfPages();
-    _file.seekp(getPos(page_num));
-    for (int i = 0; i < page_num; ++i) {
-      _file.write((char *) (&pages_[i]->real_free_space_), sizeof(unsigned));
-      _file.write((char *) (&pages_[i]->free_space), sizeof(unsigned));
-    }
+  BufferPool::instance().removeHandle(*this);
+  // in-flight background reads must finish before fd is closed
+  if (read_ahead_) read_ahead_->detach();
+  RC ret = 0;
+  if (!isMapped()) {
+    openHandles().erase(this);
+    // write back dirty frames before flushing metadata, since it might modify counters and free space. with
+    // write-ahead log they stay cached, the log covers them until they are written back
+    if (LogManager::instance().isOpen()) BufferPool::instance().detach(*this);
+    else if (BufferPool::instance().flushFile(*this)) return -1;
+    ret = dumpMeta();
   }
 
-  pages_.clear();
-  _file.close();
-  return 0;
+  fsm_.clear();
+  zone_map_.reset();
+  bloom_filter_.reset();
+  io_.close();
+  mode_ = OPEN_READ_WRITE;
+  return ret;
 }
 
-RC FileHandle::createFile(const std::string &fileName) {
+RC FileHandle::createFile(const std::string &fileName, size_t pageSize, PageLayout layout) {
 
   if (PagedFileManager::ifFileExists(fileName)) {
 //    DB_WARNING << "File " << fileName << " exist!";
     return -1;
   }
 
-  if (_file.is_open())
+  if (io_.isOpen())
     return -1;
 
-  _file.open(fileName, std::ios::out | std::ios::binary);
-  if (!_file.good()) {
+  if (!PageIO::isValidPageSize(pageSize)) {
+    DB_WARNING << "invalid page size " << pageSize;
+    return -1;
+  }
+
+  if (io_.create(fileName)) {
 //    DB_WARNING << "failed to create file " << fileName;
     return -1;
   }
-  // write counters as metadata to head of file
-  return closeFile();
+  io_.setPageSize(pageSize);
+  format_version_ = FORMAT_VERSION;
+  layout_ = layout;
+  // write counters as metadata to head of file, synced since logged writes of the file might be replayed onto it
+  RC ret = dumpMeta();
+  if (!ret) ret = io_.sync();
+  io_.close();
+  return ret;
+}
+
+RC FileHandle::loadMeta() {
+  /*
+   * layout of header page: [readPageCounter, writePageCounter, appendPageCounter, version, page size, page layout,
+   * ...group summaries...]
+   * files written before FSM pages existed have version 0 and keep free space at tail of file, version 1 has no page
+   * size field. both have PAGE_SIZE pages, and are rewritten as version 2 on close. versions before 5 have no page
+   * layout field
+   */
+  char *header = PageIO::allocAligned(PAGE_SIZE);
+  RC ret = io_.readAt(0, header, PAGE_SIZE);
+  unsigned counters[6];
+  memcpy(counters, header, sizeof(counters));
+  unsigned num_pages = counters[2];
+  unsigned version = counters[3];
+  if (!ret && version > FORMAT_VERSION) {
+    DB_ERROR << name << " has unknown format version " << version;
+    ret = -1;
+  }
+  if (!ret && version == 0 && num_pages) {
+    DB_WARNING << "upgrade " << name << " to format version " << PAGE_SIZE_HEADER_VERSION;
+    if (isMapped()) {
+      // mapped file is opened read-only
+      PageIO io;
+      ret = io.open(name) || upgradeLayout(io, num_pages);
+    } else {
+      ret = upgradeLayout(io_, num_pages);
+    }
+    if (!ret) ret = io_.readAt(0, header, PAGE_SIZE);
+    memcpy(counters, header, sizeof(counters));
+    version = counters[3];
+  }
+  size_t summary_offset = summaryOffset(version);
+  size_t page_size = counters[4];
+  unsigned layout = version >= LAYOUT_HEADER_VERSION ? counters[5] : unsigned(LAYOUT_ROW);
+  if (version < PAGE_SIZE_HEADER_VERSION) {
+    page_size = PAGE_SIZE;
+    version = PAGE_SIZE_HEADER_VERSION;
+  }
+  if (!ret && !PageIO::isValidPageSize(page_size)) {
+    DB_ERROR << name << " has invalid page size " << page_size;
+    ret = -1;
+  }
+  if (!ret && layout != LAYOUT_ROW && layout != LAYOUT_PAX) {
+    DB_ERROR << name << " has unknown page layout " << layout;
+    ret = -1;
+  }
+  if (!ret) {
+    io_.setPageSize(page_size);
+    format_version_ = version;
+    layout_ = PageLayout(layout);
+    readPageCounter = counters[0];
+    writePageCounter = counters[1];
+    appendPageCounter = num_pages;
+    auto summaries = reinterpret_cast<const FreeSpaceMap::entry_t *>(header + summary_offset);
+    fsm_.attach(&io_, num_pages, summaries, (PAGE_SIZE - summary_offset) / sizeof(FreeSpaceMap::entry_t));
+  }
+  PageIO::freeAligned(header);
+  return ret;
+}
+
+RC FileHandle::dumpMeta() {
+  std::vector<FreeSpaceMap::entry_t> summaries;
+  if (fsm_.flush(summaries)) return -1;
+  unsigned counters[3] = {readPageCounter, writePageCounter, appendPageCounter};
+  return writeHeader(io_, counters, format_version_, layout_, summaries);
+}
+
+RC FileHandle::writeHeader(const PageIO &io,
+                           const unsigned counters[3],
+                           unsigned version,
+                           PageLayout layout,
+                           const std::vector<FreeSpaceMap::entry_t> &summaries) {
+  char *header = PageIO::allocAligned(PAGE_SIZE);
+  unsigned page_size = io.getPageSize();
+  memcpy(header, counters, 3 * sizeof(unsigned));
+  memcpy(header + 3 * sizeof(unsigned), &version, sizeof(unsigned));
+  memcpy(header + 4 * sizeof(unsigned), &page_size, sizeof(unsigned));
+  if (version >= LAYOUT_HEADER_VERSION) {
+    unsigned layout_value = layout;
+    memcpy(header + HEADER_LAYOUT_OFFSET, &layout_value, sizeof(unsigned));
+  }
+  // summaries that do not fit are left UNKNOWN, their FSM pages will be loaded when searching
+  size_t summary_offset = summaryOffset(version);
+  size_t num_summaries = std::min(summaries.size(), (PAGE_SIZE - summary_offset) / sizeof(FreeSpaceMap::entry_t));
+  memcpy(header + summary_offset, summaries.data(), num_summaries * sizeof(FreeSpaceMap::entry_t));
+  RC ret = io.writeAt(0, header, PAGE_SIZE);
+  PageIO::freeAligned(header);
+  return ret;
+}
+
+RC FileHandle::upgradeLayout(const PageIO &io, unsigned num_pages) {
+  // old layout: page n at (n + 1) * PAGE_SIZE, followed by pairs of (real_free_space, free_space) of every page
+  std::vector<unsigned> free_spaces(2 * num_pages);
+  if (io.readAt(io.getPos(num_pages), free_spaces.data(), free_spaces.size() * sizeof(unsigned))) return -1;
+
+  FreeSpaceMap fsm;
+  fsm.attach(&io, 0, nullptr, 0);
+
+  // new position is always behind old one, move from back to front so nothing is overwritten before moved
+  char *page = PageIO::allocAligned(PAGE_SIZE);
+  for (PageNum page_num = num_pages; page_num-- > 0;) {
+    if (io.readPage(page_num, page) || io.writePage(fsm.toPhysical(page_num), page)) {
+      PageIO::freeAligned(page);
+      return -1;
+    }
+  }
+  PageIO::freeAligned(page);
+
+  for (PageNum page_num = 0; page_num < num_pages; ++page_num) fsm.append(free_spaces[2 * page_num + 1]);
+  std::vector<FreeSpaceMap::entry_t> summaries;
+  if (fsm.flush(summaries)) return -1;
+
+  unsigned counters[3];
+  if (io.readAt(0, counters, sizeof(counters))) return -1;
+  // heap pages are not touched, so they still have packed slot directories
+  return writeHeader(io, counters, PAGE_SIZE_HEADER_VERSION, LAYOUT_ROW, summaries);
+}
+
+size_t FileHandle::summaryOffset(unsigned version) {
+  if (version < PAGE_SIZE_HEADER_VERSION) return 4 * sizeof(unsigned);
+  if (version < LAYOUT_HEADER_VERSION) return 5 * sizeof(unsigned);
+  return 6 * sizeof(unsigned);
 }
 
 RC FileHandle::readPage(PageNum pageNum, void *data) {
   // pageNum exceed total number of pages
-  if (pageNum >= getNumberOfPages() || !_file.is_open())
+  if (pageNum >= getNumberOfPages() || !io_.isOpen())
     return -1;
-  _file.seekg(getPos(pageNum));
-  _file.read((char *) data, PAGE_SIZE);
+  if (isMapped()) {
+    const char *page = io_.mappedPage(fsm_.toPhysical(pageNum));
+    if (!page) return -1;
+    memcpy(data, page, getPageSize());
+  } else if (read_ahead_ && read_ahead_->take(pageNum, data)) {
+    return 0; // counted when prefetch was issued
+  } else if (io_.readPage(fsm_.toPhysical(pageNum), data)) return -1;
   readPageCounter++;
   return 0;
 }
 
 RC FileHandle::writePage(PageNum pageNum, const void *data) {
-  if (pageNum >= getNumberOfPages() || !_file.is_open())
+  if (pageNum >= getNumberOfPages() || !io_.isOpen() || isMapped())
     return -1;
   meta_modified_ = true;
-  _file.seekp(getPos(pageNum));
-  _file.write((char *) data, PAGE_SIZE);
+  if (io_.writePage(fsm_.toPhysical(pageNum), data)) return -1;
   writePageCounter++;
+  BufferPool::instance().refresh(name, pageNum, data);
+  BufferPool::instance().pageWritten(name, pageNum);
   return 0;
 }
 
 RC FileHandle::appendPage(const void *data) {
-  if (!_file.is_open()) {
+  if (!io_.isOpen() || isMapped()) {
 //    DB_WARNING << "File is not opened!";
     return -1;
   }
   meta_modified_ = true;
-  _file.seekp(getPos(appendPageCounter)); // this will overwrite the tailing meta pages
-  _file.write((char *) data, PAGE_SIZE);
+  if (io_.writePage(fsm_.toPhysical(appendPageCounter), data)) return -1;
+  if (LogManager::instance().isOpen()) {
+    // the new page as a whole, and the counter in header
+    LogScope scope;
+    logPage(appendPageCounter, static_cast<const char *>(data), {{0, getPageSize()}});
+    unsigned num_pages = appendPageCounter + 1;
+    LogManager::instance().logWrite(name, HEADER_APPEND_COUNTER_OFFSET, &num_pages, sizeof(num_pages));
+  }
   appendPageCounter++;
 
-  std::shared_ptr<Page> cur_page = std::make_shared<Page>(pages_.size());
-  cur_page->real_free_space_ = PAGE_SIZE - 2 * sizeof(unsigned);
-  cur_page->free_space = cur_page->real_free_space_ - sizeof(unsigned);
-  pages_.push_back(cur_page);
+  // free space of an empty heap page: page tail reserves num_slots and real_free_space, plus one 8-byte slot directory
+  fsm_.append(getPageSize() - 4 * sizeof(unsigned));
+  BufferPool::instance().fileResized(name, appendPageCounter);
   return 0;
 }
 
+RC FileHandle::truncate(unsigned numPages) {
+  if (!io_.isOpen() || isMapped() || numPages > appendPageCounter) return -1;
+  if (numPages == appendPageCounter) return 0;
+  if (BufferPool::instance().discardPages(name, numPages)) return -1;
+  BufferPool::instance().fileResized(name, numPages);
+  meta_modified_ = true;
+  if (LogManager::instance().isOpen()) {
+    // counter goes first, so that replaying writes to dropped pages can't make them reachable again
+    LogScope scope;
+    LogManager::instance().logWrite(name, HEADER_APPEND_COUNTER_OFFSET, &numPages, sizeof(numPages));
+  }
+  appendPageCounter = numPages;
+  fsm_.truncate(numPages);
+  // when the last group is full, toPhysical(numPages) is behind the FSM page of the next group, which is dropped too
+  PageNum end = fsm_.toPhysical(numPages);
+  if (numPages % (getPageSize() / sizeof(FreeSpaceMap::entry_t)) == 0) --end;
+  return io_.truncate(io_.getPos(end));
+}
+
+const char *FileHandle::mappedPage(PageNum pageNum) {
+  if (!isMapped() || pageNum >= getNumberOfPages()) return nullptr;
+  return io_.mappedPage(fsm_.toPhysical(pageNum));
+}
+
+void FileHandle::adviseSequential() {
+  if (isMapped()) io_.adviseSequential();
+}
+
+void FileHandle::attachReadAhead(ReadAhead *read_ahead) {
+  ReadAhead *old;
+  {
+    std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+    old = read_ahead_;
+    read_ahead_ = read_ahead;
+  }
+  // detaching the old one detaches it from this handle, which takes the lock again
+  if (old && old != read_ahead) old->detach();
+}
+
+void FileHandle::detachReadAhead(ReadAhead *read_ahead) {
+  std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+  if (read_ahead_ == read_ahead) read_ahead_ = nullptr;
+}
+
+void FileHandle::invalidate(PageNum pageNum) {
+  std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+  if (read_ahead_) read_ahead_->invalidate(pageNum);
+}
+
+void FileHandle::followSize(unsigned numPages) {
+  // a mapped handle reads whatever is on disk, a writable one only sees pages appended through itself
+  if (isMapped()) {
+    appendPageCounter = numPages;
+    return;
+  }
+  std::lock_guard<std::mutex> lock(read_ahead_mutex_);
+  for (PageNum page_num = numPages; read_ahead_ && page_num < appendPageCounter; ++page_num) {
+    read_ahead_->invalidate(page_num);
+  }
+}
+
+void FileHandle::logPage(PageNum pageNum, const char *page, std::initializer_list<std::pair<size_t, size_t>> ranges) {
+  LogManager::instance().logPage(name, io_.getPos(fsm_.toPhysical(pageNum)), page, getPageSize(), ranges);
+}
+
+RC FileHandle::dumpOpenFiles() {
+  for (FileHandle *handle : openHandles()) {
+    if (handle->dumpMeta()) return -1;
+  }
+  return 0;
+}
+
+std::unordered_set<FileHandle *> &FileHandle::openHandles() {
+  static std::unordered_set<FileHandle *> _open_handles;
+  return _open_handles;
+}
+
+void FileHandle::setFormatVersion(unsigned version) {
+  format_version_ = version;
+  meta_modified_ = true;
+}
+
 unsigned FileHandle::getNumberOfPages() {
   return appendPageCounter;
 }
@@ -192,3 +675,1200 @@ RC FileHandle::collectCounterValues(unsigned &readPageCount, unsigned &writePage
   appendPageCount = appendPageCounter;
   return 0;
 }
+
+/**
+ * ======= MaxTree ==========
+ */
+
+MaxTree::MaxTree() : size_(0), leaf_num_(1), tree_(2, 0) {}
+
+void MaxTree::clear() {
+  size_ = 0;
+  leaf_num_ = 1;
+  tree_.assign(2, 0);
+}
+
+void MaxTree::append(unsigned value) {
+  if (size_ == leaf_num_) {
+    // double the leaves and rebuild inner nodes
+    std::vector<unsigned> tree(4 * leaf_num_, 0);
+    std::copy(tree_.begin() + leaf_num_, tree_.end(), tree.begin() + 2 * leaf_num_);
+    leaf_num_ *= 2;
+    for (size_t i = leaf_num_ - 1; i > 0; --i) tree[i] = std::max(tree[2 * i], tree[2 * i + 1]);
+    tree_.swap(tree);
+  }
+  update(size_++, value);
+}
+
+void MaxTree::update(size_t index, unsigned value) {
+  size_t node = leaf_num_ + index;
+  tree_[node] = value;
+  for (node /= 2; node > 0; node /= 2) {
+    unsigned max = std::max(tree_[2 * node], tree_[2 * node + 1]);
+    if (tree_[node] == max) break;
+    tree_[node] = max;
+  }
+}
+
+unsigned MaxTree::get(size_t index) const {
+  return tree_[leaf_num_ + index];
+}
+
+size_t MaxTree::findFirst(unsigned value) const {
+  if (size_ == 0 || tree_[1] < value) return size_;
+  size_t node = 1;
+  while (node < leaf_num_) {
+    node = tree_[2 * node] >= value ? 2 * node : 2 * node + 1;
+  }
+  return std::min(node - leaf_num_, size_);
+}
+
+/**
+ * ======= FreeSpaceMap ==========
+ */
+
+// free space of a page never reaches MAX_PAGE_SIZE, so it always fits into an entry
+const FreeSpaceMap::entry_t FreeSpaceMap::UNKNOWN = UINT16_MAX;
+
+FreeSpaceMap::FreeSpaceMap() : io_(nullptr), entries_per_page_(PAGE_SIZE / sizeof(entry_t)), size_(0) {}
+
+void FreeSpaceMap::attach(const PageIO *io, size_t num_pages, const entry_t *summaries, size_t num_summaries) {
+  clear();
+  io_ = io;
+  entries_per_page_ = io->getPageSize() / sizeof(entry_t);
+  size_ = num_pages;
+  size_t num_groups = (num_pages + entries_per_page_ - 1) / entries_per_page_;
+  for (size_t group = 0; group < num_groups; ++group) {
+    summaries_.append(group < num_summaries ? summaries[group] : UNKNOWN);
+  }
+}
+
+RC FreeSpaceMap::flush(std::vector<entry_t> &summaries) {
+  char *page = nullptr;
+  for (auto &kv : groups_) {
+    Group *group = kv.second.get();
+    if (!group->dirty) continue;
+    if (!page) page = PageIO::allocAligned(io_->getPageSize());
+    auto entries = reinterpret_cast<entry_t *>(page);
+    for (size_t i = 0; i < entries_per_page_; ++i) {
+      entries[i] = i < group->entries.size() ? group->entries.get(i) : 0;
+    }
+    if (io_->writePage(kv.first * (entries_per_page_ + 1), page)) {
+      PageIO::freeAligned(page);
+      return -1;
+    }
+    group->dirty = false;
+  }
+  if (page) PageIO::freeAligned(page);
+
+  summaries.resize(summaries_.size());
+  for (size_t group = 0; group < summaries.size(); ++group) summaries[group] = summaries_.get(group);
+  return 0;
+}
+
+void FreeSpaceMap::clear() {
+  io_ = nullptr;
+  size_ = 0;
+  summaries_.clear();
+  groups_.clear();
+}
+
+void FreeSpaceMap::append(unsigned free_space) {
+  unsigned group_id = size_ / entries_per_page_;
+  Group *group;
+  if (size_ % entries_per_page_ == 0) {
+    // first page of a new group, FSM page will be written on flush
+    group = new Group{MaxTree(), true};
+    groups_[group_id].reset(group);
+    summaries_.append(0);
+  } else {
+    group = loadGroup(group_id);
+  }
+  group->entries.append(free_space);
+  group->dirty = true;
+  ++size_;
+  summaries_.update(group_id, group->entries.max());
+}
+
+void FreeSpaceMap::update(PageNum page_num, unsigned free_space) {
+  unsigned group_id = page_num / entries_per_page_;
+  Group *group = loadGroup(group_id);
+  size_t index = page_num % entries_per_page_;
+  if (group->entries.get(index) == free_space) return;
+  group->entries.update(index, free_space);
+  group->dirty = true;
+  summaries_.update(group_id, group->entries.max());
+}
+
+void FreeSpaceMap::truncate(size_t num_pages) {
+  if (num_pages >= size_) return;
+  size_t num_groups = (num_pages + entries_per_page_ - 1) / entries_per_page_;
+  size_t tail = num_pages % entries_per_page_;
+  if (tail) {
+    // MaxTree can only grow, rebuild entries of the group which is cut in the middle
+    Group *group = loadGroup(num_groups - 1);
+    MaxTree entries;
+    for (size_t i = 0; i < tail; ++i) entries.append(group->entries.get(i));
+    group->entries = entries;
+    group->dirty = true;
+  }
+  for (auto it = groups_.begin(); it != groups_.end();) {
+    if (it->first >= num_groups) {
+      it = groups_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  MaxTree summaries;
+  for (size_t group = 0; group < num_groups; ++group) summaries.append(summaries_.get(group));
+  summaries_ = summaries;
+  if (tail) summaries_.update(num_groups - 1, groups_[num_groups - 1]->entries.max());
+  size_ = num_pages;
+}
+
+unsigned FreeSpaceMap::get(PageNum page_num) {
+  return loadGroup(page_num / entries_per_page_)->entries.get(page_num % entries_per_page_);
+}
+
+PageNum FreeSpaceMap::findFirst(unsigned size) {
+  while (true) {
+    size_t group_id = summaries_.findFirst(size);
+    if (group_id == summaries_.size()) return size_;
+    // summary might be UNKNOWN, which is corrected once the group is loaded
+    size_t index = loadGroup(group_id)->entries.findFirst(size);
+    if (index < entries_per_page_ && group_id * entries_per_page_ + index < size_) {
+      return group_id * entries_per_page_ + index;
+    }
+  }
+}
+
+FreeSpaceMap::Group *FreeSpaceMap::loadGroup(unsigned group_id) {
+  auto it = groups_.find(group_id);
+  if (it != groups_.end()) return it->second.get();
+
+  Group *group = new Group{MaxTree(), false};
+  groups_[group_id].reset(group);
+  char *page = PageIO::allocAligned(io_->getPageSize());
+  if (io_->readPage(group_id * (entries_per_page_ + 1), page)) {
+    DB_ERROR << "failed to read FSM page of group " << group_id;
+  }
+  auto entries = reinterpret_cast<const entry_t *>(page);
+  size_t num_entries = std::min(size_t(entries_per_page_), size_ - size_t(group_id) * entries_per_page_);
+  for (size_t i = 0; i < num_entries; ++i) group->entries.append(entries[i]);
+  PageIO::freeAligned(page);
+  summaries_.update(group_id, group->entries.max());
+  return group;
+}
+
+/**
+ * ======= LogManager ==========
+ */
+
+const size_t LogManager::DEFAULT_CHECKPOINT_SIZE = 64 * 1024 * 1024;
+const unsigned LogManager::FLUSH_INTERVAL_MS = 10;
+const unsigned LogManager::DEFAULT_CHECKPOINT_INTERVAL_MS = 5 * 60 * 1000;
+
+/*
+ * a log record is [size, crc, type, name length, pos, file name, data], size counts the whole record and crc covers
+ * everything after it. a group is a series of records ended by a COMMIT record
+ */
+enum LogRecordType : uint8_t {
+  LOG_WRITE = 1,
+  LOG_CREATE = 2,
+  LOG_DROP = 3,
+  LOG_COMMIT = 4
+};
+
+static const size_t LOG_CRC_OFFSET = sizeof(uint32_t);
+static const size_t LOG_TYPE_OFFSET = 2 * sizeof(uint32_t);
+static const size_t LOG_NAME_SIZE_OFFSET = LOG_TYPE_OFFSET + sizeof(uint8_t);
+static const size_t LOG_POS_OFFSET = LOG_NAME_SIZE_OFFSET + sizeof(uint16_t);
+static const size_t LOG_HEADER_SIZE = LOG_POS_OFFSET + sizeof(uint64_t);
+
+static uint32_t crc32(const char *data, size_t size) {
+  static const std::vector<uint32_t> table = [] {
+    std::vector<uint32_t> t(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+      t[i] = c;
+    }
+    return t;
+  }();
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < size; ++i) crc = table[(crc ^ (unsigned char) data[i]) & 0xFF] ^ (crc >> 8);
+  return crc ^ 0xFFFFFFFF;
+}
+
+static RC writeFully(int fd, size_t pos, const char *data, size_t size) {
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = pwrite(fd, data + done, size - done, pos + done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    done += n;
+  }
+  return 0;
+}
+
+LogManager &LogManager::instance() {
+  static LogManager _log_manager;
+  return _log_manager;
+}
+
+LogManager::LogManager()
+    : fd_(-1), depth_(0), sync_commit_(true), checkpoint_size_(DEFAULT_CHECKPOINT_SIZE),
+      checkpoint_interval_ms_(DEFAULT_CHECKPOINT_INTERVAL_MS), base_lsn_(0), end_lsn_(0), durable_lsn_(0),
+      requested_lsn_(0), stop_(false), failed_(false) {
+  // checkpoint on destruction writes back frames, so BufferPool has to be destroyed after
+  BufferPool::instance();
+}
+
+LogManager::~LogManager() {
+  if (isOpen()) close();
+}
+
+RC LogManager::open(const std::string &path) {
+  if (isOpen()) return path == path_ ? 0 : -1;
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    DB_WARNING << "failed to open log " << path;
+    return -1;
+  }
+  // replayed writes are synced by recover, so log can be emptied
+  if (recover(fd) || ftruncate(fd, 0) || fsync(fd)) {
+    DB_ERROR << "failed to recover from log " << path;
+    ::close(fd);
+    return -1;
+  }
+  fd_ = fd;
+  path_ = path;
+  base_lsn_ = durable_lsn_ = requested_lsn_ = end_lsn_;
+  stop_ = failed_ = false;
+  last_checkpoint_ = std::chrono::steady_clock::now();
+  flusher_ = std::thread(&LogManager::flush, this);
+  return 0;
+}
+
+RC LogManager::close() {
+  if (!isOpen()) return -1;
+  if (depth_) {
+    DB_WARNING << "can not close log inside a scope";
+    return -1;
+  }
+  RC ret = checkpoint();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  flush_cv_.notify_one();
+  flusher_.join();
+  ::close(fd_);
+  fd_ = -1;
+  touched_.clear();
+  imaged_.clear();
+  return ret;
+}
+
+void LogManager::begin() {
+  ++depth_;
+}
+
+RC LogManager::commit() {
+  if (depth_ == 0) {
+    DB_WARNING << "commit without begin";
+    return -1;
+  }
+  // nested scope is committed by the outermost one
+  if (--depth_ || !isOpen()) return 0;
+  if (group_.empty()) {
+    BufferPool::instance().commit(committedLsn());
+    return runCommitHooks();
+  }
+  append(LOG_COMMIT, "", 0, nullptr, 0);
+  lsn_t lsn;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffer_.insert(buffer_.end(), group_.begin(), group_.end());
+    end_lsn_ += group_.size();
+    lsn = end_lsn_;
+  }
+  group_.clear();
+  BufferPool::instance().commit(lsn);
+  if (sync_commit_ && flushTo(lsn)) return -1;
+  if (runCommitHooks()) return -1;
+  if (lsn - base_lsn_ >= checkpoint_size_) return checkpoint();
+  if (checkpoint_interval_ms_ && std::chrono::steady_clock::now() - last_checkpoint_ >=
+      std::chrono::milliseconds(checkpoint_interval_ms_)) {
+    return checkpoint();
+  }
+  return 0;
+}
+
+void LogManager::logWrite(const std::string &file, size_t pos, const void *data, size_t size) {
+  if (!isOpen()) return;
+  LogScope scope;
+  append(LOG_WRITE, file, pos, data, size);
+  touched_.insert(file);
+}
+
+void LogManager::logPage(const std::string &file, size_t pos, const char *page, size_t page_size,
+                         std::initializer_list<std::pair<size_t, size_t>> ranges) {
+  if (!isOpen()) return;
+  LogScope scope;
+  if (imaged_[file].insert(pos).second) {
+    append(LOG_WRITE, file, pos, page, page_size);
+  } else {
+    for (auto &range : ranges) {
+      if (range.first >= range.second) continue;
+      append(LOG_WRITE, file, pos + range.first, page + range.first, range.second - range.first);
+    }
+  }
+  touched_.insert(file);
+}
+
+void LogManager::logCreate(const std::string &file) {
+  if (!isOpen()) return;
+  LogScope scope;
+  append(LOG_CREATE, file, 0, nullptr, 0);
+  imaged_.erase(file);
+}
+
+void LogManager::logDrop(const std::string &file) {
+  if (!isOpen()) return;
+  LogScope scope;
+  append(LOG_DROP, file, 0, nullptr, 0);
+  imaged_.erase(file);
+  touched_.erase(file);
+}
+
+RC LogManager::flushTo(lsn_t lsn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!isOpen() || durable_lsn_ >= lsn) return 0;
+  requested_lsn_ = std::max(requested_lsn_, lsn);
+  flush_cv_.notify_one();
+  durable_cv_.wait(lock, [&] { return durable_lsn_ >= lsn || failed_; });
+  return durable_lsn_ >= lsn ? 0 : -1;
+}
+
+LogManager::lsn_t LogManager::committedLsn() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return end_lsn_;
+}
+
+RC LogManager::checkpoint() {
+  if (!isOpen() || depth_) return -1;
+  if (flushTo(committedLsn())) return -1;
+
+  // everything the log covers goes to data files
+  if (FileHandle::dumpOpenFiles() || BufferPool::instance().flushAll()) return -1;
+  for (auto &hook : hooks_) {
+    if (hook()) return -1;
+  }
+  for (auto &file : touched_) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) continue; // destroyed
+    RC ret = fsync(fd);
+    ::close(fd);
+    if (ret) return -1;
+  }
+  touched_.clear();
+  imaged_.clear();
+  last_checkpoint_ = std::chrono::steady_clock::now();
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (ftruncate(fd_, 0) || fsync(fd_)) {
+    DB_ERROR << "failed to truncate log " << path_;
+    return -1;
+  }
+  base_lsn_ = end_lsn_;
+  return 0;
+}
+
+void LogManager::setSynchronousCommit(bool sync) {
+  sync_commit_ = sync;
+}
+
+void LogManager::setCheckpointSize(size_t bytes) {
+  checkpoint_size_ = bytes;
+}
+
+void LogManager::setCheckpointInterval(unsigned ms) {
+  checkpoint_interval_ms_ = ms;
+}
+
+void LogManager::addCheckpointHook(const std::function<RC()> &hook) {
+  hooks_.push_back(hook);
+}
+
+void LogManager::addCommitHook(const std::function<RC()> &hook) {
+  commit_hooks_.push_back(hook);
+}
+
+RC LogManager::runCommitHooks() {
+  for (auto &hook : commit_hooks_) {
+    if (hook()) return -1;
+  }
+  return 0;
+}
+
+void LogManager::append(uint8_t type, const std::string &file, size_t pos, const void *data, size_t size) {
+  uint32_t record_size = LOG_HEADER_SIZE + file.size() + size;
+  uint16_t name_size = file.size();
+  uint64_t position = pos;
+  size_t begin = group_.size();
+  group_.resize(begin + record_size);
+  char *record = group_.data() + begin;
+  memcpy(record, &record_size, sizeof(record_size));
+  memcpy(record + LOG_TYPE_OFFSET, &type, sizeof(type));
+  memcpy(record + LOG_NAME_SIZE_OFFSET, &name_size, sizeof(name_size));
+  memcpy(record + LOG_POS_OFFSET, &position, sizeof(position));
+  memcpy(record + LOG_HEADER_SIZE, file.data(), file.size());
+  if (size) memcpy(record + LOG_HEADER_SIZE + file.size(), data, size);
+  uint32_t crc = crc32(record + LOG_TYPE_OFFSET, record_size - LOG_TYPE_OFFSET);
+  memcpy(record + LOG_CRC_OFFSET, &crc, sizeof(crc));
+}
+
+void LogManager::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    flush_cv_.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this] {
+      return stop_ || (requested_lsn_ > durable_lsn_ && !buffer_.empty());
+    });
+    if (buffer_.empty()) {
+      if (stop_) return;
+      continue;
+    }
+    std::vector<char> batch;
+    batch.swap(buffer_);
+    lsn_t end = end_lsn_;
+    size_t pos = end - batch.size() - base_lsn_;
+    lock.unlock();
+    // groups committed meanwhile wait for the next round, and share its fsync
+    RC ret = writeFully(fd_, pos, batch.data(), batch.size());
+    if (!ret) ret = fdatasync(fd_);
+    lock.lock();
+    if (ret) {
+      DB_ERROR << "failed to write log " << path_;
+      failed_ = true;
+    } else {
+      durable_lsn_ = end;
+    }
+    durable_cv_.notify_all();
+  }
+}
+
+RC LogManager::recover(int fd) {
+  struct stat st;
+  if (fstat(fd, &st)) return -1;
+  std::vector<char> log(st.st_size);
+  size_t done = 0;
+  while (done < log.size()) {
+    ssize_t n = pread(fd, log.data() + done, log.size() - done, done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return -1;
+    done += n;
+  }
+
+  struct Record {
+    uint8_t type;
+    std::string file;
+    size_t pos;
+    const char *data;
+    size_t size;
+  };
+  // records of committed groups, the group being written at crash has no valid COMMIT record
+  std::vector<Record> records;
+  size_t committed = 0;
+  size_t groups = 0;
+  for (size_t pos = 0; pos + LOG_HEADER_SIZE <= log.size();) {
+    const char *record = log.data() + pos;
+    uint32_t record_size, crc;
+    uint8_t type;
+    uint16_t name_size;
+    uint64_t position;
+    memcpy(&record_size, record, sizeof(record_size));
+    memcpy(&crc, record + LOG_CRC_OFFSET, sizeof(crc));
+    memcpy(&type, record + LOG_TYPE_OFFSET, sizeof(type));
+    memcpy(&name_size, record + LOG_NAME_SIZE_OFFSET, sizeof(name_size));
+    memcpy(&position, record + LOG_POS_OFFSET, sizeof(position));
+    if (record_size < LOG_HEADER_SIZE + name_size || record_size > log.size() - pos
+        || crc32(record + LOG_TYPE_OFFSET, record_size - LOG_TYPE_OFFSET) != crc) {
+      break;
+    }
+    if (type == LOG_COMMIT) {
+      committed = records.size();
+      ++groups;
+    } else {
+      records.push_back({type, std::string(record + LOG_HEADER_SIZE, name_size), position,
+                         record + LOG_HEADER_SIZE + name_size, record_size - LOG_HEADER_SIZE - name_size});
+    }
+    pos += record_size;
+  }
+  records.resize(committed);
+
+  // writes before the last CREATE or DROP of a file belong to a destroyed file of the same name
+  std::unordered_map<std::string, size_t> last_reset;
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (records[i].type != LOG_WRITE) last_reset[records[i].file] = i;
+  }
+  std::unordered_map<std::string, int> fds;
+  RC ret = 0;
+  for (size_t i = 0; i < records.size() && !ret; ++i) {
+    auto &record = records[i];
+    if (record.type != LOG_WRITE) continue;
+    auto reset_it = last_reset.find(record.file);
+    if (reset_it != last_reset.end() && reset_it->second > i) continue;
+    auto fd_it = fds.find(record.file);
+    if (fd_it == fds.end()) fd_it = fds.emplace(record.file, ::open(record.file.c_str(), O_RDWR)).first;
+    if (fd_it->second < 0) continue; // removed without DROP record
+    ret = writeFully(fd_it->second, record.pos, record.data, record.size);
+  }
+  for (auto &kv : fds) {
+    if (kv.second < 0) continue;
+    if (fsync(kv.second)) ret = -1;
+    ::close(kv.second);
+  }
+  if (groups) DB_WARNING << "replayed " << groups << " committed groups from log";
+  return ret;
+}
+
+/**
+ * ======= BufferPool ==========
+ */
+
+const size_t BufferPool::DEFAULT_CAPACITY = 1024; // 1024 frames, which is 4MB for files of default page size
+const double BufferPool::DEFAULT_DIRTY_RATIO = 0.25;
+const unsigned BufferPool::WRITER_INTERVAL_MS = 100;
+const size_t BufferPool::WRITER_BATCH = 64;
+
+BufferPool &BufferPool::instance() {
+  static BufferPool _buffer_pool;
+  return _buffer_pool;
+}
+
+BufferPool::BufferPool()
+    : capacity_(DEFAULT_CAPACITY), clock_hand_(0), dirty_count_(0), dirty_ratio_(DEFAULT_DIRTY_RATIO),
+      pressure_(false), stop_(false) {
+  writer_ = std::thread(&BufferPool::write, this);
+}
+
+BufferPool::~BufferPool() {
+  {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    stop_ = true;
+  }
+  writer_cv_.notify_one();
+  writer_.join();
+  for (auto &frame : frames_) PageIO::freeAligned(frame->data);
+}
+
+BufferPool::Frame *BufferPool::lookup(const std::string &file_name, PageNum page_num) {
+  auto file_it = page_table_.find(file_name);
+  if (file_it == page_table_.end()) return nullptr;
+  auto frame_it = file_it->second.find(page_num);
+  return frame_it == file_it->second.end() ? nullptr : frame_it->second;
+}
+
+char *BufferPool::pin(FileHandle &handle, PageNum page_num, ScanRing *ring) {
+  if (page_num >= handle.getNumberOfPages()) return nullptr;
+  std::unique_lock<std::recursive_mutex> lock(mutex_);
+  Frame *frame;
+  // look it up again once it's loaded, the read might have failed
+  while ((frame = lookup(handle.name, page_num)) && frame->loading) loaded_cv_.wait(lock);
+  if (frame) {
+    if (frame->ring != ring) frame->ring = nullptr;
+    // a scan passing by does not make a page any hotter
+    if (!ring) frame->referenced = true;
+    ++frame->pin_count;
+    return frame->data;
+  }
+  frame = ring ? acquireRingFrame(ring, handle.getPageSize()) : acquireFrame(handle.getPageSize());
+  if (!frame) return nullptr;
+  frame->file_name = handle.name;
+  frame->page_num = page_num;
+  frame->dirty = false;
+  frame->owner = nullptr;
+  frame->lsn = 0;
+  frame->ring = ring;
+  frame->referenced = !ring;
+  page_table_[handle.name][page_num] = frame;
+
+  // the page is read without mutex_, the pin keeps the frame from being evicted and others wait until it's loaded
+  ++frame->pin_count;
+  frame->loading = true;
+  lock.unlock();
+  RC ret = handle.readPage(page_num, frame->data);
+  lock.lock();
+  frame->loading = false;
+  loaded_cv_.notify_all();
+  if (ret) {
+    DB_WARNING << "failed to read page " << page_num << " of " << handle.name;
+    --frame->pin_count;
+    evict(frame);
+    return nullptr;
+  }
+  return frame->data;
+}
+
+void BufferPool::unpin(FileHandle &handle, PageNum page_num, bool dirty) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  Frame *frame = lookup(handle.name, page_num);
+  if (!frame || frame->pin_count == 0) {
+    // file might be discarded while page is pinned
+    DB_WARNING << "unpin page " << page_num << " of " << handle.name << " which is not pinned";
+    return;
+  }
+  --frame->pin_count;
+  if (dirty) {
+    setDirty(frame, true);
+    frame->owner = &handle;
+    frame->ring = nullptr;
+    if (LogManager::instance().inScope() && !frame->uncommitted) {
+      frame->uncommitted = true;
+      uncommitted_.push_back(frame);
+    }
+    if (dirty_count_ > dirtyLimit()) writer_cv_.notify_one();
+  }
+}
+
+void BufferPool::commit(LogManager::lsn_t lsn) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  for (Frame *frame : uncommitted_) {
+    frame->uncommitted = false;
+    frame->lsn = lsn;
+  }
+  uncommitted_.clear();
+}
+
+RC BufferPool::flushFile(FileHandle &handle) {
+  // frames being written by writer thread are not dirty, but not on disk yet either
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto file_it = page_table_.find(handle.name);
+  if (file_it == page_table_.end()) return 0;
+  for (auto &kv : file_it->second) {
+    Frame *frame = kv.second;
+    if (frame->dirty && frame->owner == &handle && writeBack(frame)) return -1;
+  }
+  return 0;
+}
+
+RC BufferPool::flushFile(const std::string &fileName) {
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto file_it = page_table_.find(fileName);
+  if (file_it == page_table_.end()) return 0;
+  for (auto &kv : file_it->second) {
+    Frame *frame = kv.second;
+    if (frame->dirty && writeBack(frame)) return -1;
+  }
+  return 0;
+}
+
+RC BufferPool::flushAll() {
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  for (auto &frame : frames_) {
+    if (frame->dirty && !frame->file_name.empty() && writeBack(frame.get())) return -1;
+  }
+  return 0;
+}
+
+void BufferPool::detach(FileHandle &handle) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto file_it = page_table_.find(handle.name);
+  if (file_it == page_table_.end()) return;
+  for (auto &kv : file_it->second) {
+    if (kv.second->owner == &handle) kv.second->owner = nullptr;
+  }
+}
+
+RC BufferPool::discardFile(const std::string &fileName) {
+  // a batch in flight must not land in a file created later with the same name
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto file_it = page_table_.find(fileName);
+  if (file_it != page_table_.end()) {
+    for (auto &kv : file_it->second) {
+      if (kv.second->pin_count) {
+        DB_ERROR << "can not discard pinned page " << kv.second->page_num << " of " << fileName;
+        return -1;
+      }
+    }
+  }
+  background_writers_.erase(fileName);
+  writers_.erase(fileName);
+  if (file_it == page_table_.end()) return 0;
+  for (auto &kv : file_it->second) {
+    Frame *frame = kv.second;
+    frame->file_name.clear();
+    setDirty(frame, false);
+    frame->owner = nullptr;
+    frame->uncommitted = false;
+  }
+  page_table_.erase(file_it);
+  return 0;
+}
+
+RC BufferPool::discardPages(const std::string &fileName, PageNum from) {
+  std::lock_guard<std::mutex> io_lock(io_mutex_);
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  auto file_it = page_table_.find(fileName);
+  if (file_it == page_table_.end()) return 0;
+  for (auto &kv : file_it->second) {
+    if (kv.second->page_num >= from && kv.second->pin_count) {
+      DB_ERROR << "can not discard pinned page " << kv.second->page_num << " of " << fileName;
+      return -1;
+    }
+  }
+  for (auto it = file_it->second.begin(); it != file_it->second.end();) {
+    Frame *frame = it->second;
+    if (frame->page_num < from) {
+      ++it;
+      continue;
+    }
+    frame->file_name.clear();
+    setDirty(frame, false);
+    frame->owner = nullptr;
+    frame->uncommitted = false;
+    it = file_it->second.erase(it);
+  }
+  return 0;
+}
+
+void BufferPool::refresh(const std::string &fileName, PageNum page_num, const void *data) {
+  std::unique_lock<std::recursive_mutex> lock(mutex_);
+  Frame *frame;
+  // a read in flight might have missed this write
+  while ((frame = lookup(fileName, page_num)) && frame->loading) loaded_cv_.wait(lock);
+  if (!frame || frame->data == data) return;
+  memcpy(frame->data, data, frame->size);
+  // an older copy might be written by writer thread after this, write the page again later
+  setDirty(frame, frame->writing);
+  frame->owner = nullptr;
+}
+
+void BufferPool::addHandle(FileHandle &handle) {
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  handles_[handle.name].insert(&handle);
+}
+
+void BufferPool::removeHandle(FileHandle &handle) {
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  auto it = handles_.find(handle.name);
+  if (it == handles_.end()) return;
+  it->second.erase(&handle);
+  if (it->second.empty()) handles_.erase(it);
+}
+
+void BufferPool::pageWritten(const std::string &fileName, PageNum page_num) {
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  auto it = handles_.find(fileName);
+  if (it == handles_.end()) return;
+  for (FileHandle *handle : it->second) handle->invalidate(page_num);
+}
+
+void BufferPool::fileResized(const std::string &fileName, unsigned num_pages) {
+  std::lock_guard<std::mutex> lock(handles_mutex_);
+  auto it = handles_.find(fileName);
+  if (it == handles_.end()) return;
+  for (FileHandle *handle : it->second) handle->followSize(num_pages);
+}
+
+bool BufferPool::contains(const std::string &fileName, PageNum page_num) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  return lookup(fileName, page_num) != nullptr;
+}
+
+void BufferPool::setCapacity(size_t frames) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  capacity_ = std::max(frames, size_t(1));
+}
+
+size_t BufferPool::getCapacity() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  return capacity_;
+}
+
+void BufferPool::setDirtyRatio(double ratio) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  dirty_ratio_ = std::min(std::max(ratio, 0.0), 1.0);
+  writer_cv_.notify_one();
+}
+
+size_t BufferPool::getDirtyCount() {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  return dirty_count_;
+}
+
+BufferPool::Frame *BufferPool::acquireFrame(size_t size) {
+  // two full rounds are enough for clock: the first round clears all referenced bits. dirty frames are passed over
+  // in the first round, and only written here in the second one if writer thread has not cleaned anything meanwhile
+  if (frames_.size() >= capacity_) {
+    for (size_t i = 0; i < 2 * frames_.size(); ++i) {
+      Frame *frame = frames_[clock_hand_].get();
+      clock_hand_ = (clock_hand_ + 1) % frames_.size();
+      if (frame->pin_count || frame->uncommitted) continue;
+      if (frame->referenced && !frame->file_name.empty()) {
+        frame->referenced = false;
+        continue;
+      }
+      if (frame->dirty && i < frames_.size()) {
+        pressure_ = true;
+        continue;
+      }
+      if (frame->dirty && writeBack(frame)) return nullptr;
+      evict(frame);
+      if (frame->size != size) {
+        PageIO::freeAligned(frame->data);
+        frame->data = PageIO::allocAligned(size);
+        frame->size = size;
+      }
+      if (pressure_) writer_cv_.notify_one();
+      return frame;
+    }
+    DB_WARNING << "all " << frames_.size() << " frames are pinned, exceed capacity " << capacity_;
+  }
+  std::unique_ptr<Frame> frame(new Frame{"", 0, PageIO::allocAligned(size), size, 0, false, false, false, false,
+                                         nullptr, nullptr, false, 0});
+  frames_.push_back(std::move(frame));
+  return frames_.back().get();
+}
+
+BufferPool::Frame *BufferPool::acquireRingFrame(ScanRing *ring, size_t size) {
+  Frame *frame = nullptr;
+  if (ring->frames_.size() == ring->size_) {
+    Frame *&slot = ring->frames_[ring->next_];
+    ring->next_ = (ring->next_ + 1) % ring->size_;
+    if (slot->ring == ring && !slot->pin_count && !slot->dirty && !slot->uncommitted) {
+      frame = slot;
+      evict(frame);
+      if (frame->size != size) {
+        PageIO::freeAligned(frame->data);
+        frame->data = PageIO::allocAligned(size);
+        frame->size = size;
+      }
+      return frame;
+    }
+    // taken over by others, replace it with a frame from the pool
+    if (slot->ring == ring) slot->ring = nullptr;
+    frame = acquireFrame(size);
+    if (frame && std::find(ring->frames_.begin(), ring->frames_.end(), frame) == ring->frames_.end()) slot = frame;
+    return frame;
+  }
+  frame = acquireFrame(size);
+  if (frame && std::find(ring->frames_.begin(), ring->frames_.end(), frame) == ring->frames_.end()) {
+    ring->frames_.push_back(frame);
+  }
+  return frame;
+}
+
+void BufferPool::releaseRing(ScanRing *ring) {
+  std::lock_guard<std::recursive_mutex> lock(mutex_);
+  for (Frame *frame : ring->frames_) {
+    if (frame->ring == ring) frame->ring = nullptr;
+  }
+}
+
+void BufferPool::evict(Frame *frame) {
+  if (!frame->file_name.empty()) {
+    page_table_[frame->file_name].erase(frame->page_num);
+    frame->file_name.clear();
+  }
+  frame->ring = nullptr;
+}
+
+RC BufferPool::writeBack(Frame *frame) {
+  // page must not reach disk before the log describing it
+  RC ret = LogManager::instance().flushTo(frame->lsn);
+  if (!ret && frame->owner) {
+    ret = frame->owner->writePage(frame->page_num, frame->data);
+  } else if (!ret) {
+    // handle is closed, see detach
+    auto &writer = writers_[frame->file_name];
+    if (!writer) {
+      writer.reset(new PageIO());
+      writer->open(frame->file_name);
+      writer->setPageSize(frame->size);
+    }
+    ret = writer->writePage(FreeSpaceMap::toPhysical(frame->page_num, frame->size), frame->data);
+    if (ret) writers_.erase(frame->file_name);
+    else pageWritten(frame->file_name, frame->page_num);
+  }
+  if (ret) {
+    DB_ERROR << "failed to write back page " << frame->page_num << " of " << frame->file_name;
+    return -1;
+  }
+  setDirty(frame, false);
+  frame->owner = nullptr;
+  frame->lsn = 0;
+  return 0;
+}
+
+void BufferPool::setDirty(Frame *frame, bool dirty) {
+  if (frame->dirty == dirty) return;
+  frame->dirty = dirty;
+  if (dirty) ++dirty_count_;
+  else --dirty_count_;
+}
+
+size_t BufferPool::dirtyLimit() const {
+  return size_t(capacity_ * dirty_ratio_);
+}
+
+void BufferPool::write() {
+  std::unique_lock<std::recursive_mutex> lock(mutex_);
+  while (true) {
+    writer_cv_.wait_for(lock, std::chrono::milliseconds(WRITER_INTERVAL_MS), [this] {
+      return stop_ || pressure_ || dirty_count_ > dirtyLimit();
+    });
+    if (stop_) return;
+    lock.unlock();
+    std::lock_guard<std::mutex> io_lock(io_mutex_);
+    lock.lock();
+
+    size_t goal = dirty_count_ > dirtyLimit() ? dirty_count_ - dirtyLimit() : 0;
+    if (pressure_) goal = std::max(goal, WRITER_BATCH);
+    pressure_ = false;
+    // frames passed by the clock since last access first, the others are likely to be dirtied again soon
+    std::vector<Frame *> cold, hot;
+    for (auto &frame : frames_) {
+      if (!frame->dirty || frame->pin_count || frame->uncommitted || frame->file_name.empty()) continue;
+      (frame->referenced ? hot : cold).push_back(frame.get());
+    }
+    cold.insert(cold.end(), hot.begin(), hot.end());
+    if (cold.size() > goal) cold.resize(goal);
+    if (cold.empty()) continue;
+
+    // copies are written without mutex_, the pin keeps frame from being evicted and read again before that
+    std::vector<Copy> copies;
+    LogManager::lsn_t lsn = 0;
+    for (Frame *frame : cold) {
+      char *data = PageIO::allocAligned(frame->size);
+      memcpy(data, frame->data, frame->size);
+      copies.push_back({frame, frame->file_name, frame->page_num, frame->size, data, false});
+      lsn = std::max(lsn, frame->lsn);
+      ++frame->pin_count;
+      frame->writing = true;
+      setDirty(frame, false);
+    }
+    lock.unlock();
+    if (!lsn || !LogManager::instance().flushTo(lsn)) writeCopies(copies);
+    lock.lock();
+
+    for (auto &copy : copies) {
+      Frame *frame = copy.frame;
+      --frame->pin_count;
+      frame->writing = false;
+      if (!copy.written) {
+        setDirty(frame, true);
+      } else if (!frame->dirty) {
+        frame->owner = nullptr;
+        if (!frame->uncommitted) frame->lsn = 0;
+      }
+      PageIO::freeAligned(copy.data);
+    }
+  }
+}
+
+void BufferPool::writeCopies(std::vector<Copy> &copies) {
+  std::sort(copies.begin(), copies.end(), [](const Copy &a, const Copy &b) {
+    return a.file_name != b.file_name ? a.file_name < b.file_name : a.page_num < b.page_num;
+  });
+  size_t end;
+  for (size_t begin = 0; begin < copies.size(); begin = end) {
+    // run of pages physically adjacent in the same file
+    const Copy &first = copies[begin];
+    PageNum physical = FreeSpaceMap::toPhysical(first.page_num, first.size);
+    std::vector<const char *> pages{first.data};
+    for (end = begin + 1; end < copies.size() && copies[end].file_name == first.file_name &&
+        FreeSpaceMap::toPhysical(copies[end].page_num, first.size) == physical + (end - begin); ++end) {
+      pages.push_back(copies[end].data);
+    }
+
+    auto &writer = background_writers_[first.file_name];
+    if (!writer) {
+      writer.reset(new PageIO());
+      if (writer->open(first.file_name)) writer.reset();
+      else writer->setPageSize(first.size);
+    }
+    if (!writer || writer->writePages(physical, pages)) {
+      DB_ERROR << "failed to write back pages " << first.page_num << "-" << copies[end - 1].page_num << " of "
+               << first.file_name;
+      background_writers_.erase(first.file_name);
+      continue;
+    }
+    for (size_t i = begin; i < end; ++i) {
+      copies[i].written = true;
+      pageWritten(first.file_name, copies[i].page_num);
+    }
+  }
+}
+
+/**
+ * ======= ScanRing ==========
+ */
+
+const unsigned ScanRing::DEFAULT_SIZE = 16;
+
+ScanRing::ScanRing(unsigned size) : size_(std::max(size, 1u)), next_(0) {}
+
+ScanRing::~ScanRing() {
+  BufferPool::instance().releaseRing(this);
+}
+
+/**
+ * ======= AsyncReader ==========
+ */
+
+const unsigned AsyncReader::WORKER_NUM = 2;
+
+AsyncReader &AsyncReader::instance() {
+  static AsyncReader _async_reader;
+  return _async_reader;
+}
+
+AsyncReader::AsyncReader() : stop_(false) {
+  for (unsigned i = 0; i < WORKER_NUM; ++i) workers_.emplace_back(&AsyncReader::work, this);
+}
+
+AsyncReader::~AsyncReader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  queue_cv_.notify_all();
+  for (auto &worker : workers_) worker.join();
+}
+
+void AsyncReader::submit(const std::shared_ptr<Request> &request) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    request->started = request->done = request->cancelled = false;
+    queue_.push_back(request);
+  }
+  queue_cv_.notify_one();
+}
+
+bool AsyncReader::wait(const std::shared_ptr<Request> &request, bool cancel) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (cancel && !request->started) {
+    // worker will drop it when popped
+    request->cancelled = true;
+    return false;
+  }
+  done_cv_.wait(lock, [&] { return request->done; });
+  return request->ret == 0;
+}
+
+void AsyncReader::work() {
+  while (true) {
+    std::shared_ptr<Request> request;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      queue_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      request = queue_.front();
+      queue_.pop_front();
+      if (request->cancelled) continue;
+      request->started = true;
+    }
+    RC ret = request->io->readPage(request->page_num, request->data);
+    if (!ret) ++*request->counter;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      request->ret = ret;
+      request->done = true;
+    }
+    done_cv_.notify_all();
+  }
+}
+
+/**
+ * ======= ReadAhead ==========
+ */
+
+ReadAhead::ReadAhead(FileHandle &handle, unsigned depth) : handle_(&handle), depth_(depth), issued_end_(0) {
+  handle.attachReadAhead(this);
+}
+
+ReadAhead::~ReadAhead() {
+  detach();
+}
+
+void ReadAhead::advance(PageNum next) {
+  if (!handle_) return;
+  while (!pending_.empty() && pending_.begin()->first < next) release(pending_.begin());
+
+  auto &pool = BufferPool::instance();
+  PageNum end = std::min(next + depth_, handle_->getNumberOfPages());
+  PageNum begin = std::max(next, issued_end_);
+  {
+    // writes racing with the reads issued below are recorded from now on
+    std::lock_guard<std::mutex> lock(invalid_mutex_);
+    invalid_.erase(invalid_.begin(), invalid_.lower_bound(next));
+    issued_end_ = std::max(issued_end_, end);
+  }
+  for (PageNum page_num = begin; page_num < end; ++page_num) {
+    if (pool.contains(handle_->name, page_num) || (wanted_ && !wanted_(page_num))) continue;
+    std::shared_ptr<AsyncReader::Request> request;
+    if (spare_.empty()) {
+      request = std::make_shared<AsyncReader::Request>(handle_->getPageSize());
+    } else {
+      request = spare_.back();
+      spare_.pop_back();
+    }
+    request->io = &handle_->io_;
+    request->page_num = handle_->fsm_.toPhysical(page_num);
+    request->counter = &handle_->readPageCounter;
+    AsyncReader::instance().submit(request);
+    pending_[page_num] = request;
+  }
+}
+
+bool ReadAhead::take(PageNum page_num, void *data) {
+  auto it = pending_.find(page_num);
+  if (it == pending_.end()) return false;
+  bool written;
+  {
+    std::lock_guard<std::mutex> lock(invalid_mutex_);
+    written = invalid_.erase(page_num);
+  }
+  if (written) {
+    release(it);
+    return false;
+  }
+  bool ok = AsyncReader::instance().wait(it->second);
+  if (ok) memcpy(data, it->second->data, it->second->size);
+  spare_.push_back(it->second);
+  pending_.erase(it);
+  return ok;
+}
+
+void ReadAhead::invalidate(PageNum page_num) {
+  std::lock_guard<std::mutex> lock(invalid_mutex_);
+  // pages issued later are read after the write
+  if (page_num < issued_end_) invalid_.insert(page_num);
+}
+
+void ReadAhead::detach() {
+  while (!pending_.empty()) release(pending_.begin());
+  {
+    std::lock_guard<std::mutex> lock(invalid_mutex_);
+    invalid_.clear();
+  }
+  if (handle_) handle_->detachReadAhead(this);
+  handle_ = nullptr;
+}
+
+void ReadAhead::setFilter(const std::function<bool(PageNum)> &wanted) {
+  wanted_ = wanted;
+}
+
+void ReadAhead::release(std::map<PageNum, std::shared_ptr<AsyncReader::Request>>::iterator it) {
+  AsyncReader::instance().wait(it->second, true);
+  // a cancelled request might still be in the queue, it can't be reused until worker drops it
+  if (it->second->done) spare_.push_back(it->second);
+  pending_.erase(it);
+}
@@ -8,10 +8,21 @@
 #include <sstream>
 #include <iomanip>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 #include <ostream>
 #include <stdexcept>
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <unordered_set>
+#include <initializer_list>
+#include <chrono>
 #include <string.h>
 
 /******************************************
@@ -145,7 +156,99 @@ static std::string print_bits(const void *ptr, int size) {
 typedef unsigned PageNum;
 typedef int RC;
 
-#define PAGE_SIZE 4096
+#define PAGE_SIZE 4096      // default page size, also the size of file header
+#define MAX_PAGE_SIZE 65536 // page size of a file can be any power of 2 in [PAGE_SIZE, MAX_PAGE_SIZE]
+
+enum OpenMode {
+  OPEN_READ_WRITE = 0,
+  OPEN_MMAP_READ_ONLY = 1, // pages are views onto a read-only mapping of the file, bypassing BufferPool
+  OPEN_DIRECT = 2          // O_DIRECT, bypass kernel page cache so that BufferPool is the only cache
+};
+
+/**
+ * how heap pages of a file store records, chosen when the file is created. row pages keep each record contiguous,
+ * PAX pages keep every column of their records together in a minipage, so a scan reading a few columns of a wide
+ * table touches only their bytes. see Page
+ */
+enum PageLayout {
+  LAYOUT_ROW = 0,
+  LAYOUT_PAX = 1
+};
+
+/**
+ * raw file descriptor page I/O shared by FileHandle and IXFileManager
+ *
+ * all accesses are positional (pread/pwrite/preadv), there's no shared file offset, so one PageIO can be used by
+ * multiple threads at the same time without locking. page size is a property of each file, page `n` is located at
+ * (n + 1) * page size since the first page of every file is reserved for metadata
+ *
+ * with OPEN_DIRECT, page I/O from buffers allocated by `allocAligned` goes straight to the device, any other access
+ * (unaligned buffer, metadata of arbitrary size) is bounced through an aligned buffer
+ */
+class PageIO {
+ public:
+  static const size_t ALIGNMENT;                                      // alignment required by O_DIRECT
+
+  PageIO();
+  ~PageIO();
+
+  RC open(const std::string &fileName, OpenMode mode = OPEN_READ_WRITE);
+  RC create(const std::string &fileName);                             // fail if file already exists
+  RC close();
+  bool isOpen() const;
+
+  RC readPage(PageNum pageNum, void *data) const;
+  RC writePage(PageNum pageNum, const void *data) const;
+  RC readPages(PageNum firstPage, const std::vector<char *> &pages) const; // read consecutive pages in one syscall
+  RC writePages(PageNum firstPage, const std::vector<const char *> &pages) const; // write them in one syscall
+
+  RC readAt(size_t pos, void *data, size_t size) const;               // short read is zero-filled
+  RC writeAt(size_t pos, const void *data, size_t size) const;
+  RC sync() const;                                                    // fsync
+  RC truncate(size_t size) const;                                     // cut file down to `size` bytes
+
+  /**
+   * read-only view of a page inside the memory mapping of the whole file, the file is (re)mapped on demand so pages
+   * appended after the last mapping are still reachable
+   * @return nullptr if page is beyond end of file
+   */
+  const char *mappedPage(PageNum pageNum);
+
+  void adviseSequential();                                            // madvise(MADV_SEQUENTIAL) on current mapping
+
+  inline size_t getPos(PageNum page_num) const {
+    return (size_t(page_num) + 1) * page_size_;
+  }
+
+  inline size_t getPageSize() const { return page_size_; }
+  void setPageSize(size_t page_size);                                 // must be valid, see `isValidPageSize`
+
+  static bool isValidPageSize(size_t page_size);
+
+  static char *allocAligned(size_t size);                             // zero-filled, release with freeAligned
+  static void freeAligned(void *ptr);
+
+ private:
+  int fd_;
+  bool direct_;
+  size_t page_size_;
+  char *map_;         // PROT_READ mapping of the file, nullptr if not mapped
+  size_t map_size_;
+  bool sequential_;   // advice to re-apply after remapping
+
+  RC remap();
+  void unmap();
+
+  inline bool needBounce(size_t pos, const void *data, size_t size) const {
+    return direct_ && ((pos | size | reinterpret_cast<size_t>(data)) & (ALIGNMENT - 1));
+  }
+
+  RC rawRead(size_t pos, void *data, size_t size) const;
+  RC rawWrite(size_t pos, const void *data, size_t size) const;
+
+  PageIO(const PageIO &) = delete;
+  PageIO &operator=(const PageIO &) = delete;
+};
 
 class FileHandle;
 
@@ -153,9 +256,11 @@ class PagedFileManager {
  public:
   static PagedFileManager &instance();                                // Access to the _pf_manager instance
 
-  RC createFile(const std::string &fileName);                         // Create a new file
+  RC createFile(const std::string &fileName, size_t pageSize = PAGE_SIZE,
+                PageLayout layout = LAYOUT_ROW);                      // Create a new file
   RC destroyFile(const std::string &fileName);                        // Destroy a file
-  RC openFile(const std::string &fileName, FileHandle &fileHandle);   // Open a file
+  RC openFile(const std::string &fileName, FileHandle &fileHandle,
+              OpenMode mode = OPEN_READ_WRITE);                       // Open a file
   RC closeFile(FileHandle &fileHandle);                               // Close a file
 
   static inline bool ifFileExists(const std::string &fileName) {
@@ -174,38 +279,578 @@ class PagedFileManager {
 };
 
 class Page;
+class ReadAhead;
+class ScanRing;
+class ZoneMap;
+class BloomFilter;
+
+/**
+ * max segment tree over an array of values, answers "first index with value >= N" in O(log n)
+ */
+class MaxTree {
+ public:
+  MaxTree();
+
+  void clear();
+  void append(unsigned value);
+  void update(size_t index, unsigned value);
+  unsigned get(size_t index) const;
+  inline unsigned max() const { return tree_[1]; }
+  inline size_t size() const { return size_; }
+
+  /**
+   * @return first index whose value >= `value`, or size() if there's no such index
+   */
+  size_t findFirst(unsigned value) const;
+
+ private:
+  size_t size_;
+  size_t leaf_num_;            // power of 2, leaves are tree_[leaf_num_, 2 * leaf_num_)
+  std::vector<unsigned> tree_; // 1-based, every node is max of its children
+};
+
+/**
+ * free space of every data page in a heap file, stored in dedicated FSM pages which are loaded lazily
+ *
+ * the file is divided into groups, each is one FSM page followed by as many data pages as it has entries (page size / 2)
+ * whose free space it records. the max free space of each group (summary) is kept in file header, so finding the first page with enough
+ * space only loads the FSM page of the group it's in, and opening a file never touches FSM pages
+ */
+class FreeSpaceMap {
+ public:
+  typedef uint16_t entry_t;
+
+  static const entry_t UNKNOWN; // summary of group not recorded in header, FSM page has to be loaded to know
+
+  FreeSpaceMap();
+
+  /**
+   * @param io page size of FSM pages is taken from it
+   * @param summaries summaries of the first `num_summaries` groups, other groups are UNKNOWN
+   */
+  void attach(const PageIO *io, size_t num_pages, const entry_t *summaries, size_t num_summaries);
+
+  /**
+   * write dirty FSM pages back
+   * @param summaries out, summary of every group
+   */
+  RC flush(std::vector<entry_t> &summaries);
+
+  void clear();
+  void append(unsigned free_space);                                   // a new page at the end
+  void update(PageNum page_num, unsigned free_space);
+  unsigned get(PageNum page_num);
+  inline size_t size() const { return size_; }
+
+  /**
+   * forget pages from `num_pages` on, FSM pages of groups left without data pages are dropped as well
+   */
+  void truncate(size_t num_pages);
+
+  /**
+   * @return first page whose free space >= `size`, or size() if there's no such page
+   */
+  PageNum findFirst(unsigned size);
+
+  /**
+   * position of data page counting from first page after header, as used by PageIO
+   */
+  inline PageNum toPhysical(PageNum page_num) const {
+    return page_num / entries_per_page_ * (entries_per_page_ + 1) + 1 + page_num % entries_per_page_;
+  }
+
+  static inline PageNum toPhysical(PageNum page_num, size_t page_size) {
+    unsigned entries_per_page = page_size / sizeof(entry_t);
+    return page_num / entries_per_page * (entries_per_page + 1) + 1 + page_num % entries_per_page;
+  }
+
+ private:
+  struct Group {
+    MaxTree entries;
+    bool dirty;
+  };
+
+  const PageIO *io_;
+  unsigned entries_per_page_;
+  size_t size_;
+  MaxTree summaries_;
+  std::unordered_map<unsigned, std::unique_ptr<Group>> groups_;
+
+  Group *loadGroup(unsigned group);
+};
 
 class FileHandle {
+  friend class ReadAhead;
+  friend class BufferPool;
  public:
   // variables to keep the counter for each operation
-  unsigned readPageCounter;
-  unsigned writePageCounter;
-  unsigned appendPageCounter;
+  std::atomic<unsigned> readPageCounter;
+  std::atomic<unsigned> writePageCounter;
+  std::atomic<unsigned> appendPageCounter;
   std::string name;
-  std::vector<std::shared_ptr<Page>> pages_;
+  FreeSpaceMap fsm_; // free space of each page, kept in sync by Page
+  std::shared_ptr<ZoneMap> zone_map_; // attached by RecordBasedFileManager::openFile if the file has one, shared
+  std::shared_ptr<BloomFilter> bloom_filter_; // same as zone_map_
   bool meta_modified_;
 
+  static const unsigned FORMAT_VERSION;
+
   FileHandle();                                                       // Default constructor
   ~FileHandle();                                                      // Destructor
 
   RC readPage(PageNum pageNum, void *data);                           // Get a specific page
   RC writePage(PageNum pageNum, const void *data);                    // Write a specific page
   RC appendPage(const void *data);                                    // Append a specific page
+  RC truncate(unsigned numPages);                                     // Drop pages from `numPages` to the end
   unsigned getNumberOfPages();                                        // Get the number of pages in the file
   RC collectCounterValues(unsigned &readPageCount, unsigned &writePageCount,
                           unsigned &appendPageCount);                 // Put current counter values into variables
 
 
-  RC createFile(const std::string &fileName);
-  RC openFile(const std::string &fileName);
+  RC createFile(const std::string &fileName, size_t pageSize = PAGE_SIZE, PageLayout layout = LAYOUT_ROW);
+  RC openFile(const std::string &fileName, OpenMode mode = OPEN_READ_WRITE);
   RC closeFile();
 
+  inline bool isMapped() const { return mode_ == OPEN_MMAP_READ_ONLY; }
+  inline size_t getPageSize() const { return io_.getPageSize(); }     // read from file header on open
+  inline PageLayout getLayout() const { return layout_; }             // of heap pages, read from file header on open
+
+  /**
+   * version of file format, which is FORMAT_VERSION for new files. a file of version 2 has the same layout, but its
+   * heap pages might still use the packed slot directory, see RecordBasedFileManager::upgradeDirectories. heap pages
+   * of version 3 never have holes, so they are valid in version 4 as they are. files before version 5 have no
+   * layout in header, their pages are all row pages
+   */
+  inline unsigned getFormatVersion() const { return format_version_; }
+  void setFormatVersion(unsigned version);                            // written to header on close
+
+  /**
+   * only valid for mapped handle, the returned pointer is valid until next call that remaps or closeFile
+   */
+  const char *mappedPage(PageNum pageNum);
+
+  void adviseSequential();
+
+  /**
+   * pages prefetched by `read_ahead` will be served from it by readPage, at most one ReadAhead per handle
+   */
+  void attachReadAhead(ReadAhead *read_ahead);
+  void detachReadAhead(ReadAhead *read_ahead);
+
+  /**
+   * redo records of a page modified in BufferPool, see LogManager::logPage
+   * @param ranges [begin, end) offsets of modified bytes
+   */
+  void logPage(PageNum pageNum, const char *page, std::initializer_list<std::pair<size_t, size_t>> ranges);
+
+  static RC dumpOpenFiles();                                          // write metadata of every open writable handle
+
  private:
-  static inline size_t getPos(PageNum page_num) {
-    return (page_num + 1) * PAGE_SIZE;
-  }
+  PageIO io_;
+  OpenMode mode_;
+  ReadAhead *read_ahead_;
+  std::mutex read_ahead_mutex_; // guards read_ahead_ against BufferPool telling it about writes of other threads
+  unsigned format_version_;
+  PageLayout layout_;
+
+  RC loadMeta();
+  RC dumpMeta();
+
+  void invalidate(PageNum pageNum);                                   // page reached disk, see BufferPool::pageWritten
+  void followSize(unsigned numPages);                                 // see BufferPool::fileResized
+
+  static std::unordered_set<FileHandle *> &openHandles();             // writable handles, for checkpoint
+
+  /**
+   * move pages of a file created before FSM pages existed to their new positions, and build FSM pages from the
+   * free space array at the tail of file. such files always have PAGE_SIZE pages
+   */
+  static RC upgradeLayout(const PageIO &io, unsigned num_pages);
+
+  static RC writeHeader(const PageIO &io,
+                        const unsigned counters[3],
+                        unsigned version,
+                        PageLayout layout,
+                        const std::vector<FreeSpaceMap::entry_t> &summaries);
+
+  static size_t summaryOffset(unsigned version);                      // where group summaries begin in header
+};
+
+/**
+ * write-ahead log shared by all heap and index files
+ *
+ * a mutation appends physical redo records (bytes written at a position of a file) to the group of its log scope,
+ * the group is appended to the log when the outermost scope commits. pages modified by a group are never written
+ * back before it commits (no steal), and never before the log holding it is durable, so replaying committed groups
+ * after a crash reproduces every committed mutation, and nothing else.
+ *
+ * commits are made durable by a flusher thread, all groups committed while it is writing share its next fsync
+ * (group commit). dirty pages stay cached until BufferPool writes them back or until a checkpoint writes everything
+ * back and truncates the log, which happens when the log grows beyond the checkpoint size, when the checkpoint
+ * interval has passed since the last one, or on close. both bound the log replayed by recovery
+ */
+class LogManager {
+ public:
+  typedef uint64_t lsn_t; // log sequence number, position in the log stream since process start
+
+  static const size_t DEFAULT_CHECKPOINT_SIZE;
+  static const unsigned DEFAULT_CHECKPOINT_INTERVAL_MS;
+  static const unsigned FLUSH_INTERVAL_MS;                            // flusher wakes up at least this often
+
+  static LogManager &instance();
+
+  /**
+   * replay committed groups left in an existing log by a crash, then start logging into it
+   */
+  RC open(const std::string &path);
+  RC close();                                                         // checkpoint and stop logging
+  inline bool isOpen() const { return fd_ >= 0; }
+
+  void begin();                                                       // scopes nest
+  RC commit();                                                        // durable on return if commit is synchronous
+  inline bool inScope() const { return depth_ && isOpen(); }
+
+  /**
+   * redo record of `size` bytes written at `pos` of `file`, a write outside of any scope is a group of its own
+   */
+  void logWrite(const std::string &file, size_t pos, const void *data, size_t size);
+
+  /**
+   * redo records of a page, the first time a page is logged after a checkpoint its whole image is logged instead of
+   * the modified ranges, so that a torn write of it can be repaired
+   * @param pos position of page in file
+   * @param ranges [begin, end) offsets of modified bytes
+   */
+  void logPage(const std::string &file, size_t pos, const char *page, size_t page_size,
+               std::initializer_list<std::pair<size_t, size_t>> ranges);
+
+  void logCreate(const std::string &file);                            // writes of a file before are not replayed
+  void logDrop(const std::string &file);
+
+  RC flushTo(lsn_t lsn);                                              // block until log before lsn is durable
+  lsn_t committedLsn();                                               // end of last committed group
+
+  /**
+   * write back all dirty pages and metadata and sync them, then truncate the log. fails inside a scope
+   */
+  RC checkpoint();
+
+  /**
+   * off: commit returns before its group is durable, a crash might lose the last FLUSH_INTERVAL_MS of commits
+   * but never leaves a partial group
+   */
+  void setSynchronousCommit(bool sync);
+  void setCheckpointSize(size_t bytes);
+  void setCheckpointInterval(unsigned ms);                            // checked on commit, 0 to disable
+
+  /**
+   * called by checkpoint to write back pages not cached in BufferPool, e.g. index pages
+   */
+  void addCheckpointHook(const std::function<RC()> &hook);
+
+  /**
+   * called when the outermost scope commits, to write back pages not cached in BufferPool that wait for the log
+   */
+  void addCommitHook(const std::function<RC()> &hook);
+
+ private:
+  int fd_;
+  std::string path_;
+  unsigned depth_;
+  std::vector<char> group_;      // records of current scope
+  std::unordered_set<std::string> touched_; // files written since last checkpoint, synced by it
+  std::unordered_map<std::string, std::unordered_set<size_t>> imaged_; // pages with a whole image since checkpoint
+  std::vector<std::function<RC()>> hooks_;
+  std::vector<std::function<RC()>> commit_hooks_;
+  bool sync_commit_;
+  size_t checkpoint_size_;
+  unsigned checkpoint_interval_ms_;
+  std::chrono::steady_clock::time_point last_checkpoint_;
+
+  // shared with flusher thread
+  std::mutex mutex_;
+  std::condition_variable flush_cv_;
+  std::condition_variable durable_cv_;
+  std::vector<char> buffer_;     // committed groups not written yet
+  lsn_t base_lsn_;               // lsn of first byte in log file
+  lsn_t end_lsn_;
+  lsn_t durable_lsn_;
+  lsn_t requested_lsn_;
+  bool stop_;
+  bool failed_;
+  std::thread flusher_;
+
+  LogManager();
+  ~LogManager();
+  LogManager(const LogManager &) = delete;
+  LogManager &operator=(const LogManager &) = delete;
+
+  void append(uint8_t type, const std::string &file, size_t pos, const void *data, size_t size);
+  RC runCommitHooks();
+  void flush();                                                       // flusher thread
+  static RC recover(int fd);
+};
+
+/**
+ * begin a log scope on construction and commit it on destruction
+ */
+class LogScope {
+ public:
+  LogScope() { LogManager::instance().begin(); }
+  ~LogScope() { LogManager::instance().commit(); }
+
+  LogScope(const LogScope &) = delete;
+  LogScope &operator=(const LogScope &) = delete;
+};
+
+/**
+ * process-wide page cache shared by all FileHandles, a frame is identified by <file name, page num>
+ *
+ * pinned frames are never evicted. dirty frames are written back by a writer thread in the background, which keeps
+ * the share of dirty frames under the dirty ratio, writing them in page order and adjacent pages in one syscall.
+ * victims are chosen by the clock (second chance) policy, preferring clean frames, so a dirty frame is only written
+ * on the foreground path when nothing clean is left, or when the file is closed.
+ *
+ * when LogManager is open, frames dirtied inside a log scope can't be evicted until it commits, and closing a file
+ * leaves its dirty frames cached, they are written back on eviction or checkpoint without a FileHandle
+ */
+class BufferPool {
+  friend class ScanRing;
+ public:
+  static const size_t DEFAULT_CAPACITY;
+  static const double DEFAULT_DIRTY_RATIO;
+  static const unsigned WRITER_INTERVAL_MS;                           // writer checks dirty ratio at least this often
+  static const size_t WRITER_BATCH;                                   // frames written per round under pressure
+
+  static BufferPool &instance();
+
+  /**
+   * fetch page into a frame (read from disk only on miss), and pin it
+   * @param ring frames of a sequential scan, a miss reuses one of them instead of evicting from the whole pool
+   * @return pointer to frame data, nullptr if read failed
+   */
+  char *pin(FileHandle &handle, PageNum page_num, ScanRing *ring = nullptr);
+
+  /**
+   * release one pin of the frame
+   * @param dirty true if frame is modified while pinned, `handle` will be used to write it back later
+   */
+  void unpin(FileHandle &handle, PageNum page_num, bool dirty);
+
+  RC flushFile(FileHandle &handle);                                   // write back dirty frames owned by handle
+  RC flushFile(const std::string &fileName);                          // write back all dirty frames of the file
+  RC flushAll();                                                      // write back all dirty frames
+  void detach(FileHandle &handle);                                    // handle closes, keep its dirty frames
+  void commit(LogManager::lsn_t lsn);                                 // frames dirtied in committed log scope
+  RC discardFile(const std::string &fileName);                        // drop all frames of the file without writing
+  /**
+   * drop frames of pages >= from without writing them, as the file shrinks. like discardFile, fails if one of them is
+   * pinned, nothing is dropped then
+   */
+  RC discardPages(const std::string &fileName, PageNum from);
+  void refresh(const std::string &fileName, PageNum page_num, const void *data); // page written bypassing the pool
+
+  /**
+   * every open handle of a file is told about the writes of the others and of writer thread, so that its read-ahead
+   * drops the copies prefetched before a write, and a mapped handle sees pages appended or cut off by others
+   */
+  void addHandle(FileHandle &handle);
+  void removeHandle(FileHandle &handle);
+  void pageWritten(const std::string &fileName, PageNum page_num);   // page reached disk
+  void fileResized(const std::string &fileName, unsigned num_pages); // before a file is cut, after it grows
+
+  bool contains(const std::string &fileName, PageNum page_num);       // whether page is cached, no pin
+  void setCapacity(size_t frames);                                    // frame budget, takes effect on next miss
+  size_t getCapacity();
+  void setDirtyRatio(double ratio);                                   // share of capacity allowed to stay dirty
+  size_t getDirtyCount();
+
+ private:
+  struct Frame {
+    std::string file_name;
+    PageNum page_num;
+    char *data;
+    size_t size; // page size of the file, frames are reallocated when reused for a file with another page size
+    int pin_count;
+    bool dirty;
+    bool referenced; // second chance bit for clock
+    bool writing; // a copy is being written by writer thread, which holds a pin
+    bool loading; // the page is being read by the thread that pinned it first, without mutex_
+    FileHandle *owner; // handle that dirtied this frame, nullptr if it's closed
+    ScanRing *ring; // ring the frame was loaded for, nullptr once the page is used by anything else
+    bool uncommitted; // dirtied inside a log scope which is not committed yet, can't be written back
+    LogManager::lsn_t lsn; // log has to be durable up to it before the frame is written back
+  };
+
+  size_t capacity_;
+  size_t clock_hand_;
+  std::vector<std::unique_ptr<Frame>> frames_;
+  std::unordered_map<std::string, std::unordered_map<PageNum, Frame *>> page_table_;
+  std::vector<Frame *> uncommitted_;
+  std::unordered_map<std::string, std::unique_ptr<PageIO>> writers_; // write back frames without owner
+  size_t dirty_count_;
+  double dirty_ratio_;
+
+  // state above is guarded by mutex_, which is recursive since writing back through a FileHandle refreshes the frame.
+  // io_mutex_ is held by writer thread while writing a batch, and by whatever has to wait for it, taken before mutex_
+  std::recursive_mutex mutex_;
+  std::mutex io_mutex_;
+  std::condition_variable_any writer_cv_;
+  std::condition_variable_any loaded_cv_; // a frame is no longer loading
+  std::unordered_map<std::string, std::unique_ptr<PageIO>> background_writers_; // guarded by io_mutex_
+  std::unordered_map<std::string, std::unordered_set<FileHandle *>> handles_;   // guarded by handles_mutex_
+  std::mutex handles_mutex_; // taken after mutex_ and io_mutex_
+  bool pressure_; // eviction skipped dirty frames
+  bool stop_;
+  std::thread writer_;
+
+  BufferPool();
+  ~BufferPool();
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  Frame *lookup(const std::string &file_name, PageNum page_num);
+
+  /**
+   * find a free or evictable frame, allocate a new one if pool not full or every frame is pinned
+   * @param size page size the frame has to hold
+   */
+  Frame *acquireFrame(size_t size);
+
+  Frame *acquireRingFrame(ScanRing *ring, size_t size);             // recycle the oldest frame of ring
+  void releaseRing(ScanRing *ring);                                   // ring is destroyed, its frames stay cached
+  void evict(Frame *frame);                                           // unmap a clean, unpinned frame
+
+  RC writeBack(Frame *frame);
+  void setDirty(Frame *frame, bool dirty);
+  size_t dirtyLimit() const;
+
+  // copy of a dirty frame taken by writer thread
+  struct Copy {
+    Frame *frame;
+    std::string file_name;
+    PageNum page_num;
+    size_t size;
+    char *data;
+    bool written;
+  };
+
+  void write();                                                       // writer thread
+  void writeCopies(std::vector<Copy> &copies);                        // without mutex_, sets `written`
+};
 
-  std::fstream _file;
+/**
+ * background page reader, reads are served by worker threads in FIFO order
+ *
+ * kernel async I/O (io_uring) is not assumed to be available, so a small pool of threads issuing blocking pread
+ * is used, which gives the same overlap between decoding current page and fetching following pages
+ */
+class AsyncReader {
+ public:
+  static const unsigned WORKER_NUM;
+
+  struct Request {
+    explicit Request(size_t size) : size(size), data(PageIO::allocAligned(size)) {}
+    ~Request() { PageIO::freeAligned(data); }
+
+    const PageIO *io;
+    PageNum page_num;
+    size_t size;
+    char *data;
+    std::atomic<unsigned> *counter; // read counter of the FileHandle, increased when the read is issued
+    RC ret;
+    bool started;
+    bool done;
+    bool cancelled;
+  };
+
+  static AsyncReader &instance();
+
+  void submit(const std::shared_ptr<Request> &request);
+
+  /**
+   * block until request is done, or cancel it if no worker has picked it up yet
+   * @return true if data of request is valid
+   */
+  bool wait(const std::shared_ptr<Request> &request, bool cancel = false);
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable queue_cv_;
+  std::condition_variable done_cv_;
+  std::deque<std::shared_ptr<Request>> queue_;
+  std::vector<std::thread> workers_;
+  bool stop_;
+
+  AsyncReader();
+  ~AsyncReader();
+  AsyncReader(const AsyncReader &) = delete;
+  AsyncReader &operator=(const AsyncReader &) = delete;
+
+  void work();
+};
+
+/**
+ * small private set of frames for a sequential scan over a file much larger than the pool. pages the scan misses on
+ * are read into frames of the ring in turn, so the scan only ever evicts its own pages and leaves the working set of
+ * point lookups cached. pages already cached are used in place. a ring frame that is pinned or dirtied by anything
+ * else leaves the ring and becomes an ordinary frame, the ring takes another one from the pool instead
+ */
+class ScanRing {
+  friend class BufferPool;
+ public:
+  static const unsigned DEFAULT_SIZE;
+
+  explicit ScanRing(unsigned size);
+  ~ScanRing();
+
+ private:
+  unsigned size_;
+  size_t next_; // frame to recycle next
+  std::vector<BufferPool::Frame *> frames_;
+
+  ScanRing(const ScanRing &) = delete;
+  ScanRing &operator=(const ScanRing &) = delete;
+};
+
+/**
+ * prefetch window of a sequential scan: pages [next, next + depth) are read in background, and handed over to
+ * BufferPool when the scan misses on them. pages already cached by BufferPool are not prefetched
+ */
+class ReadAhead {
+ public:
+  ReadAhead(FileHandle &handle, unsigned depth);
+  ~ReadAhead();
+
+  /**
+   * scan is going to read page `next`, drop pages before it and fill up the window
+   */
+  void advance(PageNum next);
+
+  /**
+   * @return true if page was prefetched and copied into data
+   */
+  bool take(PageNum page_num, void *data);
+
+  void invalidate(PageNum page_num);                                  // page written after prefetch, by any thread
+  void detach();                                                      // cancel everything, handle is closing
+
+  /**
+   * pages `wanted` returns false for are going to be skipped by the scan, they are not prefetched
+   */
+  void setFilter(const std::function<bool(PageNum)> &wanted);
+
+ private:
+  FileHandle *handle_;
+  unsigned depth_;
+  std::function<bool(PageNum)> wanted_;
+  PageNum issued_end_; // pages before it are already issued or skipped
+  std::map<PageNum, std::shared_ptr<AsyncReader::Request>> pending_;
+  std::set<PageNum> invalid_; // issued pages written since, whose copies are dropped by take
+  std::mutex invalid_mutex_;  // guards invalid_ and updates of issued_end_, the rest is only used by the scan
+  std::vector<std::shared_ptr<AsyncReader::Request>> spare_; // recycled requests to avoid allocation per page
+
+  void release(std::map<PageNum, std::shared_ptr<AsyncReader::Request>>::iterator it);
 };
 
 #endif
@@ -5,6 +5,13 @@
 RecordBasedFileManager *RecordBasedFileManager::_rbf_manager = nullptr;
 
 const RC RecordBasedFileManager::COND_NOT_SATISFIED = 3;
+const size_t RecordBasedFileManager::CODEC_CACHE_SIZE = 256;
+std::unordered_map<std::string, std::shared_ptr<const RecordCodec>> RecordBasedFileManager::codecs_;
+std::mutex RecordBasedFileManager::codecs_mutex_;
+std::map<std::string, std::weak_ptr<PageSummary>> RecordBasedFileManager::summaries_;
+std::mutex RecordBasedFileManager::summaries_mutex_;
+
+static const unsigned WIDE_DIRECTORY_VERSION = 3; // first format version whose heap pages all have wide directories
 
 RecordBasedFileManager &RecordBasedFileManager::instance() {
   static RecordBasedFileManager _rbf_manager = RecordBasedFileManager();
@@ -19,16 +26,37 @@ RecordBasedFileManager::RecordBasedFileManager(const RecordBasedFileManager &) =
 
 RecordBasedFileManager &RecordBasedFileManager::operator=(const RecordBasedFileManager &) = default;
 
-RC RecordBasedFileManager::createFile(const std::string &fileName) {
-  return pfm_->createFile(fileName);
+RC RecordBasedFileManager::createFile(const std::string &fileName, size_t pageSize, PageLayout layout) {
+  return pfm_->createFile(fileName, pageSize, layout);
 }
 
 RC RecordBasedFileManager::destroyFile(const std::string &fileName) {
+  for (auto &suffix : {ZoneMap::SUFFIX, BloomFilter::SUFFIX}) {
+    forgetSummary(fileName + suffix);
+    if (PagedFileManager::ifFileExists(fileName + suffix)) pfm_->destroyFile(fileName + suffix);
+  }
   return pfm_->destroyFile(fileName);
 }
 
-RC RecordBasedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle) {
-  return pfm_->openFile(fileName, fileHandle);
+RC RecordBasedFileManager::openFile(const std::string &fileName, FileHandle &fileHandle, OpenMode mode) {
+  RC ret = pfm_->openFile(fileName, fileHandle, mode);
+  if (ret) return ret;
+  // packed directories can still be read from a mapped file, they are only upgraded when writable
+  if (fileHandle.isMapped() || fileHandle.getFormatVersion() >= FileHandle::FORMAT_VERSION) {
+    return attachSummaries(fileHandle);
+  }
+  if (fileHandle.getFormatVersion() >= WIDE_DIRECTORY_VERSION) {
+    // pages are valid as they are, only newer readers understand fragmented pages written from now on
+    fileHandle.setFormatVersion(FileHandle::FORMAT_VERSION);
+    return attachSummaries(fileHandle);
+  }
+  DB_WARNING << "upgrade slot directories of " << fileName;
+  if (upgradeDirectories(fileHandle)) {
+    DB_ERROR << "failed to upgrade slot directories of " << fileName;
+    pfm_->closeFile(fileHandle);
+    return -1;
+  }
+  return attachSummaries(fileHandle);
 }
 
 RC RecordBasedFileManager::closeFile(FileHandle &fileHandle) {
@@ -41,11 +69,82 @@ RC RecordBasedFileManager::insertRecord(FileHandle &fileHandle, const std::vecto
   return insertRecordImpl(fileHandle, recordDescriptor, data, rid, 0);
 }
 
+RC RecordBasedFileManager::insertRecords(FileHandle &fileHandle,
+                                         const std::vector<Attribute> &recordDescriptor,
+                                         const std::vector<const void *> &batch,
+                                         std::vector<RID> &rids) {
+  rids.clear();
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not insert record into read-only file " << fileHandle.name;
+    return -1;
+  }
+  auto codec = codecOf({recordDescriptor});
+  std::vector<std::vector<char>> records(batch.size());
+  size_t max_size = Page::maxRecordSize(fileHandle.getPageSize(), fileHandle.getLayout(), recordDescriptor.size());
+  for (size_t i = 0; i < batch.size(); ++i) {
+    if (codec->encode(batch[i], 0, records[i])) return -1;  // varchar longer than upper limit
+    if (records[i].size() > max_size) {
+      DB_ERROR << "data size " << records[i].size() << " larger than max record size " << max_size;
+      return -1;
+    }
+  }
+
+  size_t i = 0;
+  while (i < records.size()) {
+    // one page with the records put into it is an atomic step
+    LogScope log_scope;
+    Page page(INVALID_PID);
+    loadAvailablePage(records[i].data(), records[i].size(), fileHandle, page);
+    size_t first = i;
+    RC ret = 0;
+    do {
+      // entries go first, so that a failure leaves the page with only records that are covered
+      for (auto summary : summariesOf(fileHandle)) {
+        if ((ret = summary->add(page.pid, recordDescriptor, batch[i]))) break;
+      }
+      if (ret) break;
+      rids.push_back(page.insertData(records[i].data(), records[i].size()));
+      ++i;
+    } while (i < records.size() && hasSpace(page, records[i].data(), records[i].size()));
+    if (i > first) page.dump(fileHandle);
+    else page.freeMem();
+    if (ret) return -1;
+  }
+  return 0;
+}
+
 RC RecordBasedFileManager::readRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
                                       const RID &rid, void *data) {
   return readRecordImpl(fileHandle, {recordDescriptor}, rid, data, {});
 }
 
+RC RecordBasedFileManager::readRecordView(FileHandle &fileHandle,
+                                          const std::vector<Attribute> &recordDescriptor,
+                                          const RID &rid,
+                                          RecordView &view) {
+  view.release();
+  auto page = std::make_shared<Page>(rid.pageNum);
+  if (!loadPageWithRid(rid, fileHandle, *page)) return -1;
+
+  auto record_offset = page->getSlot(rid.slotNum);
+  if (record_offset.first != page->pid) {
+    // redirect to another page: the PageOffset entry actually stores the RID at the exact page
+    auto redirect_page = std::make_shared<Page>(record_offset.first);
+    redirect_page->load(fileHandle);
+    record_offset.second = redirect_page->getSlot(record_offset.second).second;
+    page = redirect_page;
+  }
+  view.parse(*page, record_offset.second);
+  if (view.record_fields_.size() != recordDescriptor.size()) {
+    DB_ERROR << "field num not matched. " << recordDescriptor.size() << " given in recordDescriptor, "
+             << view.record_fields_.size() << " found in data";
+    return -1;
+  }
+  view.fields_ = view.record_fields_;
+  view.page_ = page;
+  return 0;
+}
+
 RC RecordBasedFileManager::printRecord(const std::vector<Attribute> &recordDescriptor, const void *data) {
   // parse null indicators
   int fields_num = recordDescriptor.size();
@@ -85,36 +184,47 @@ RC RecordBasedFileManager::printRecord(const std::vector<Attribute> &recordDescr
 
 RC RecordBasedFileManager::deleteRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
                                         const RID &rid) {
-  auto res = loadPageWithRid(rid, fileHandle);
-  if (!res.first) {
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not delete record from read-only file " << fileHandle.name;
+    return -1;
+  }
+  LogScope log_scope;
+  Page origin_page(rid.pageNum);
+  if (!loadPageWithRid(rid, fileHandle, origin_page)) {
     DB_WARNING << "deleteRecord failed, RID invalid";
     return -1;
   }
 
-  Page *origin_page = res.second;
-
-  auto &offset = origin_page->records_offset[rid.slotNum];
-  if (offset.first == origin_page->pid) {
+  auto offset = origin_page.getSlot(rid.slotNum);
+  origin_page.setSlot(rid.slotNum, {rid.pageNum, Page::INVALID_OFFSET});
+  if (offset.first == origin_page.pid) {
     // in origin page
-    auto data_begin = offset.second;
-    offset.second = Page::INVALID_OFFSET;
-    origin_page->deleteRecord(data_begin);
+    origin_page.deleteRecord(offset.second);
   } else {
     // redirect to another page
     PID redirect_pid = offset.first;
     SID redirect_sid = offset.second;
-    offset = {rid.pageNum, Page::INVALID_OFFSET};
 
-    Page *redirect_page = fileHandle.pages_[redirect_pid].get();
-    redirect_page->load(fileHandle);
-    auto &redirect_offset = redirect_page->records_offset[redirect_sid];
-    auto data_begin = redirect_offset.second;
-    redirect_offset = {redirect_page->pid, Page::INVALID_OFFSET};
-    redirect_page->deleteRecord(data_begin);
-    redirect_page->dump(fileHandle);
+    Page redirect_page(redirect_pid);
+    redirect_page.load(fileHandle);
+    auto data_begin = redirect_page.getSlot(redirect_sid).second;
+    redirect_page.setSlot(redirect_sid, {redirect_page.pid, Page::INVALID_OFFSET});
+    redirect_page.deleteRecord(data_begin);
+    redirect_page.dump(fileHandle);
   }
 
-  origin_page->dump(fileHandle);
+  // records moved in from other pages are covered by the entries of their own pages
+  auto summaries = summariesOf(fileHandle);
+  bool empty = true;
+  for (SID sid = 0; !summaries.empty() && sid < origin_page.numSlots() && empty; ++sid) {
+    auto slot = origin_page.getSlot(sid);
+    empty = slot.second == Page::INVALID_OFFSET || slot.first == Page::REDIRECT_PID;
+  }
+  origin_page.dump(fileHandle);
+  // the record is deleted either way, entries left behind only make scans read the page
+  for (auto summary : summaries) {
+    if (empty && summary->reset(rid.pageNum)) DB_WARNING << "failed to reset entries of page " << rid.pageNum;
+  }
 
   return 0;
 }
@@ -136,7 +246,131 @@ RC RecordBasedFileManager::readAttribute(FileHandle &fileHandle,
 RC RecordBasedFileManager::scan(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
                                 const std::string &conditionAttribute, const CompOp compOp, const void *value,
                                 const std::vector<std::string> &attributeNames, RBFM_ScanIterator &rbfm_ScanIterator) {
-  return rbfm_ScanIterator.init(fileHandle, this, {recordDescriptor}, conditionAttribute, compOp, value, attributeNames);
+  ScanCondition condition;
+  if (compOp != NO_OP) condition.conjuncts.push_back({conditionAttribute, compOp, value});
+  return rbfm_ScanIterator.init(fileHandle, this, {recordDescriptor}, condition, attributeNames);
+}
+
+RC RecordBasedFileManager::scan(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor,
+                                const ScanCondition &condition, const std::vector<std::string> &attributeNames,
+                                RBFM_ScanIterator &rbfm_ScanIterator) {
+  return rbfm_ScanIterator.init(fileHandle, this, {recordDescriptor}, condition, attributeNames);
+}
+
+RC RecordBasedFileManager::vacuum(FileHandle &fileHandle,
+                                  const std::function<RC(const RID &oldRid, const RID &newRid)> &onMove) {
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not vacuum read-only file " << fileHandle.name;
+    return -1;
+  }
+  PID num_pages = fileHandle.getNumberOfPages();
+  for (PID pid = 0; pid < num_pages; ++pid) {
+    // a page with the records it takes back, and the moves of its strays with the index updates of onMove, is an atomic
+    // step
+    LogScope log_scope;
+    Page page(pid);
+    page.load(fileHandle);
+    bool modified = false;
+    std::vector<std::pair<SID, std::vector<char>>> strays; // records that don't fit into their origin slots
+    for (SID sid = 0; sid < page.numSlots(); ++sid) {
+      auto offset = page.getSlot(sid);
+      if (offset.second == Page::INVALID_OFFSET || offset.first == pid || offset.first == Page::REDIRECT_PID) continue;
+      Page redirect_page(offset.first);
+      redirect_page.load(fileHandle);
+      PageOffset data_begin = redirect_page.getSlot(offset.second).second;
+      std::vector<char> record;
+      redirect_page.copyRecord(data_begin, record);
+      redirect_page.setSlot(offset.second, {redirect_page.pid, Page::INVALID_OFFSET});
+      redirect_page.deleteRecord(data_begin);
+      if (redirect_page.fragmented_ && !redirect_page.pax_) redirect_page.compact();
+      redirect_page.dump(fileHandle);
+      modified = true;
+
+      if (page.accepts(record.data()) && page.real_free_space_ >= page.dataSize(record.data(), record.size())) {
+        page.insertData(record.data(), record.size(), sid);
+      } else {
+        page.setSlot(sid, {pid, Page::INVALID_OFFSET});
+        strays.emplace_back(sid, std::move(record));
+      }
+    }
+    // holes of a PAX page are the room of its minipages
+    if (page.fragmented_ && !page.pax_) {
+      page.compact();
+      modified = true;
+    }
+    if (modified) page.dump(fileHandle);
+    else page.freeMem();
+
+    // page is dumped first, so that loading it again for a stray sees its current meta. a stray is only kept here, so
+    // every one of them is put into a page even if moving another one failed
+    RC ret = 0;
+    for (auto &stray : strays) {
+      Page new_page(INVALID_PID);
+      loadAvailablePage(stray.second.data(), stray.second.size(), fileHandle, new_page);
+      for (auto summary : summariesOf(fileHandle)) {
+        if (summary->merge(new_page.pid, pid)) {
+          DB_ERROR << "failed to merge entries of page " << pid << " into " << new_page.pid;
+          ret = -1;
+        }
+      }
+      RID new_rid = new_page.insertData(stray.second.data(), stray.second.size());
+      new_page.dump(fileHandle);
+      if (onMove && onMove({pid, stray.first}, new_rid)) {
+        DB_ERROR << "failed to move record " << pid << " " << stray.first << " to " << new_rid.pageNum << " "
+                 << new_rid.slotNum;
+        ret = -1;
+      }
+    }
+    // nothing is truncated after a failed move
+    if (ret) return ret;
+  }
+
+  // strays might have been appended behind the pages checked here, they are not empty
+  PID end = fileHandle.getNumberOfPages();
+  for (; end > 0; --end) {
+    Page page(end - 1);
+    page.load(fileHandle);
+    bool empty = true;
+    for (SID sid = 0; sid < page.numSlots() && empty; ++sid) {
+      empty = page.getSlot(sid).second == Page::INVALID_OFFSET;
+    }
+    page.freeMem();
+    if (!empty) break;
+  }
+  if (end < fileHandle.getNumberOfPages()) {
+    DB_DEBUG << "vacuum drops " << fileHandle.getNumberOfPages() - end << " pages of " << fileHandle.name;
+    for (auto summary : summariesOf(fileHandle)) {
+      if (summary->truncate(end)) return -1;
+    }
+    return fileHandle.truncate(end);
+  }
+  return 0;
+}
+
+RC RecordBasedFileManager::createZoneMap(FileHandle &fileHandle,
+                                         const std::vector<Attribute> &recordDescriptor,
+                                         const std::vector<std::string> &attributeNames) {
+  return createZoneMapImpl(fileHandle, {recordDescriptor}, attributeNames);
+}
+
+RC RecordBasedFileManager::destroyZoneMap(FileHandle &fileHandle) {
+  fileHandle.zone_map_.reset();
+  forgetSummary(fileHandle.name + ZoneMap::SUFFIX);
+  if (!PagedFileManager::ifFileExists(fileHandle.name + ZoneMap::SUFFIX)) return -1;
+  return pfm_->destroyFile(fileHandle.name + ZoneMap::SUFFIX);
+}
+
+RC RecordBasedFileManager::createBloomFilter(FileHandle &fileHandle,
+                                             const std::vector<Attribute> &recordDescriptor,
+                                             const std::vector<std::string> &attributeNames) {
+  return createBloomFilterImpl(fileHandle, {recordDescriptor}, attributeNames);
+}
+
+RC RecordBasedFileManager::destroyBloomFilter(FileHandle &fileHandle) {
+  fileHandle.bloom_filter_.reset();
+  forgetSummary(fileHandle.name + BloomFilter::SUFFIX);
+  if (!PagedFileManager::ifFileExists(fileHandle.name + BloomFilter::SUFFIX)) return -1;
+  return pfm_->destroyFile(fileHandle.name + BloomFilter::SUFFIX);
 }
 
 /**************************************
@@ -151,39 +385,129 @@ RC RecordBasedFileManager::readRecordImpl(FileHandle &fileHandle,
                                           const RID &rid,
                                           void *data,
                                           const std::vector<std::string> &projected_fields) {
-  auto ret = loadPageWithRid(rid, fileHandle);
-  if (!ret.first) {
+  auto codec = codecOf(recordDescriptors, projected_fields);
+  if (!codec) return -1;
+  Page origin_page(rid.pageNum);
+  if (!loadPageWithRid(rid, fileHandle, origin_page)) {
     return -1;
   }
 
-  Page *origin_page = ret.second;
-
-  auto &record_offset = origin_page->records_offset[rid.slotNum];
-  if (record_offset.first == origin_page->pid) {
+  RC ret;
+  auto record_offset = origin_page.getSlot(rid.slotNum);
+  if (record_offset.first == origin_page.pid) {
     // in the same page: directly read the record starting at PageOffset
-    origin_page->readData(record_offset.second, data, recordDescriptors, projected_fields);
+    ret = origin_page.readData(record_offset.second, data, *codec);
   } else if (record_offset.first == Page::REDIRECT_PID) {
     DB_ERROR << "Illegal direct access to a forwarded slot: " << rid.pageNum << " " << rid.slotNum;
     return -1;
   } else {
     // redirect to another page: the PageOffset entry actually stores the RID at the exact page
-    Page *redirect_page = fileHandle.pages_[record_offset.first].get();
-    redirect_page->load(fileHandle);
+    Page redirect_page(record_offset.first);
+    redirect_page.load(fileHandle);
     // if redirected, we use offset to indicate SID in the redirected page
-    PageOffset real_offset = redirect_page->records_offset[record_offset.second].second;
-    redirect_page->readData(real_offset, data, recordDescriptors, projected_fields);
-    redirect_page->freeMem();
+    PageOffset real_offset = redirect_page.getSlot(record_offset.second).second;
+    ret = redirect_page.readData(real_offset, data, *codec);
+    redirect_page.freeMem();
+  }
+  origin_page.freeMem();
+
+  return ret;
+}
+
+RC RecordBasedFileManager::createZoneMapImpl(FileHandle &fileHandle,
+                                             const std::vector<std::vector<Attribute>> &recordDescriptors,
+                                             const std::vector<std::string> &attributeNames) {
+  ZoneMap zone_map;
+  fileHandle.zone_map_.reset();
+  return createSummary(fileHandle, zone_map, ZoneMap::SUFFIX, recordDescriptors, attributeNames);
+}
+
+RC RecordBasedFileManager::createBloomFilterImpl(FileHandle &fileHandle,
+                                                 const std::vector<std::vector<Attribute>> &recordDescriptors,
+                                                 const std::vector<std::string> &attributeNames) {
+  BloomFilter bloom_filter;
+  fileHandle.bloom_filter_.reset();
+  return createSummary(fileHandle, bloom_filter, BloomFilter::SUFFIX, recordDescriptors, attributeNames);
+}
+
+RC RecordBasedFileManager::createSummary(FileHandle &fileHandle,
+                                         PageSummary &summary,
+                                         const std::string &suffix,
+                                         const std::vector<std::vector<Attribute>> &recordDescriptors,
+                                         const std::vector<std::string> &attributeNames) {
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not create " << suffix << " of read-only file " << fileHandle.name;
+    return -1;
+  }
+  forgetSummary(fileHandle.name + suffix);
+  if (PagedFileManager::ifFileExists(fileHandle.name + suffix)) pfm_->destroyFile(fileHandle.name + suffix);
+  if (summary.create(fileHandle, recordDescriptors, attributeNames)) {
+    DB_ERROR << "failed to create " << suffix << " of " << fileHandle.name;
+    if (PagedFileManager::ifFileExists(fileHandle.name + suffix)) pfm_->destroyFile(fileHandle.name + suffix);
+    return -1;
+  }
+  return attachSummaries(fileHandle);
+}
+
+RC RecordBasedFileManager::attachSummaries(FileHandle &fileHandle) {
+  // records modified without keeping them up to date would be skipped by later scans, so this is fatal
+  if (attachSummary(fileHandle, fileHandle.zone_map_) || attachSummary(fileHandle, fileHandle.bloom_filter_)) {
+    pfm_->closeFile(fileHandle);
+    return -1;
   }
-  origin_page->freeMem();
+  return 0;
+}
 
+template<typename Summary>
+RC RecordBasedFileManager::attachSummary(FileHandle &fileHandle, std::shared_ptr<Summary> &attached) {
+  attached.reset();
+  if (!PagedFileManager::ifFileExists(fileHandle.name + Summary::SUFFIX)) return 0;
+  std::lock_guard<std::mutex> lock(summaries_mutex_);
+  auto &shared = summaries_[fileHandle.name + Summary::SUFFIX];
+  auto summary = std::static_pointer_cast<Summary>(shared.lock());
+  // mapped handles fall back to mapping a side file that can't be written, a writable handle then opens it anew
+  if (!summary || (summary->isMapped() && !fileHandle.isMapped())) {
+    summary = std::make_shared<Summary>();
+    RC ret = summary->open(fileHandle.name, OPEN_READ_WRITE);
+    if (ret && fileHandle.isMapped()) {
+      summary = std::make_shared<Summary>();
+      ret = summary->open(fileHandle.name, OPEN_MMAP_READ_ONLY);
+    }
+    if (ret) {
+      DB_ERROR << "failed to open " << Summary::SUFFIX << " of " << fileHandle.name;
+      return -1;
+    }
+    shared = summary;
+  }
+  if (summary->columns().empty()) {
+    DB_WARNING << "ignore " << Summary::SUFFIX << " of " << fileHandle.name << " whose build was interrupted";
+    return 0;
+  }
+  attached = summary;
   return 0;
 }
 
+void RecordBasedFileManager::forgetSummary(const std::string &sideFile) {
+  std::lock_guard<std::mutex> lock(summaries_mutex_);
+  summaries_.erase(sideFile);
+}
+
+std::vector<PageSummary *> RecordBasedFileManager::summariesOf(const FileHandle &fileHandle) {
+  std::vector<PageSummary *> summaries;
+  if (fileHandle.zone_map_) summaries.push_back(fileHandle.zone_map_.get());
+  if (fileHandle.bloom_filter_) summaries.push_back(fileHandle.bloom_filter_.get());
+  return summaries;
+}
+
 RC RecordBasedFileManager::insertRecordImpl(FileHandle &fileHandle,
                                             const std::vector<Attribute> &recordDescriptor,
                                             const void *data,
                                             RID &rid,
                                             const directory_t ver) {
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not insert record into read-only file " << fileHandle.name;
+    return -1;
+  }
   // use the array of field offsets method for variable length record introduced in class as the format of record
   // each record has a leading series of bytes indicating the pointers to each field
   auto data_to_be_inserted = serializeRecord(recordDescriptor, data, ver);
@@ -192,15 +516,24 @@ RC RecordBasedFileManager::insertRecordImpl(FileHandle &fileHandle,
     return -1;  // varchar longer than upper limit
   size_t total_size = data_to_be_inserted.second.size();
 //  DB_DEBUG << "TOTAL SIZE " << total_size;
-  if (total_size > Page::MAX_SIZE) {
-    DB_ERROR << "data size " << total_size << " larger than MAX_SIZE " << Page::MAX_SIZE;
+  size_t max_size = Page::maxRecordSize(fileHandle.getPageSize(), fileHandle.getLayout(), recordDescriptor.size());
+  if (total_size > max_size) {
+    DB_ERROR << "data size " << total_size << " larger than max record size " << max_size;
     return -1;
   }
 
-  Page *page = findAvailableSlot(total_size, fileHandle);
-  page->load(fileHandle);
-  rid = page->insertData(data_to_be_inserted.second.data(), data_to_be_inserted.second.size());
-  page->dump(fileHandle);
+  LogScope log_scope;
+  Page page(INVALID_PID);
+  loadAvailablePage(data_to_be_inserted.second.data(), total_size, fileHandle, page);
+  // entries are committed together with the record, they go first so that a failure leaves the page untouched
+  for (auto summary : summariesOf(fileHandle)) {
+    if (summary->add(page.pid, recordDescriptor, data)) {
+      page.freeMem();
+      return -1;
+    }
+  }
+  rid = page.insertData(data_to_be_inserted.second.data(), data_to_be_inserted.second.size());
+  page.dump(fileHandle);
   return 0;
 }
 
@@ -209,102 +542,123 @@ RC RecordBasedFileManager::updateRecordImpl(FileHandle &fileHandle,
                                             const void *data,
                                             const RID &rid,
                                             const directory_t ver) {
-  auto ret = loadPageWithRid(rid, fileHandle);
-  if (!ret.first) {
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not update record in read-only file " << fileHandle.name;
+    return -1;
+  }
+  LogScope log_scope;
+  Page origin_page(rid.pageNum);
+  if (!loadPageWithRid(rid, fileHandle, origin_page)) {
     DB_WARNING << "updateRecord failed, RID invalid";
     return -1;
   }
 
-  Page *origin_page = ret.second;
-
   /*
    * serialize data just like insert
    */
   auto data_to_be_inserted = serializeRecord(recordDescriptor, data, ver);
   if (data_to_be_inserted.first != 0) {
-    origin_page->freeMem();
+    origin_page.freeMem();
     return -1;  // varchar longer than upper limit
   }
   size_t new_size = data_to_be_inserted.second.size();
 //  DB_DEBUG << "updateRecord TOTAL SIZE " << total_size;
-  if (new_size > Page::MAX_SIZE) {
-    origin_page->freeMem();
-    DB_ERROR << "data size " << new_size << " larger than MAX_SIZE " << Page::MAX_SIZE;
+  size_t max_size = Page::maxRecordSize(fileHandle.getPageSize(), fileHandle.getLayout(), recordDescriptor.size());
+  if (new_size > max_size) {
+    origin_page.freeMem();
+    DB_ERROR << "data size " << new_size << " larger than max record size " << max_size;
     return -1;
   }
+  // the entries of origin page cover the record wherever it's forwarded to, they go first so that a failure leaves
+  // the record untouched
+  for (auto summary : summariesOf(fileHandle)) {
+    if (summary->add(rid.pageNum, recordDescriptor, data)) {
+      origin_page.freeMem();
+      return -1;
+    }
+  }
 
   /*
    * update record
    */
-  auto &origin_offset = origin_page->records_offset[rid.slotNum];
-  Page *cur_page = origin_page;
-  auto &cur_offset = origin_offset;
-  if (origin_offset.first != origin_page->pid) {
+  auto origin_offset = origin_page.getSlot(rid.slotNum);
+  Page *cur_page = &origin_page;
+  Page redirect_page(origin_offset.first);
+  SID cur_sid = rid.slotNum;
+  if (origin_offset.first != origin_page.pid) {
     // redirected to another page
-    cur_page = fileHandle.pages_[origin_offset.first].get();
+    cur_page = &redirect_page;
     cur_page->load(fileHandle);
-    cur_offset = cur_page->records_offset[origin_offset.second];
+    cur_sid = origin_offset.second;
   }
+  auto cur_offset = cur_page->getSlot(cur_sid);
 
-  size_t old_size = Page::getRecordSize(cur_page->data + cur_offset.second);
-  // here we should compare real_free_space_, since we don't need to allocate another slot directory
-  if (new_size > old_size && (new_size - old_size) > cur_page->real_free_space_) {
+  const char *new_record = data_to_be_inserted.second.data();
+  size_t old_size = cur_page->recordSize(cur_offset.second);
+  // here we should compare real_free_space_, since we don't need to allocate another slot directory. a record of a PAX
+  // page grows there by as many bytes as the encoded one, if the page accepts it
+  if (!cur_page->accepts(new_record) || (new_size > old_size && (new_size - old_size) > cur_page->real_free_space_)) {
     // become too large that current page can not fit
 
     // 1. delete from cur_page
-    auto cur_data_begin = cur_offset.second;
-    cur_offset = {cur_page->pid, Page::INVALID_OFFSET};
-    cur_page->deleteRecord(cur_data_begin);
+    cur_page->setSlot(cur_sid, {cur_page->pid, Page::INVALID_OFFSET});
+    cur_page->deleteRecord(cur_offset.second);
 
     // 2. insert into new_page
-    Page *new_page = findAvailableSlot(new_size, fileHandle);
-    if (new_page != origin_page) new_page->load(fileHandle);
     /*
      * be careful! might redirected back to origin page, which means new_page == origin_page,
-     * in that case we should re-use old directory and sid instead of create a new one
+     * in that case we should re-use old directory and sid instead of create a new one.
+     * it might also be the page the record was redirected to, which is already loaded
      */
+    Page other_page(INVALID_PID);
+    Page *new_page = &other_page;
+    while (true) {
+      PID new_pid = findAvailableSlot(new_size, fileHandle);
+      // see loadAvailablePage, loaded pages are accurate in free space map already, except that a PAX page might not
+      // accept the record
+      if (new_pid == origin_page.pid) new_page = &origin_page;
+      else if (new_pid == cur_page->pid) new_page = cur_page;
+      else {
+        other_page.pid = new_pid;
+        other_page.load(fileHandle);
+        if (!hasSpace(other_page, new_record, new_size)) {
+          other_page.freeMem();
+          continue;
+        }
+        break;
+      }
+      if (hasSpace(*new_page, new_record, new_size)) break;
+    }
 
-    if (new_page == origin_page) {
+    if (new_page == &origin_page) {
       SID origin_sid = rid.slotNum;
-      new_page->insertData(data_to_be_inserted.second.data(), new_size, origin_sid);
-      // new_page->records_offset[origin_sid] will be updated accordingly
+      new_page->insertData(new_record, new_size, origin_sid);
+      // slot origin_sid of new_page will point to the record in place accordingly
     } else {
-      RID new_rid = new_page->insertData(data_to_be_inserted.second.data(), new_size);
-      new_page->records_offset[new_rid.slotNum].first = Page::REDIRECT_PID;
-      origin_page->records_offset[rid.slotNum] = {new_rid.pageNum, new_rid.slotNum};
+      RID new_rid = new_page->insertData(new_record, new_size);
+      new_page->setSlot(new_rid.slotNum, {Page::REDIRECT_PID, new_page->getSlot(new_rid.slotNum).second});
+      origin_page.setSlot(rid.slotNum, {new_rid.pageNum, new_rid.slotNum});
     }
-    if (new_page != origin_page) new_page->dump(fileHandle);
+    if (new_page == &other_page) new_page->dump(fileHandle);
   } else {
-    // shift backward/forward inside cur_page
-    size_t shift_offset = std::abs(int(old_size) - int(new_size));
-    cur_page->shiftAfterRecords(cur_offset.second, shift_offset, new_size > old_size);
-    memcpy(cur_page->data + cur_offset.second, data_to_be_inserted.second.data(), new_size);
+    cur_page->updateData(cur_sid, new_record, new_size);
   }
 
-  origin_page->dump(fileHandle);
-  if (cur_page != origin_page) cur_page->dump(fileHandle);
-
+  origin_page.dump(fileHandle);
+  if (cur_page != &origin_page) cur_page->dump(fileHandle);
   return 0;
 }
 
-void RecordBasedFileManager::loadNextPage(FileHandle &fileHandle) {
-  // construct a Page object, read page to buffer, parse meta in corresponding data to initialize in-memory variables,
-  //   then free buffer up
-  std::shared_ptr<Page> cur_page = std::make_shared<Page>(fileHandle.pages_.size());
-  cur_page->load(fileHandle); // load and parse
-  cur_page->freeMem();
-//  free_slots_[cur_page->free_space].insert(cur_page.get());
-  fileHandle.pages_.push_back(cur_page);
-}
-
 void RecordBasedFileManager::appendNewPage(FileHandle &file_handle) {
-  if (file_handle.pages_.size() == Page::REDIRECT_PID) {
-    DB_ERROR << "Exceed max page num " << Page::REDIRECT_PID;
+  size_t page_size = file_handle.getPageSize();
+  if (file_handle.getNumberOfPages() >= Page::maxPageNum()) {
+    DB_ERROR << "Exceed max page num " << Page::maxPageNum();
     throw std::runtime_error("exceed max page num");
   }
-  char new_page[PAGE_SIZE];
-  Page::initPage(new_page);
+  char *new_page = PageIO::allocAligned(page_size);
+  Page::initPage(new_page, page_size, file_handle.getLayout());
   file_handle.appendPage(new_page);
+  PageIO::freeAligned(new_page);
 }
 
 std::vector<bool> RecordBasedFileManager::parseNullIndicator(const unsigned char *data, unsigned fields_num) {
@@ -340,165 +694,59 @@ std::pair<RC, std::vector<char>>
 RecordBasedFileManager::serializeRecord(const std::vector<Attribute> &recordDescriptor,
                                         const void *data,
                                         const directory_t ver) {
-  // parse null indicators
-  int fields_num = recordDescriptor.size();
-  int indicator_bytes_num = int(ceil(double(fields_num) / 8));
-  std::vector<bool> null_indicators = parseNullIndicator((const unsigned char *) data, recordDescriptor.size());
-
-  // the real data position
-  const char *real_data = ((char *) data) + indicator_bytes_num;
-
-  // create directories: "array of field offsets"
-  // the first element in the array indicates the number of fields in this record
-  // the second element indicates the schema version
-  // then the following elements indicate the END of records instead of head
-  std::vector<directory_t> directories{directory_t(fields_num), ver};
-  directory_t offset = entryDirectoryOverheadLength(fields_num); // offset from the head of encoded record
-  int raw_offset = indicator_bytes_num;
-  for (int i = 0; i < fields_num; ++i) {
-    // when a field is NULL, the directory has value of -1
-    if (!null_indicators[i]) {
-      if (recordDescriptor[i].type == TypeVarChar) {
-        // we also store the int which indicate varchar len
-        int char_len = *((int *) ((char *) data + raw_offset));
-        if (char_len > recordDescriptor[i].length) {
-          // varchar longer than upper limit
-          return {-1, std::vector<char>()};
-        }
-        offset += char_len + sizeof(int);
-        raw_offset += char_len + sizeof(int);
-      } else {
-        offset += recordDescriptor[i].length;
-        raw_offset += recordDescriptor[i].length;
-      }
-      directories.push_back(offset);
-    } else {
-      directories.push_back(-1);
-    }
-  }
-  std::vector<char> decoded_data(offset, 0);
-  size_t directory_size = sizeof(directory_t) * directories.size();
-  size_t real_data_size = offset - directory_size;
-
-  memcpy(decoded_data.data(), directories.data(), directory_size);
-  memcpy(decoded_data.data() + directory_size, real_data, real_data_size);
-
-  return {0, decoded_data};
+  std::vector<char> record;
+  RC ret = codecOf({recordDescriptor})->encode(data, ver, record);
+  return {ret, std::move(record)};
 }
 
 RC RecordBasedFileManager::deserializeRecord(const std::vector<std::vector<Attribute>> &recordDescriptors,
                                              void *out,
                                              const char *src,
-                                             std::vector<std::string> projected_fields,
+                                             const std::vector<std::string> &projected_fields,
                                              CompOp cmp,
                                              const std::string &cond_field,
                                              const void *cond_value) {
-
-  // 1. parse schema version
-  const std::vector<Attribute> &cur_schema = recordDescriptors.back();
-  directory_t cur_schema_ver = recordDescriptors.size() - 1;
-  directory_t *dir_pt = (directory_t *) src;
-  directory_t data_field_num = *dir_pt++;
-  directory_t data_schema_ver = *dir_pt++;
-  const std::vector<Attribute> &data_schema = recordDescriptors.at(data_schema_ver);
-  if (data_field_num != data_schema.size()) {
-    DB_ERROR << "field num not matched. " << data_schema.size() << " given in recordDescriptor, " << data_field_num
-             << " found in data";
-    return -1;
-  }
-
-  // 2. mapping fields between cur_schema and data_schema
-  if (projected_fields.empty()) {
-    // all fields
-    std::transform(cur_schema.begin(),
-                   cur_schema.end(),
-                   std::back_inserter(projected_fields),
-                   [](const Attribute &attr) { return attr.name; });
-  } else {
-    for (auto &projected_field: projected_fields) {
-      if (std::find_if(cur_schema.begin(),
-                       cur_schema.end(),
-                       [&](const Attribute &attr) { return attr.name == projected_field; }) == cur_schema.end()) {
-        DB_ERROR << "projected field `" << projected_field << "`" << "not found";
-        return -1;
-      }
-    }
-  }
-  std::unordered_map<std::string, int> data_field_to_idx;
-  for (int i = 0; i < data_schema.size(); ++i) {
-    data_field_to_idx[data_schema[i].name] = i;
-  }
-
-  // 3. parse fields offset
-  size_t directory_size = entryDirectoryOverheadLength(data_field_num);
-  size_t prev_offset = directory_size;
-  std::vector<std::tuple<bool, size_t, size_t >> fields_offset; // is_null, start, size
-
-  for (int i = 0; i < data_field_num; ++i) {
-    directory_t offset = *dir_pt++;
-    if (offset == -1) {// null
-
-      fields_offset.emplace_back(true, 0, 0);
-    } else {
-      // here we don't need to handle varchar as special case,
-      // since we already store that int for varchar len
-      directory_t field_size = offset - prev_offset;
-      fields_offset.emplace_back(false, prev_offset, field_size);
-      prev_offset = offset;
-    }
-  }
-
-
-  // 4. compare if condition is given
-  if (cmp != CompOp::NO_OP) {
-    auto cond_it = std::find_if(data_schema.begin(), data_schema.end(), [&](const Attribute &attr) {
-      return attr.name == cond_field;
-    });
-    if (cond_it != data_schema.end()) {
-      int cond_field_idx = cond_it - data_schema.begin();
-      if (std::get<0>(fields_offset[cond_field_idx])) return COND_NOT_SATISFIED; // compare NULL always false
-      size_t cond_field_start = std::get<1>(fields_offset[cond_field_idx]);
-      if (!cmpAttr(cmp, data_schema[cond_field_idx].type, src + cond_field_start, cond_value)) {
-        return COND_NOT_SATISFIED;
-      }
-    } else {
-      DB_ERROR << "condition attr `" << cond_field << "` not found on current schema!";
-      return -1;
-    }
+  if (cmp == NO_OP) {
+    auto codec = codecOf(recordDescriptors, projected_fields);
+    return codec ? codec->decode(src, out) : -1;
   }
+  // the condition value differs from call to call
+  ScanCondition condition;
+  condition.conjuncts.push_back({cond_field, cmp, cond_value});
+  RecordCodec codec;
+  if (codec.compile(recordDescriptors, projected_fields, condition)) return -1;
+  return codec.decode(src, out);
+}
 
-  // 5. make null indicator
-  int projected_fields_num = projected_fields.size();
-  int indicator_bytes_num = int(ceil(double(projected_fields_num) / 8));
-  unsigned char indicator_bytes[indicator_bytes_num];
-  memset(indicator_bytes, 0, indicator_bytes_num);
-  unsigned char *pt = indicator_bytes;
-  for (int i = 0; i < projected_fields_num; ++i) {
-    if (!data_field_to_idx.count(projected_fields[i]) ||
-        std::get<0>(fields_offset[data_field_to_idx.at(projected_fields[i])])) {
-      unsigned char mask = 1 << (7 - (i % 8));
-      *pt = *pt | mask;
+std::shared_ptr<const RecordCodec> RecordBasedFileManager::codecOf(const std::vector<std::vector<Attribute>> &schemas,
+                                                                   const std::vector<std::string> &projected_fields) {
+  // every list and name is preceded by its size, so that different arguments never make the same key
+  std::string key;
+  auto append = [&key](size_t value) { key.append(reinterpret_cast<const char *>(&value), sizeof(value)); };
+  append(schemas.size());
+  for (auto &schema : schemas) {
+    append(schema.size());
+    for (auto &attr : schema) {
+      append(attr.name.size());
+      key.append(attr.name);
+      append(attr.type);
+      append(attr.length);
     }
-    if (i % 8 == 7) pt++;
   }
-
-  char *out_pt = (char *) out;
-
-  memcpy(out_pt, indicator_bytes, indicator_bytes_num);
-  out_pt += indicator_bytes_num;
-
-  // 6. copy data
-  for (auto &projected_field:projected_fields) {
-    if (!data_field_to_idx.count(projected_field)) continue;// new field, old data, set null
-    int idx = data_field_to_idx.at(projected_field);
-    if (std::get<0>(fields_offset[idx])) continue;
-    size_t field_begin = std::get<1>(fields_offset[idx]);
-    size_t field_size = std::get<2>(fields_offset[idx]);
-    memcpy(out_pt, src + field_begin, field_size);
-    out_pt += field_size;
+  append(projected_fields.size());
+  for (auto &field : projected_fields) {
+    append(field.size());
+    key.append(field);
   }
 
-  return 0;
+  std::lock_guard<std::mutex> lock(codecs_mutex_);
+  auto it = codecs_.find(key);
+  if (it != codecs_.end()) return it->second;
+  auto codec = std::make_shared<RecordCodec>();
+  if (codec->compile(schemas, projected_fields)) return nullptr;
+  if (codecs_.size() >= CODEC_CACHE_SIZE) codecs_.clear();
+  codecs_.emplace(std::move(key), codec);
+  return codec;
 }
 
 int RecordBasedFileManager::getRecordLength(const std::vector<Attribute> &attrs, const void *data, int pos) {
@@ -517,82 +765,208 @@ int RecordBasedFileManager::getRecordLength(const std::vector<Attribute> &attrs,
   return res;
 }
 
-Page *RecordBasedFileManager::findAvailableSlot(size_t size, FileHandle &file_handle) {
+PID RecordBasedFileManager::findAvailableSlot(size_t size, FileHandle &file_handle) {
   // find the first available free slot to insert data
   // will also handle creating new page / new slot when there's no available one
-  for (auto p : file_handle.pages_) {
-    // TODO: I think here should be `p->free_space >= size`,
-    //  since free_space already reserved sizeof(unsigned) as we maintain internally
-//    if (p->free_space >= size) return p.get();
-    if (p->free_space >= size + sizeof(unsigned)) return p.get();
-  }
+  // TODO: I think here should be `free_space >= size`,
+  //  since free_space already reserved sizeof(unsigned) as we maintain internally
+  PageNum page_num = file_handle.fsm_.findFirst(size + sizeof(unsigned));
+  if (page_num < file_handle.getNumberOfPages()) return page_num;
   appendNewPage(file_handle);
-  return file_handle.pages_.back().get();
+  return file_handle.getNumberOfPages() - 1;
+}
+
+void RecordBasedFileManager::loadAvailablePage(const char *record, size_t size, FileHandle &file_handle, Page &page) {
+  while (true) {
+    page.pid = findAvailableSlot(size, file_handle);
+    page.load(file_handle);
+    if (hasSpace(page, record, size)) return;
+    page.freeMem();
+  }
+}
+
+bool RecordBasedFileManager::hasSpace(Page &page, const char *record, size_t size) {
+  page.maintainFreeSpace();
+  // same as what findAvailableSlot asks free space map for
+  if (page.free_space < size + sizeof(unsigned)) return false;
+  if (!page.pax_) return true;
+  if (!page.accepts(record)) {
+    // no record of this version fits until the rows of other versions are gone
+    if (page.handle_) page.handle_->fsm_.update(page.pid, 0);
+    return false;
+  }
+  if (page.free_space >= page.dataSize(record, size) + sizeof(unsigned)) return true;
+  // null bitmaps grow every 8 rows, hide the page from searches for this size so that they don't find it again
+  if (page.handle_) page.handle_->fsm_.update(page.pid, size + sizeof(unsigned) - 1);
+  return false;
+}
+
+RC RecordBasedFileManager::upgradeDirectories(FileHandle &file_handle) {
+  static const size_t extra_per_slot = Page::SLOT_SIZE - Page::PACKED_SLOT_SIZE;
+  auto key = [](PID pid, SID sid) { return (uint64_t(pid) << 16) | sid; };
+
+  // moving a record that is forwarded from another slot has to fix the forwarding pointer of its origin
+  std::unordered_map<uint64_t, RID> origins;
+  PID num_pages = file_handle.getNumberOfPages();
+  for (PID pid = 0; pid < num_pages; ++pid) {
+    Page page(pid);
+    page.load(file_handle);
+    for (SID sid = 0; sid < page.numSlots(); ++sid) {
+      auto offset = page.getSlot(sid);
+      if (offset.second == Page::INVALID_OFFSET || offset.first == pid || offset.first == Page::REDIRECT_PID) continue;
+      origins[key(offset.first, offset.second)] = {pid, sid};
+    }
+    page.freeMem();
+  }
+
+  // records are forwarded to pages appended here, which are wide already
+  PID spill_pid = INVALID_PID;
+  for (PID pid = 0; pid < num_pages; ++pid) {
+    // one page with the records it moves out is an atomic step
+    LogScope log_scope;
+    Page page(pid);
+    page.load(file_handle);
+    if (page.wide_) {
+      page.freeMem();
+      continue;
+    }
+    size_t extra = page.numSlots() * extra_per_slot;
+    while (page.real_free_space_ < extra) {
+      // the largest record in this page, a forwarded one only lives in its target
+      SID victim = Page::FIND_NEW_SID;
+      size_t victim_size = 0;
+      for (SID sid = 0; sid < page.numSlots(); ++sid) {
+        auto offset = page.getSlot(sid);
+        if (offset.second == Page::INVALID_OFFSET || (offset.first != pid && offset.first != Page::REDIRECT_PID)) {
+          continue;
+        }
+        size_t size = Page::getRecordSize(page.data + offset.second);
+        if (size > victim_size) {
+          victim = sid;
+          victim_size = size;
+        }
+      }
+      if (victim == Page::FIND_NEW_SID) {
+        DB_ERROR << "no record to move out of page " << pid;
+        return -1;
+      }
+
+      auto offset = page.getSlot(victim);
+      bool moved_in = offset.first == Page::REDIRECT_PID;
+      std::vector<char> record(page.data + offset.second, page.data + offset.second + victim_size);
+      page.setSlot(victim, {pid, Page::INVALID_OFFSET});
+      page.deleteRecord(offset.second);
+
+      if (spill_pid == INVALID_PID || file_handle.fsm_.get(spill_pid) < victim_size) {
+        appendNewPage(file_handle);
+        spill_pid = file_handle.getNumberOfPages() - 1;
+      }
+      Page spill_page(spill_pid);
+      spill_page.load(file_handle);
+      RID new_rid = spill_page.insertData(record.data(), victim_size);
+      spill_page.setSlot(new_rid.slotNum, {Page::REDIRECT_PID, spill_page.getSlot(new_rid.slotNum).second});
+      spill_page.dump(file_handle);
+
+      if (!moved_in) {
+        page.setSlot(victim, {new_rid.pageNum, new_rid.slotNum});
+        continue;
+      }
+      // slot in this page is dropped, origin now points to the new place directly
+      RID origin = origins.at(key(pid, victim));
+      origins[key(new_rid.pageNum, new_rid.slotNum)] = origin;
+      if (origin.pageNum == pid) {
+        page.setSlot(origin.slotNum, {new_rid.pageNum, new_rid.slotNum});
+      } else {
+        Page origin_page(origin.pageNum);
+        origin_page.load(file_handle);
+        origin_page.setSlot(origin.slotNum, {new_rid.pageNum, new_rid.slotNum});
+        origin_page.dump(file_handle);
+      }
+    }
+    page.real_free_space_ -= extra;
+    page.widenDirectory();
+    page.maintainFreeSpace();
+    page.dump(file_handle);
+  }
+  file_handle.setFormatVersion(FileHandle::FORMAT_VERSION);
+  return 0;
 }
 
-std::pair<bool, Page *> RecordBasedFileManager::loadPageWithRid(const RID &rid, FileHandle &file_handle) {
-  if (rid.pageNum >= file_handle.pages_.size()) {
+bool RecordBasedFileManager::loadPageWithRid(const RID &rid, FileHandle &file_handle, Page &page) {
+  if (rid.pageNum >= file_handle.getNumberOfPages()) {
     DB_WARNING << "RID invalid, page num " << rid.pageNum << " no exist";
-    return {false, nullptr};
+    return false;
   }
-  Page *origin_page = file_handle.pages_[rid.pageNum].get();
-  origin_page->load(file_handle);
+  page.load(file_handle);
 
-  if (rid.slotNum > origin_page->records_offset.size()
-      || origin_page->records_offset[rid.slotNum].second == Page::INVALID_OFFSET
-      || origin_page->records_offset[rid.slotNum].first == Page::REDIRECT_PID) {
+  if (rid.slotNum >= page.numSlots()
+      || page.getSlot(rid.slotNum).second == Page::INVALID_OFFSET
+      || page.getSlot(rid.slotNum).first == Page::REDIRECT_PID) {
     DB_WARNING << "RID invalid, slot num " << rid.slotNum << " in page " << rid.pageNum
                << " not exist, might be deleted or redirected or out of bound";
-    origin_page->freeMem();
-    return {false, nullptr};
+    page.freeMem();
+    return false;
   }
-  return {true, origin_page};
+  return true;
 }
 
 bool RecordBasedFileManager::cmpAttr(CompOp cmp,
                                      AttrType type,
                                      const void *val1,
                                      const void *val2) {
-  static const std::unordered_map<CompOp, std::function<bool(int, int)>, EnumHash> int_op_map{
-      {CompOp::EQ_OP, std::equal_to<int>()},
-      {CompOp::NE_OP, std::not_equal_to<int>()},
-      {CompOp::LT_OP, std::less<int>()},
-      {CompOp::LE_OP, std::less_equal<int>()},
-      {CompOp::GT_OP, std::greater<int>()},
-      {CompOp::GE_OP, std::greater_equal<int>()},
-  };
-  static const std::unordered_map<CompOp, std::function<bool(float, float)>, EnumHash> float_op_map{
-      {CompOp::EQ_OP, std::equal_to<float>()},
-      {CompOp::NE_OP, std::not_equal_to<float>()},
-      {CompOp::LT_OP, std::less<float>()},
-      {CompOp::LE_OP, std::less_equal<float>()},
-      {CompOp::GT_OP, std::greater<float>()},
-      {CompOp::GE_OP, std::greater_equal<float>()},
-  };
-  static const std::unordered_map<CompOp, std::function<bool(const char *, const char *, int, int)>, EnumHash>
-      char_op_map{
-      {CompOp::EQ_OP, [](const char *s1, const char *s2, int l1, int l2) { return myStrcmp(s1, s2, l1, l2) == 0; }},
-      {CompOp::NE_OP, [](const char *s1, const char *s2, int l1, int l2) { return myStrcmp(s1, s2, l1, l2) != 0; }},
-      {CompOp::LT_OP, [](const char *s1, const char *s2, int l1, int l2) { return myStrcmp(s1, s2, l1, l2) < 0; }},
-      {CompOp::LE_OP, [](const char *s1, const char *s2, int l1, int l2) { return myStrcmp(s1, s2, l1, l2) <= 0; }},
-      {CompOp::GT_OP, [](const char *s1, const char *s2, int l1, int l2) { return myStrcmp(s1, s2, l1, l2) > 0; }},
-      {CompOp::GE_OP, [](const char *s1, const char *s2, int l1, int l2) { return myStrcmp(s1, s2, l1, l2) >= 0; }},
-  };
+  Comparator compare = getComparator(type, cmp);
+  if (!compare) {
+    DB_ERROR << "Unrecognized AttrType " << type << " or CompOp " << cmp;
+    return false;
+  }
+  return compare(val1, val2);
+}
 
-  if (type == AttrType::TypeInt) {
-    return int_op_map.at(cmp)(*static_cast<const int *>(val1), *static_cast<const int *>(val2));
-  } else if (type == AttrType::TypeReal) {
-    return float_op_map.at(cmp)(*static_cast<const float *>(val1), *static_cast<const float *>(val2));
-  } else if (type == AttrType::TypeVarChar) {
-    int l1 = *((const int *) val1), l2 = *((const int *) val2);
+/**
+ * `lhs cmp rhs`, cmp is a constant in every instance so only one comparison is left
+ */
+template<CompOp cmp, typename T>
+static inline bool applyOp(T lhs, T rhs) {
+  switch (cmp) {
+    case EQ_OP: return lhs == rhs;
+    case NE_OP: return lhs != rhs;
+    case LT_OP: return lhs < rhs;
+    case LE_OP: return lhs <= rhs;
+    case GT_OP: return lhs > rhs;
+    default: return lhs >= rhs;
+  }
+}
 
-    return char_op_map.at(cmp)(static_cast<const char *>(val1) + sizeof(int),
-                               static_cast<const char *>(val2) + sizeof(int),
+template<AttrType type, CompOp cmp>
+bool RecordBasedFileManager::compareValues(const void *lhs, const void *rhs) {
+  if (type == TypeInt) return applyOp<cmp>(*static_cast<const int *>(lhs), *static_cast<const int *>(rhs));
+  if (type == TypeReal) return applyOp<cmp>(*static_cast<const float *>(lhs), *static_cast<const float *>(rhs));
+  int l1 = *static_cast<const int *>(lhs), l2 = *static_cast<const int *>(rhs);
+  return applyOp<cmp>(myStrcmp(static_cast<const char *>(lhs) + sizeof(int),
+                               static_cast<const char *>(rhs) + sizeof(int),
                                l1,
-                               l2);
-  } else {
-    DB_ERROR << "Unrecognized AttrType " << type;
-    return false;
+                               l2), 0);
+}
+
+template<AttrType type>
+Comparator RecordBasedFileManager::comparatorOf(CompOp cmp) {
+  switch (cmp) {
+    case EQ_OP: return &compareValues<type, EQ_OP>;
+    case NE_OP: return &compareValues<type, NE_OP>;
+    case LT_OP: return &compareValues<type, LT_OP>;
+    case LE_OP: return &compareValues<type, LE_OP>;
+    case GT_OP: return &compareValues<type, GT_OP>;
+    case GE_OP: return &compareValues<type, GE_OP>;
+    default: return nullptr;
+  }
+}
+
+Comparator RecordBasedFileManager::getComparator(AttrType type, CompOp cmp) {
+  switch (type) {
+    case TypeInt: return comparatorOf<TypeInt>(cmp);
+    case TypeReal: return comparatorOf<TypeReal>(cmp);
+    case TypeVarChar: return comparatorOf<TypeVarChar>(cmp);
+    default: return nullptr;
   }
 }
 
@@ -602,41 +976,130 @@ bool RecordBasedFileManager::cmpAttr(CompOp cmp,
  *
  *************************************/
 
-const size_t Page::MAX_SIZE = PAGE_SIZE - 3 * sizeof(int);
 const SID Page::FIND_NEW_SID = UINT16_MAX;
-const unsigned Page::INVALID_OFFSET = 0xfff;  // PageOffset value to indicate a deleted slot
-const unsigned Page::REDIRECT_PID = 0xfffff;
+// in-memory values, never valid for any page size. wide slots use flags for them, packed slots all ones of the
+// offset/pid bits
+const unsigned Page::INVALID_OFFSET = UINT16_MAX;
+const unsigned Page::REDIRECT_PID = INVALID_PID - 1;
+const size_t Page::SLOT_SIZE = sizeof(Page::Directory);
+const size_t Page::PACKED_SLOT_SIZE = sizeof(unsigned);
+const uint16_t Page::SLOT_DELETED = 1;
+const uint16_t Page::SLOT_FORWARDED = 2;
+const uint16_t Page::SLOT_MOVED_IN = 4;
+const unsigned Page::MAX_FRAGMENTED = 0x7FFF;
+
+// set in num_slots of page tail for wide pages, num_slots of packed pages never reaches it
+static const unsigned WIDE_PAGE_FLAG = 0x80000000;
+// bits of num_slots of a wide page above the slot count hold fragmented bytes, zero before format version 4
+static const unsigned FRAGMENTED_SHIFT = 16;
+static const unsigned NUM_SLOTS_MASK = 0xFFFF;
+// set in real_free_space of page tail for PAX pages, which are always wide
+static const unsigned PAX_PAGE_FLAG = 0x80000000;
+
+/**
+ * locate all fields of an encoded record from its offset directory
+ * @return schema version of record
+ */
+static directory_t locateFields(const char *record, std::vector<std::pair<const char *, unsigned>> &fields) {
+  // same layout as serializeRecord writes: [field_num, version, end of each field (-1 for NULL)...][data...]
+  const directory_t *dir_pt = reinterpret_cast<const directory_t *>(record);
+  directory_t field_num = *dir_pt++;
+  directory_t ver = *dir_pt++;
+  fields.clear();
+  size_t prev_offset = sizeof(directory_t) * (field_num + 2);
+  for (int i = 0; i < field_num; ++i) {
+    directory_t offset = *dir_pt++;
+    if (offset == -1) {
+      fields.emplace_back(nullptr, 0);
+    } else {
+      fields.emplace_back(record + prev_offset, offset - prev_offset);
+      prev_offset = offset;
+    }
+  }
+  return ver;
+}
+
+Page::Page(PID page_id)
+    : data_end(0), data(nullptr), handle_(nullptr), page_size_(PAGE_SIZE), offset_bits_(0), wide_(true),
+      real_free_space_(0), fragmented_(0), dirty_begin_(PAGE_SIZE), dirty_end_(0), num_slots_(0),
+      free_slots_built_(false), pax_(false), num_rows_(0), pax_fields_(0), pax_version_(0), pid(page_id),
+      free_space(0) {}
+
+size_t Page::maxRecordSize(size_t page_size, PageLayout layout, size_t num_fields) {
+  size_t capacity = page_size - 2 * sizeof(unsigned) - SLOT_SIZE;
+  if (layout == LAYOUT_PAX) {
+    // an empty page takes a record of size s in s - 4 bytes plus one bitmap byte and a minipage begin of two bytes
+    // for each field, which has to leave the margin hasSpace asks for
+    capacity -= sizeof(PaxHeader) + std::max(num_fields * (1 + sizeof(uint16_t)), sizeof(unsigned));
+  }
+  return std::min(capacity, size_t(INT16_MAX));
+}
 
-Page::Page(PID page_id) : pid(page_id), data(nullptr), data_end(0) {}
+PID Page::maxPageNum() {
+  return REDIRECT_PID;
+}
 
 Page::~Page() {
   if (data) freeMem();
 }
 
-void Page::load(FileHandle &handle) {
-  if (!data) data = (char *) malloc(PAGE_SIZE);
-  handle.readPage(pid, data);
+void Page::load(FileHandle &handle, ScanRing *ring) {
+  if (!data && handle.isMapped()) {
+    // view onto the mapping, never written since dump is rejected for mapped handle
+    data = const_cast<char *>(handle.mappedPage(pid));
+    if (!data) throw std::runtime_error("failed to map page " + std::to_string(pid));
+    handle_ = &handle;
+  } else if (!data) {
+    data = BufferPool::instance().pin(handle, pid, ring);
+    if (!data) throw std::runtime_error("failed to pin page " + std::to_string(pid));
+    handle_ = &handle;
+  }
+  page_size_ = handle.getPageSize();
+  offset_bits_ = __builtin_ctz(page_size_);
+  dirty_begin_ = page_size_;
+  dirty_end_ = 0;
   parseMeta();
-  maintainFreeSpace();
 //  DB_DEBUG << "page after load" << ToString();
 }
 
+void Page::attach(char *buffer, size_t page_size) {
+  data = buffer;
+  handle_ = nullptr;
+  page_size_ = page_size;
+  offset_bits_ = __builtin_ctz(page_size_);
+  dirty_begin_ = page_size_;
+  dirty_end_ = 0;
+  parseMeta();
+}
+
 void Page::freeMem() {
-  free(data);
+  if (!data) return;
+  if (!handle_->isMapped()) BufferPool::instance().unpin(*handle_, pid, false);
   data = nullptr;
+  handle_ = nullptr;
 }
 
 RID Page::insertData(const char *new_data, size_t size, SID sid) {
   if (sid == FIND_NEW_SID) sid = findNextSlotID();
-  if (sid == records_offset.size()) {
+  if (pax_) {
+    // the directory grows into the room of the last minipage, which is moved if it needs that room
+    if (sid == num_slots_) ++num_slots_;
+    writePaxRow(num_rows_, new_data);
+    setSlot(sid, {pid, num_rows_ - 1});
+    maintainFreeSpace();
+    return {pid, sid};
+  }
+  // holes are only reclaimed when the space in front of the directory runs out
+  if (contiguousFreeSpace() < size + (sid == num_slots_ ? slotSize() : 0)) compact();
+  if (sid == num_slots_) {
     // new slot
-    records_offset.emplace_back(pid, data_end);
-    real_free_space_ -= sizeof(int);
-  } else {
-    // use previous deleted slot
-    records_offset[sid] = {pid, data_end};
+    ++num_slots_;
+    real_free_space_ -= slotSize();
   }
+  // otherwise use previous deleted slot
+  setSlot(sid, {pid, data_end});
   memcpy(data + data_end, new_data, size);
+  markDirty(data_end, data_end + size);
 
   data_end += size;
   real_free_space_ -= size;
@@ -646,97 +1109,434 @@ RID Page::insertData(const char *new_data, size_t size, SID sid) {
 }
 
 RC Page::deleteRecord(size_t record_begin_offset) {
+  if (pax_) {
+    // rows after it move up by one
+    for (SID sid = 0; sid < num_slots_; ++sid) {
+      auto offset = getSlot(sid);
+      if (offset.first != pid && offset.first != REDIRECT_PID) continue;
+      if (offset.second == INVALID_OFFSET || offset.second <= record_begin_offset) continue;
+      setSlot(sid, {offset.first, offset.second - 1});
+    }
+    writePaxRow(record_begin_offset, nullptr);
+    maintainFreeSpace();
+    return 0;
+  }
   size_t record_size = getRecordSize(data + record_begin_offset);
-  shiftAfterRecords(record_begin_offset, record_size, false);
-//  real_free_space_ -= record_size;
+  if (!wide_) {
+    // packed pages are only modified while being upgraded, and have no room to record fragmentation
+    shiftAfterRecords(record_begin_offset, record_size, false);
+    maintainFreeSpace();
+    return 0;
+  }
+  real_free_space_ += record_size;
+  if (record_begin_offset + record_size == data_end) data_end = record_begin_offset;
+  else addFragment(record_size);
   maintainFreeSpace();
   return 0;
 }
 
-RC Page::readData(PageOffset record_offset,
-                  void *out,
-                  const std::vector<std::vector<Attribute>> &recordDescriptors,
-                  const std::vector<std::string> &projected_fields,
-                  CompOp cmp,
-                  const std::string &cond_field,
-                  const void *cond_value) {
-  return RecordBasedFileManager::deserializeRecord(recordDescriptors,
-                                                   out,
-                                                   data + record_offset,
-                                                   projected_fields,
-                                                   cmp,
-                                                   cond_field,
-                                                   cond_value);
+void Page::updateData(SID sid, const char *new_data, size_t size) {
+  if (pax_) {
+    writePaxRow(getSlot(sid).second, new_data);
+    maintainFreeSpace();
+    return;
+  }
+  size_t begin = getSlot(sid).second;
+  size_t old_size = getRecordSize(data + begin);
+  if (!wide_) {
+    shiftAfterRecords(begin, std::abs(int(old_size) - int(size)), size > old_size);
+    memcpy(data + begin, new_data, size);
+    markDirty(begin, begin + size);
+    return;
+  }
+  bool last = begin + old_size == data_end;
+  real_free_space_ += old_size;
+  if (size <= old_size || (last && contiguousFreeSpace() >= size - old_size)) {
+    memcpy(data + begin, new_data, size);
+    markDirty(begin, begin + size);
+    if (last) data_end = begin + size;
+    else addFragment(old_size - size);
+  } else {
+    // old place becomes a hole, slot is invalid meanwhile so that compaction skips it
+    PID slot_pid = getSlot(sid).first;
+    setSlot(sid, {slot_pid, INVALID_OFFSET});
+    if (last) data_end = begin;
+    else addFragment(old_size);
+    if (contiguousFreeSpace() < size) compact();
+    setSlot(sid, {slot_pid, data_end});
+    memcpy(data + data_end, new_data, size);
+    markDirty(data_end, data_end + size);
+    data_end += size;
+  }
+  real_free_space_ -= size;
+  maintainFreeSpace();
+}
+
+void Page::compact() {
+  if (pax_) return; // holes between minipages are reclaimed by compactPax
+  // records in page order, each one slides down over the holes before it
+  std::vector<SID> sids;
+  for (SID sid = 0; sid < num_slots_; ++sid) {
+    auto offset = getSlot(sid);
+    if (offset.second == INVALID_OFFSET || (offset.first != pid && offset.first != REDIRECT_PID)) continue;
+    sids.push_back(sid);
+  }
+  std::sort(sids.begin(), sids.end(), [this](SID a, SID b) {
+    return getSlot(a).second < getSlot(b).second;
+  });
+  size_t end = 0;
+  for (SID sid : sids) {
+    auto offset = getSlot(sid);
+    size_t size = getRecordSize(data + offset.second);
+    if (offset.second != end) {
+      memmove(data + end, data + offset.second, size);
+      markDirty(end, end + size);
+      setSlot(sid, {offset.first, PageOffset(end)});
+    }
+    end += size;
+  }
+  DB_DEBUG << "Page " << pid << " compacted, " << data_end - end << " bytes reclaimed";
+  data_end = end;
+  fragmented_ = 0;
+}
+
+RC Page::readData(PageOffset record_offset, void *out, const RecordCodec &codec) {
+  return codec.decode(*this, record_offset, out);
+}
+
+bool Page::accepts(const char *record) const {
+  if (!pax_ || !num_rows_) return true;
+  auto dir_pt = reinterpret_cast<const directory_t *>(record);
+  return dir_pt[0] == pax_fields_ && dir_pt[1] == pax_version_;
+}
+
+size_t Page::dataSize(const char *record, size_t size) const {
+  if (!pax_) return size;
+  // field ends of minipages replace the offset directory, except its field_num and version. the first row also brings
+  // the begin of each minipage
+  directory_t num_fields = reinterpret_cast<const directory_t *>(record)[0];
+  size_t index_size = (num_rows_ % 8 == 0 ? num_fields : 0) + (num_rows_ ? 0 : num_fields * sizeof(uint16_t));
+  return size - 2 * sizeof(directory_t) + index_size;
+}
+
+size_t Page::recordSize(PageOffset record_offset) const {
+  if (!pax_) return getRecordSize(data + record_offset);
+  size_t size = RecordBasedFileManager::entryDirectoryOverheadLength(pax_fields_);
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    unsigned field_size;
+    paxField(field, record_offset, field_size);
+    size += field_size;
+  }
+  return size;
+}
+
+void Page::copyRecord(PageOffset record_offset, std::vector<char> &out) const {
+  if (!pax_) {
+    const char *begin = data + record_offset;
+    out.assign(begin, begin + getRecordSize(begin));
+    return;
+  }
+  out.assign(RecordBasedFileManager::entryDirectoryOverheadLength(pax_fields_), 0);
+  reinterpret_cast<directory_t *>(out.data())[0] = pax_fields_;
+  reinterpret_cast<directory_t *>(out.data())[1] = pax_version_;
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    unsigned size;
+    const char *value = paxField(field, record_offset, size);
+    if (value) out.insert(out.end(), value, value + size);
+    reinterpret_cast<directory_t *>(out.data())[field + 2] = value ? directory_t(out.size()) : directory_t(-1);
+  }
 }
 
 void Page::dump(FileHandle &handle) {
   if (not data) {
     throw std::runtime_error("dump empty data");
   }
+  if (handle_->isMapped()) {
+    throw std::runtime_error("dump page " + std::to_string(pid) + " of read-only file");
+  }
 //  DB_DEBUG << "page before dump:" << ToString();
+  // frame has to be unpinned inside the scope, so that it's not written back before the scope commits
+  LogScope log_scope;
   // dump meta
   dumpMeta();
+  // modified records and the whole slot directory
+  size_t meta_begin = page_size_ - 2 * sizeof(unsigned) - num_slots_ * slotSize();
+  handle.logPage(pid, data, {{dirty_begin_, dirty_end_}, {meta_begin, page_size_}});
 
-  handle.writePage(pid, data);
-  freeMem();
+  handle.meta_modified_ = true;
+  BufferPool::instance().unpin(*handle_, pid, true);
+  data = nullptr;
+  handle_ = nullptr;
 }
 
 void Page::parseMeta() {
 
   /*
-   * remember to reset in-memory data
+   * layout of tail of page: [...directories...., num_slots, real_free_space]
+   * directories are Directory for wide pages (WIDE_PAGE_FLAG set in num_slots), 32-bit packed ones otherwise.
+   * records are packed from the beginning of page up to data_end, except for holes of `fragmented_` bytes in total
+   * directories are not decoded here, getSlot reads the one asked for
    */
-  records_offset.clear();
-  invalid_slots_.clear();
 
-  /*
-   * layout of tail of page: [...directories...., num_slots, real_free_space]
-   */
+  unsigned *pt = (unsigned *) (data + page_size_) - 1;
+  real_free_space_ = *pt--;
+  pax_ = real_free_space_ & PAX_PAGE_FLAG;
+  real_free_space_ &= ~PAX_PAGE_FLAG;
+  num_slots_ = *pt;
+  wide_ = num_slots_ & WIDE_PAGE_FLAG;
+  fragmented_ = wide_ ? (num_slots_ >> FRAGMENTED_SHIFT) & MAX_FRAGMENTED : 0;
+  if (wide_) num_slots_ &= NUM_SLOTS_MASK;
+  data_end = page_size_ - 2 * sizeof(unsigned) - num_slots_ * slotSize() - real_free_space_ + fragmented_;
+
+  // remember to reset in-memory data
+  free_slots_.clear();
+  free_slots_built_ = false;
+  if (pax_) parsePax();
+}
 
-  unsigned *pt = (unsigned *) (data + PAGE_SIZE) - 1;
-  if (real_free_space_ != *(pt)) {
-    DB_ERROR << "FUCK " << real_free_space_ << " " << *pt;
+void Page::parsePax() {
+  PaxHeader header;
+  memcpy(&header, data, sizeof(header));
+  num_rows_ = header.num_rows;
+  pax_fields_ = header.num_fields;
+  pax_version_ = header.version;
+  minipages_.resize(pax_fields_);
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    uint16_t begin;
+    memcpy(&begin, data + sizeof(PaxHeader) + field * sizeof(uint16_t), sizeof(uint16_t));
+    minipages_[field] = begin;
   }
-  real_free_space_ = *pt--;
-  unsigned num_slots = *pt--;
+}
 
-  // scan record offsets from back to front
-  for (int i = 0; i < num_slots; ++i) {
-    records_offset.push_back(decodeDirectory(*pt--));
-    if (records_offset.back().second != INVALID_OFFSET) {
-    } else {
-      // invalid(deleted) entry
-      invalid_slots_.insert(i);
+static inline size_t paxIndexSize(unsigned rows) {
+  return (rows + 7) / 8 + rows * sizeof(uint16_t);
+}
+
+static inline uint16_t loadEnd(const char *ends, unsigned row) {
+  uint16_t end;
+  memcpy(&end, ends + row * sizeof(uint16_t), sizeof(uint16_t));
+  return end;
+}
+
+static inline void storeEnd(char *ends, unsigned row, uint16_t end) {
+  memcpy(ends + row * sizeof(uint16_t), &end, sizeof(uint16_t));
+}
+
+static inline void setNullBit(char *bitmap, unsigned row, bool null) {
+  if (null) bitmap[row / 8] |= char(1 << row % 8);
+  else bitmap[row / 8] &= char(~(1 << row % 8));
+}
+
+/**
+ * change row `row` of the minipage of `rows` rows at `minipage` in place, see Page::writePaxRow. the room after the
+ * minipage has to fit its new size
+ * @param value nullptr for NULL
+ * @return size of the minipage afterwards
+ */
+static size_t writeMinipage(char *minipage,
+                            unsigned rows,
+                            unsigned row,
+                            bool remove,
+                            const char *value,
+                            unsigned size) {
+  size_t bitmap_size = (rows + 7) / 8;
+  char *ends = minipage + bitmap_size;
+  char *values = ends + rows * sizeof(uint16_t);
+  uint16_t values_size = rows ? loadEnd(ends, rows - 1) : 0;
+  if (row == rows) {
+    // values, then value ends, move towards the end by the bytes that the bitmap and the ends grow
+    char *new_ends = minipage + (rows + 8) / 8;
+    char *new_values = new_ends + (rows + 1) * sizeof(uint16_t);
+    memmove(new_values, values, values_size);
+    if (value) memcpy(new_values + values_size, value, size);
+    memmove(new_ends, ends, rows * sizeof(uint16_t));
+    storeEnd(new_ends, rows, uint16_t(values_size + size));
+    if (new_ends - minipage > ptrdiff_t(bitmap_size)) minipage[bitmap_size] = 0;
+    setNullBit(minipage, rows, !value);
+    return new_values + values_size + size - minipage;
+  }
+  uint16_t begin = row ? loadEnd(ends, row - 1) : 0, end = loadEnd(ends, row);
+  if (remove) {
+    // everything moves towards the beginning, so the bitmap is shifted first, then the ends, then the values
+    for (unsigned r = row; r + 1 < rows; ++r) setNullBit(minipage, r, minipage[(r + 1) / 8] & (1 << (r + 1) % 8));
+    setNullBit(minipage, rows - 1, false);
+    char *new_ends = minipage + (rows + 6) / 8;
+    char *new_values = new_ends + (rows - 1) * sizeof(uint16_t);
+    memmove(new_ends, ends, row * sizeof(uint16_t));
+    memmove(new_ends + row * sizeof(uint16_t),
+            ends + (row + 1) * sizeof(uint16_t),
+            (rows - row - 1) * sizeof(uint16_t));
+    for (unsigned r = row; r + 1 < rows; ++r) storeEnd(new_ends, r, uint16_t(loadEnd(new_ends, r) - (end - begin)));
+    memmove(new_values, values, begin);
+    memmove(new_values + begin, values + end, values_size - end);
+    return new_values + values_size - (end - begin) - minipage;
+  }
+  memmove(values + begin + size, values + end, values_size - end);
+  if (value) memcpy(values + begin, value, size);
+  int delta = int(size) - int(end - begin);
+  for (unsigned r = row; r < rows; ++r) storeEnd(ends, r, uint16_t(loadEnd(ends, r) + delta));
+  setNullBit(minipage, row, !value);
+  return values + values_size + delta - minipage;
+}
+
+void Page::writePaxRow(unsigned row, const char *record) {
+  if (!record && num_rows_ == 1) {
+    // a page without rows has no fields, the next row decides them
+    PaxHeader header = {0, 0, pax_version_, 0};
+    memcpy(data, &header, sizeof(header));
+    markDirty(0, sizeof(header));
+    num_rows_ = 0;
+    pax_fields_ = 0;
+    minipages_.clear();
+    accountPax();
+    return;
+  }
+  std::vector<std::pair<const char *, unsigned>> fields;
+  if (record) pax_version_ = locateFields(record, fields);
+  if (!num_rows_) {
+    // minipages are empty, compactPax below lays them out
+    pax_fields_ = directory_t(fields.size());
+    minipages_.assign(pax_fields_, sizeof(PaxHeader) + pax_fields_ * sizeof(uint16_t));
+  }
+  unsigned rows = record ? std::max(num_rows_, row + 1) : num_rows_ - 1;
+
+  // minipages that shrink are changed first, so that the room they leave is there if the others have to be moved
+  std::vector<size_t> sizes(pax_fields_);
+  std::vector<bool> grows(pax_fields_);
+  bool fits = num_rows_ > 0;
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    unsigned old_size = 0;
+    if (row < num_rows_) paxField(field, row, old_size);
+    size_t size = minipageSize(field);
+    sizes[field] = size + paxIndexSize(rows) - paxIndexSize(num_rows_) + (record ? fields[field].second : 0) - old_size;
+    grows[field] = sizes[field] > size;
+    if (!grows[field]) {
+      writeMinipage(data + minipages_[field], num_rows_, row, !record, record ? fields[field].first : nullptr,
+                    record ? fields[field].second : 0);
+      markDirty(minipages_[field], minipages_[field] + size);
+      continue;
     }
+    size_t room_end = field + 1 < pax_fields_ ? minipages_[field + 1]
+                                               : page_size_ - 2 * sizeof(unsigned) - num_slots_ * slotSize();
+    if (minipages_[field] + sizes[field] > room_end) fits = false;
+  }
+  if (!fits) compactPax(sizes);
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    if (!grows[field]) continue;
+    writeMinipage(data + minipages_[field], num_rows_, row, !record, fields[field].first, fields[field].second);
+    markDirty(minipages_[field], minipages_[field] + sizes[field]);
+  }
+
+  num_rows_ = rows;
+  PaxHeader header = {uint16_t(num_rows_), pax_fields_, pax_version_, 0};
+  memcpy(data, &header, sizeof(header));
+  markDirty(0, sizeof(header));
+  accountPax();
+  if (fragmented_ <= MAX_FRAGMENTED) return;
+  for (directory_t field = 0; field < pax_fields_; ++field) sizes[field] = minipageSize(field);
+  compactPax(sizes);
+  accountPax();
+}
+
+void Page::compactPax(const std::vector<size_t> &sizes) {
+  std::vector<size_t> old_sizes(pax_fields_), begins(pax_fields_);
+  size_t begin = sizeof(PaxHeader) + pax_fields_ * sizeof(uint16_t), total = 0;
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    old_sizes[field] = minipageSize(field);
+    total += sizes[field];
+  }
+  // the share of the last minipage stays in front of the slot directory, holes are limited to what fits in the tail
+  size_t spare = page_size_ - 2 * sizeof(unsigned) - num_slots_ * slotSize() - begin - total, holes = 0;
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    begins[field] = begin;
+    size_t hole = field + 1 < pax_fields_ && total ? spare * sizes[field] / total : 0;
+    hole = std::min(hole, MAX_FRAGMENTED - holes);
+    holes += hole;
+    begin += sizes[field] + hole;
+  }
+
+  // minipages keep their order, so the ones moving to the beginning are moved in order, the others in reverse order
+  auto move = [&](directory_t field) {
+    if (begins[field] == minipages_[field]) return;
+    memmove(data + begins[field], data + minipages_[field], old_sizes[field]);
+    markDirty(begins[field], begins[field] + old_sizes[field]);
+  };
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    if (begins[field] < minipages_[field]) move(field);
+  }
+  for (directory_t field = pax_fields_; field-- > 0;) {
+    if (begins[field] > minipages_[field]) move(field);
+  }
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    uint16_t field_begin = uint16_t(begins[field]);
+    memcpy(data + sizeof(PaxHeader) + field * sizeof(uint16_t), &field_begin, sizeof(uint16_t));
+  }
+  markDirty(sizeof(PaxHeader), sizeof(PaxHeader) + pax_fields_ * sizeof(uint16_t));
+  minipages_ = begins;
+  DB_DEBUG << "PAX page " << pid << " compacted, " << holes << " bytes of holes";
+}
+
+size_t Page::minipageSize(unsigned field) const {
+  if (!num_rows_) return 0;
+  return paxIndexSize(num_rows_) + loadEnd(data + minipages_[field] + (num_rows_ + 7) / 8, num_rows_ - 1);
+}
+
+void Page::accountPax() {
+  size_t used = sizeof(PaxHeader) + pax_fields_ * sizeof(uint16_t);
+  data_end = used;
+  fragmented_ = 0;
+  for (directory_t field = 0; field < pax_fields_; ++field) {
+    size_t size = minipageSize(field);
+    used += size;
+    if (field + 1 < pax_fields_) fragmented_ += minipages_[field + 1] - minipages_[field] - size;
+    else data_end = minipages_[field] + size;
   }
-  data_end = PAGE_SIZE - (num_slots + 2) * sizeof(unsigned) - real_free_space_;
+  real_free_space_ = page_size_ - 2 * sizeof(unsigned) - num_slots_ * slotSize() - used;
 }
 
 void Page::dumpMeta() {
-  unsigned num_slots = records_offset.size();
-  unsigned *pt = (unsigned *) (data + PAGE_SIZE) - 1;
-  *pt-- = real_free_space_;
-  *pt-- = records_offset.size();
-  // scan record offsets from back to front
-  for (int i = 0; i < num_slots; ++i) {
-    *pt-- = encodeDirectory(records_offset[i]);
+  // directories are written in place by setSlot
+  unsigned *pt = (unsigned *) (data + page_size_) - 1;
+  *pt-- = real_free_space_ | (pax_ ? PAX_PAGE_FLAG : 0);
+  *pt = wide_ ? num_slots_ | WIDE_PAGE_FLAG | fragmented_ << FRAGMENTED_SHIFT : num_slots_;
+}
+
+void Page::buildFreeSlots() {
+  if (free_slots_built_) return;
+  free_slots_.assign((num_slots_ + 63) / 64, 0);
+  free_slots_built_ = true;
+  for (SID sid = 0; sid < num_slots_; ++sid) {
+    if (getSlot(sid).second == INVALID_OFFSET) markFreeSlot(sid, true);
   }
 }
 
+void Page::widenDirectory() {
+  if (wide_) return;
+  std::vector<std::pair<PID, PageOffset>> slots;
+  for (SID sid = 0; sid < num_slots_; ++sid) slots.push_back(getSlot(sid));
+  wide_ = true;
+  for (SID sid = 0; sid < num_slots_; ++sid) setSlot(sid, slots[sid]);
+}
+
 //std::string Page::ToString() const {
 //  std::ostringstream oss;
 //  oss << "Page: " << pid << " free space:" << free_space << " real free space " << real_free_space_ << "\n";
-//  for (int i = 0; i < records_offset.size(); ++i) {
-//    oss << "\tRecord " << i << " offset " << records_offset[i].first << "," << records_offset[i].second << "\n";
+//  for (SID i = 0; i < num_slots_; ++i) {
+//    oss << "\tRecord " << i << " offset " << getSlot(i).first << "," << getSlot(i).second << "\n";
 //  }
 //  return oss.str();
 //}
 
-void Page::initPage(char *page_data) {
-  // assume page_data is PAGE_SIZE
+void Page::initPage(char *page_data, size_t page_size, PageLayout layout) {
   // reserve 2 ints, one for freespace, one for num_slots
-  *((int *) (page_data + PAGE_SIZE) - 1) = PAGE_SIZE - 2 * sizeof(unsigned);
-  *((int *) (page_data + PAGE_SIZE) - 2) = 0; // initial num_slots
+  *((unsigned *) (page_data + page_size) - 1) = page_size - 2 * sizeof(unsigned);
+  *((unsigned *) (page_data + page_size) - 2) = WIDE_PAGE_FLAG; // initial num_slots, new pages are always wide
+  if (layout == LAYOUT_PAX) {
+    // no rows yet, so no minipages
+    memset(page_data, 0, sizeof(PaxHeader));
+    *((unsigned *) (page_data + page_size) - 1) =
+        (page_size - 2 * sizeof(unsigned) - sizeof(PaxHeader)) | PAX_PAGE_FLAG;
+  }
 }
 
 RC Page::shiftAfterRecords(size_t record_begin_offset, size_t shift_size, bool forward) {
@@ -744,17 +1544,19 @@ RC Page::shiftAfterRecords(size_t record_begin_offset, size_t shift_size, bool f
   // since records are continuous, we only need to find the start and size of the chunk
 
   // get the START of the chunk of records to be moved
-  size_t chunk_start = PAGE_SIZE;
-  for (auto &offset: records_offset) {
+  size_t chunk_start = page_size_;
+  for (SID sid = 0; sid < num_slots_; ++sid) {
+    auto offset = getSlot(sid);
     if (offset.first != pid && offset.first != REDIRECT_PID) continue;  // redirected to another slot: no need to shift
     if (offset.second <= record_begin_offset || offset.second == INVALID_OFFSET)
       continue;  // locates before it or deleted
     chunk_start = std::min(chunk_start, size_t(offset.second));
     if (forward) offset.second += shift_size;
     else offset.second -= shift_size;
+    setSlot(sid, offset);
   }
   bool need_shift = true;
-  if (chunk_start == PAGE_SIZE) {
+  if (chunk_start == page_size_) {
     // no following records
     need_shift = false;
     DB_DEBUG << "no following records, no need to shift data chunk";
@@ -765,6 +1567,7 @@ RC Page::shiftAfterRecords(size_t record_begin_offset, size_t shift_size, bool f
     if (need_shift) {
       memmove(data + chunk_start + shift_size, data + chunk_start, chunk_size);
       memset(data + chunk_start, 0, shift_size);
+      markDirty(chunk_start, chunk_start + shift_size + chunk_size);
       DB_DEBUG << "Page " << pid << " move data chunk start from " << chunk_start << "(size " << chunk_size
                << ") forward " << shift_size << " bytes";
     }
@@ -776,6 +1579,7 @@ RC Page::shiftAfterRecords(size_t record_begin_offset, size_t shift_size, bool f
         memset(data + chunk_start - shift_size + chunk_size,
                0,
                shift_size); // in case there could be some non-zeros after shifting backward
+      markDirty(chunk_start - shift_size, chunk_start + chunk_size);
 
       DB_DEBUG << "Page " << pid << " move data chunk start from " << chunk_start << "(size " << chunk_size
                << ") back " << shift_size << " bytes";
@@ -801,8 +1605,10 @@ size_t Page::getRecordSize(const char *begin) {
 
 void Page::checkDataend() {
   size_t last_record_begin = 0;
-  for (auto &record:records_offset) {
-    if (record.second != INVALID_OFFSET)
+  for (SID sid = 0; sid < num_slots_; ++sid) {
+    auto record = getSlot(sid);
+    // offset of a forwarded slot is a slot in another page
+    if (record.second != INVALID_OFFSET && (record.first == pid || record.first == REDIRECT_PID))
       last_record_begin = std::max(last_record_begin, std::size_t(record.second));
   }
 
@@ -813,18 +1619,858 @@ void Page::checkDataend() {
 
 }
 
+/**************************************
+ *
+ * ========= HeapBuilder ==========
+ *
+ *************************************/
+
+HeapBuilder::HeapBuilder() : file_handle_(nullptr), buffer_(nullptr), page_(INVALID_PID) {}
+
+HeapBuilder::~HeapBuilder() {
+  close();
+}
+
+RC HeapBuilder::init(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor) {
+  close();
+  if (fileHandle.isMapped()) {
+    DB_WARNING << "can not insert record into read-only file " << fileHandle.name;
+    return -1;
+  }
+  file_handle_ = &fileHandle;
+  record_descriptor_ = recordDescriptor;
+  codec_.compile({recordDescriptor});
+  ranges_.clear();
+  buffer_ = PageIO::allocAligned(fileHandle.getPageSize());
+  startPage();
+  return 0;
+}
+
+RC HeapBuilder::append(const void *data, RID &rid) {
+  if (!buffer_) {
+    DB_ERROR << "heap builder not init!";
+    return -1;
+  }
+  if (codec_.encode(data, 0, record_)) return -1;  // varchar longer than upper limit
+  size_t total_size = record_.size();
+  size_t max_size = Page::maxRecordSize(file_handle_->getPageSize(),
+                                        file_handle_->getLayout(),
+                                        record_descriptor_.size());
+  if (total_size > max_size) {
+    DB_ERROR << "data size " << total_size << " larger than max record size " << max_size;
+    return -1;
+  }
+  if (page_.numSlots() && !RecordBasedFileManager::hasSpace(page_, record_.data(), total_size)) {
+    if (appendPage()) return -1;
+    startPage();
+  }
+  // the page is appended later, its entries cover more than what's on disk meanwhile, which is harmless
+  for (auto summary : RecordBasedFileManager::summariesOf(*file_handle_)) {
+    if (summary->add(page_.pid, record_descriptor_, data)) return -1;
+  }
+  rid = page_.insertData(record_.data(), total_size);
+  return 0;
+}
+
+RC HeapBuilder::close() {
+  if (!buffer_) return 0;
+  RC ret = page_.numSlots() ? appendPage() : 0;
+  page_.data = nullptr;
+  PageIO::freeAligned(buffer_);
+  buffer_ = nullptr;
+  file_handle_ = nullptr;
+  return ret;
+}
+
+void HeapBuilder::startPage() {
+  Page::initPage(buffer_, file_handle_->getPageSize(), file_handle_->getLayout());
+  page_.pid = file_handle_->getNumberOfPages();
+  page_.attach(buffer_, file_handle_->getPageSize());
+}
+
+RC HeapBuilder::appendPage() {
+  if (page_.pid >= Page::maxPageNum()) {
+    DB_ERROR << "Exceed max page num " << Page::maxPageNum();
+    return -1;
+  }
+  page_.dumpMeta();
+  if (file_handle_->appendPage(buffer_)) return -1;
+  // appendPage takes it as an empty page
+  file_handle_->fsm_.update(page_.pid, page_.free_space);
+  ranges_.push_back({page_.pid, page_.numSlots()});
+  return 0;
+}
+
+/**************************************
+ *
+ * ========= RecordCodec ==========
+ *
+ *************************************/
+
+RecordCodec::RecordCodec()
+    : encode_indicator_bytes_(0),
+      decode_indicator_bytes_(0),
+      max_decoded_size_(0),
+      has_condition_(false),
+      has_disjuncts_(false) {}
+
+RC RecordCodec::compile(const std::vector<std::vector<Attribute>> &schemas,
+                        const std::vector<std::string> &projected_fields,
+                        const ScanCondition &condition) {
+  versions_.clear();
+  fields_.clear();
+  const std::vector<Attribute> &cur_schema = schemas.back();
+  for (auto &attr : cur_schema) fields_.emplace_back(attr.type, attr.length);
+  encode_indicator_bytes_ = RecordBasedFileManager::nullIndicatorLength(cur_schema);
+
+  std::vector<std::string> names = projected_fields;
+  if (names.empty()) {
+    for (auto &attr : cur_schema) names.push_back(attr.name);
+  }
+  decode_indicator_bytes_ = (names.size() + 7) / 8;
+  max_decoded_size_ = decode_indicator_bytes_;
+  // NO_OP holds for every record, a NO_OP disjunct makes the whole OR group hold
+  std::vector<Predicate> conjuncts, disjuncts;
+  for (auto &predicate : condition.conjuncts) {
+    if (predicate.op != NO_OP) conjuncts.push_back(predicate);
+  }
+  bool any_disjunct = false;
+  for (auto &predicate : condition.disjuncts) {
+    if (predicate.op == NO_OP) any_disjunct = true;
+    else disjuncts.push_back(predicate);
+  }
+  if (any_disjunct) disjuncts.clear();
+  has_disjuncts_ = !disjuncts.empty();
+  has_condition_ = !conjuncts.empty() || has_disjuncts_;
+  for (auto &schema : schemas) {
+    auto find = [&](const std::string &name) {
+      auto it = std::find_if(schema.begin(), schema.end(), [&](const Attribute &attr) { return attr.name == name; });
+      return it == schema.end() ? -1 : int(it - schema.begin());
+    };
+    Version version;
+    version.num_fields = schema.size();
+    version.header_size = RecordBasedFileManager::entryDirectoryOverheadLength(schema.size());
+    for (auto &name : names) version.projection.push_back(find(name));
+    // a field of an older version may have been longer than the one of the same name now
+    size_t decoded_size = decode_indicator_bytes_;
+    for (int field : version.projection) {
+      if (field < 0) continue;
+      decoded_size += schema[field].length + (schema[field].type == TypeVarChar ? sizeof(int) : 0);
+    }
+    max_decoded_size_ = std::max(max_decoded_size_, decoded_size);
+    // a predicate on a field this version doesn't have is dropped, it never holds
+    auto resolve = [&](const std::vector<Predicate> &predicates, std::vector<Test> &tests) -> RC {
+      for (auto &predicate : predicates) {
+        int field = find(predicate.attribute);
+        if (field < 0) continue;
+        Comparator compare = RecordBasedFileManager::getComparator(schema[field].type, predicate.op);
+        if (!compare) {
+          DB_ERROR << "can not compare `" << predicate.attribute << "` with CompOp " << predicate.op;
+          return -1;
+        }
+        tests.push_back({field, compare, predicate.value});
+      }
+      return 0;
+    };
+    if (resolve(conjuncts, version.conjuncts) || resolve(disjuncts, version.disjuncts)) return -1;
+    version.satisfiable =
+        version.conjuncts.size() == conjuncts.size() && (!has_disjuncts_ || !version.disjuncts.empty());
+    versions_.push_back(std::move(version));
+  }
+  for (size_t i = 0; i < names.size(); ++i) {
+    if (versions_.back().projection[i] < 0) {
+      DB_ERROR << "projected field `" << names[i] << "`" << "not found";
+      return -1;
+    }
+  }
+  return 0;
+}
+
+RC RecordCodec::encode(const void *data, directory_t ver, std::vector<char> &out) const {
+  // [field_num, version, end of each field (-1 for NULL)...][data...], data is the input without its null indicator
+  auto indicator = static_cast<const unsigned char *>(data);
+  const char *real_data = static_cast<const char *>(data) + encode_indicator_bytes_;
+  size_t fields_num = fields_.size();
+  size_t header_size = RecordBasedFileManager::entryDirectoryOverheadLength(fields_num);
+  out.resize(header_size);
+  auto directories = reinterpret_cast<directory_t *>(out.data());
+  directories[0] = directory_t(fields_num);
+  directories[1] = ver;
+  size_t offset = header_size;
+  for (size_t i = 0; i < fields_num; ++i) {
+    if (indicator[i / 8] & (1 << (7 - i % 8))) {
+      directories[i + 2] = -1;
+      continue;
+    }
+    if (fields_[i].first == TypeVarChar) {
+      // we also store the int which indicate varchar len
+      int char_len;
+      memcpy(&char_len, real_data + offset - header_size, sizeof(int));
+      // compared unsigned, so that a negative length is rejected as well
+      if (unsigned(char_len) > fields_[i].second) return -1;
+      offset += sizeof(int) + char_len;
+    } else {
+      offset += fields_[i].second;
+    }
+    directories[i + 2] = directory_t(offset);
+  }
+  out.resize(offset);
+  memcpy(out.data() + header_size, real_data, offset - header_size);
+  return 0;
+}
+
+/**
+ * fields are stored back to back, a field begins where the last non-NULL field before it ends
+ */
+static inline directory_t fieldBegin(const directory_t *ends, int field, directory_t header_size) {
+  while (field-- > 0) {
+    if (ends[field] != -1) return ends[field];
+  }
+  return header_size;
+}
+
+inline bool RecordCodec::holds(const Test &test,
+                               const char *src,
+                               const directory_t *ends,
+                               directory_t header_size) const {
+  // compare NULL always false
+  if (ends[test.field] == -1) return false;
+  return test.compare(src + fieldBegin(ends, test.field, header_size), test.value);
+}
+
+template<typename Holds>
+RC RecordCodec::check(directory_t ver, directory_t num_fields, Holds holds) const {
+  if (!hasVersion(ver) || num_fields != versions_[ver].num_fields) {
+    DB_ERROR << "field num " << num_fields << " of record does not match schema version " << ver;
+    return -1;
+  }
+  if (!has_condition_) return 0;
+  const Version &version = versions_[ver];
+  if (!version.satisfiable) return RecordBasedFileManager::COND_NOT_SATISFIED;
+  // conjuncts first, the OR group is only tested on records they all pass
+  for (auto &test : version.conjuncts) {
+    if (!holds(test)) return RecordBasedFileManager::COND_NOT_SATISFIED;
+  }
+  if (!has_disjuncts_) return 0;
+  for (auto &test : version.disjuncts) {
+    if (holds(test)) return 0;
+  }
+  return RecordBasedFileManager::COND_NOT_SATISFIED;
+}
+
+RC RecordCodec::filter(const char *src) const {
+  auto dir_pt = reinterpret_cast<const directory_t *>(src);
+  const directory_t *ends = dir_pt + 2;
+  return check(dir_pt[1], dir_pt[0], [&](const Test &test) {
+    return holds(test, src, ends, versions_[dir_pt[1]].header_size);
+  });
+}
+
+RC RecordCodec::filter(const Page &page, PageOffset record_offset) const {
+  if (!page.pax_) return filter(page.data + record_offset);
+  return check(page.pax_version_, page.pax_fields_, [&](const Test &test) {
+    // compare NULL always false
+    unsigned size;
+    const char *value = page.paxField(test.field, record_offset, size);
+    return value && test.compare(value, test.value);
+  });
+}
+
+RC RecordCodec::decode(const char *src, void *out, size_t *length) const {
+  RC ret = filter(src);
+  if (ret) return ret;
+  auto dir_pt = reinterpret_cast<const directory_t *>(src);
+  const Version &version = versions_[dir_pt[1]];
+  const directory_t *ends = dir_pt + 2;
+
+  auto indicator = static_cast<unsigned char *>(out);
+  memset(indicator, 0, decode_indicator_bytes_);
+  char *out_pt = static_cast<char *>(out) + decode_indicator_bytes_;
+  for (size_t i = 0; i < version.projection.size(); ++i) {
+    int idx = version.projection[i];
+    // new field, old data, set null
+    if (idx < 0 || ends[idx] == -1) {
+      indicator[i / 8] |= 1 << (7 - i % 8);
+      continue;
+    }
+    directory_t begin = fieldBegin(ends, idx, version.header_size);
+    memcpy(out_pt, src + begin, ends[idx] - begin);
+    out_pt += ends[idx] - begin;
+  }
+  if (length) *length = out_pt - static_cast<char *>(out);
+  return 0;
+}
+
+RC RecordCodec::decode(const Page &page, PageOffset record_offset, void *out, size_t *length) const {
+  if (!page.pax_) return decode(page.data + record_offset, out, length);
+  RC ret = filter(page, record_offset);
+  if (ret) return ret;
+  const Version &version = versions_[page.pax_version_];
+
+  auto indicator = static_cast<unsigned char *>(out);
+  memset(indicator, 0, decode_indicator_bytes_);
+  char *out_pt = static_cast<char *>(out) + decode_indicator_bytes_;
+  for (size_t i = 0; i < version.projection.size(); ++i) {
+    int idx = version.projection[i];
+    unsigned size = 0;
+    const char *value = idx < 0 ? nullptr : page.paxField(idx, record_offset, size);
+    // new field, old data, set null
+    if (!value) {
+      indicator[i / 8] |= 1 << (7 - i % 8);
+      continue;
+    }
+    memcpy(out_pt, value, size);
+    out_pt += size;
+  }
+  if (length) *length = out_pt - static_cast<char *>(out);
+  return 0;
+}
+
+/**************************************
+ *
+ * ========= PageSummary ==========
+ *
+ *************************************/
+
+PageSummary::PageSummary(const std::string &suffix) : suffix_(suffix), entry_size_(0), entries_per_page_(0) {}
+
+RC PageSummary::create(FileHandle &fileHandle,
+                       const std::vector<std::vector<Attribute>> &schemas,
+                       const std::vector<std::string> &columns) {
+  const std::vector<Attribute> &cur_schema = schemas.back();
+  std::vector<Attribute> attrs;
+  for (auto &name : columns) {
+    auto it = std::find_if(cur_schema.begin(), cur_schema.end(), [&](const Attribute &attr) {
+      return attr.name == name;
+    });
+    if (it == cur_schema.end() || !accepts(*it)) {
+      DB_ERROR << "column `" << name << "` can not be summarized in " << suffix_;
+      return -1;
+    }
+    attrs.push_back(*it);
+  }
+  /*
+   * layout of first page: [num_columns, (type, name length, name)...]
+   */
+  size_t page_size = fileHandle.getPageSize();
+  entry_size_ = entrySize(page_size);
+  size_t header_size = sizeof(uint32_t);
+  for (auto &attr : attrs) header_size += 2 * sizeof(uint32_t) + attr.name.size();
+  if (attrs.empty() || header_size > page_size || attrs.size() * entry_size_ > page_size) {
+    DB_ERROR << "invalid " << suffix_ << " columns for " << fileHandle.name;
+    return -1;
+  }
+
+  // entries of every page are built in memory, then written once
+  size_t bytes_per_pid = attrs.size() * entry_size_;
+  unsigned entries_per_page = page_size / bytes_per_pid;
+  PID num_pages = fileHandle.getNumberOfPages();
+  std::vector<char> entries(size_t(num_pages) * bytes_per_pid, 0);
+  RBFM_ScanIterator it;
+  if (it.init(fileHandle, &RecordBasedFileManager::instance(), schemas, ScanCondition(), columns)) return -1;
+  std::vector<char> data(page_size);
+  RecordView view;
+  RID rid;
+  while (it.getNextRecord(rid, data.data()) != RBFM_EOF) {
+    view.bind(attrs, data.data());
+    for (size_t i = 0; i < attrs.size(); ++i) {
+      if (view.isNull(i)) continue;
+      fold(&entries[rid.pageNum * bytes_per_pid + i * entry_size_], attrs[i], attrs[i].type, view.field(i));
+    }
+  }
+  it.close();
+
+  std::string summary_file = fileHandle.name + suffix_;
+  auto &pfm = PagedFileManager::instance();
+  if (pfm.createFile(summary_file, page_size)) return -1;
+  FileHandle handle;
+  if (pfm.openFile(summary_file, handle)) return -1;
+  char *page = PageIO::allocAligned(page_size);
+  memset(page, 0, page_size);
+  RC ret = handle.appendPage(page);
+  size_t bytes_per_page = size_t(entries_per_page) * bytes_per_pid;
+  for (size_t begin = 0; ret == 0 && begin < entries.size(); begin += bytes_per_page) {
+    memset(page, 0, page_size);
+    memcpy(page, entries.data() + begin, std::min(bytes_per_page, entries.size() - begin));
+    ret = handle.appendPage(page);
+  }
+  PageIO::freeAligned(page);
+  if (ret) return ret;
+
+  // the side file is valid once its columns are written
+  LogScope log_scope;
+  char *header = BufferPool::instance().pin(handle, 0);
+  if (!header) return -1;
+  char *pt = header;
+  *reinterpret_cast<uint32_t *>(pt) = attrs.size();
+  pt += sizeof(uint32_t);
+  for (auto &attr : attrs) {
+    reinterpret_cast<uint32_t *>(pt)[0] = attr.type;
+    reinterpret_cast<uint32_t *>(pt)[1] = attr.name.size();
+    pt += 2 * sizeof(uint32_t);
+    memcpy(pt, attr.name.data(), attr.name.size());
+    pt += attr.name.size();
+  }
+  handle.logPage(0, header, {{0, header_size}});
+  BufferPool::instance().unpin(handle, 0, true);
+  return 0;
+}
+
+RC PageSummary::open(const std::string &fileName, OpenMode mode) {
+  columns_.clear();
+  if (handle_.openFile(fileName + suffix_, mode)) return -1;
+  if (handle_.getNumberOfPages() == 0) return 0;
+  const char *header = handle_.isMapped() ? handle_.mappedPage(0) : BufferPool::instance().pin(handle_, 0);
+  if (!header) return -1;
+  const char *pt = header;
+  uint32_t num_columns = *reinterpret_cast<const uint32_t *>(pt);
+  pt += sizeof(uint32_t);
+  for (uint32_t i = 0; i < num_columns; ++i) {
+    Attribute attr;
+    attr.type = AttrType(reinterpret_cast<const uint32_t *>(pt)[0]);
+    uint32_t name_len = reinterpret_cast<const uint32_t *>(pt)[1];
+    pt += 2 * sizeof(uint32_t);
+    attr.name.assign(pt, name_len);
+    attr.length = sizeof(int);
+    pt += name_len;
+    columns_.push_back(attr);
+  }
+  if (!handle_.isMapped()) BufferPool::instance().unpin(handle_, 0, false);
+  entry_size_ = entrySize(handle_.getPageSize());
+  if (!columns_.empty()) entries_per_page_ = handle_.getPageSize() / (columns_.size() * entry_size_);
+  return 0;
+}
+
+RC PageSummary::add(PID pid, const std::vector<Attribute> &recordDescriptor, const void *data) {
+  RecordView view;
+  view.bind(recordDescriptor, data);
+  LogScope log_scope;
+  char *entries = pin(pid, true);
+  if (!entries) return -1;
+  bool dirty = false;
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    auto it = std::find_if(recordDescriptor.begin(), recordDescriptor.end(), [&](const Attribute &attr) {
+      return attr.name == columns_[i].name;
+    });
+    // a missing field is NULL, which satisfies no predicate
+    if (it == recordDescriptor.end() || view.isNull(it - recordDescriptor.begin())) continue;
+    dirty |= fold(entries + i * entry_size_, columns_[i], it->type, view.field(it - recordDescriptor.begin()));
+  }
+  unpin(pid, entries, dirty);
+  return 0;
+}
+
+RC PageSummary::merge(PID to, PID from) {
+  LogScope log_scope;
+  char *src = pin(from, false);
+  if (!src) return 0;
+  std::vector<char> moved(src, src + columns_.size() * entry_size_);
+  unpin(from, src, false);
+  char *entries = pin(to, true);
+  if (!entries) return -1;
+  bool dirty = false;
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    dirty |= mergeEntry(entries + i * entry_size_, moved.data() + i * entry_size_, columns_[i]);
+  }
+  unpin(to, entries, dirty);
+  return 0;
+}
+
+RC PageSummary::reset(PID pid) {
+  LogScope log_scope;
+  char *entries = pin(pid, false);
+  if (!entries) return 0;
+  size_t size = columns_.size() * entry_size_;
+  bool dirty = std::any_of(entries, entries + size, [](char byte) { return byte != 0; });
+  if (dirty) memset(entries, 0, size);
+  unpin(pid, entries, dirty);
+  return 0;
+}
+
+RC PageSummary::truncate(PID num_pages) {
+  // pages appended to the heap later start from empty entries
+  PID end = (handle_.getNumberOfPages() - 1) * entries_per_page_;
+  for (PID pid = num_pages; pid < end; ++pid) {
+    if (reset(pid)) return -1;
+  }
+  return 0;
+}
+
+char *PageSummary::pin(PID pid, bool create) {
+  PageNum page_num = 1 + pid / entries_per_page_;
+  if (page_num >= handle_.getNumberOfPages()) {
+    if (!create) return nullptr;
+    if (handle_.isMapped()) return nullptr;
+    std::lock_guard<std::mutex> lock(append_mutex_);
+    size_t page_size = handle_.getPageSize();
+    char *page = PageIO::allocAligned(page_size);
+    memset(page, 0, page_size);
+    RC ret = 0;
+    while (ret == 0 && handle_.getNumberOfPages() <= page_num) ret = handle_.appendPage(page);
+    PageIO::freeAligned(page);
+    if (ret) return nullptr;
+  }
+  char *page = handle_.isMapped() ? const_cast<char *>(handle_.mappedPage(page_num))
+                                  : BufferPool::instance().pin(handle_, page_num);
+  if (!page) return nullptr;
+  return page + size_t(pid % entries_per_page_) * columns_.size() * entry_size_;
+}
+
+void PageSummary::unpin(PID pid, char *entries, bool dirty) {
+  if (handle_.isMapped()) return;
+  PageNum page_num = 1 + pid / entries_per_page_;
+  size_t begin = size_t(pid % entries_per_page_) * columns_.size() * entry_size_;
+  char *page = entries - begin;
+  if (dirty) handle_.logPage(page_num, page, {{begin, begin + columns_.size() * entry_size_}});
+  BufferPool::instance().unpin(handle_, page_num, dirty);
+}
+
+template<typename Test, typename Make>
+void PageSummary::resolve(const ScanCondition &condition, Filter<Test> &filter, Make make) {
+  filter.conjuncts.clear();
+  filter.disjuncts.clear();
+  Test test;
+  for (auto &predicate : condition.conjuncts) {
+    if (make(predicate, test)) filter.conjuncts.push_back(test);
+  }
+  // the OR group only rules out a page if every disjunct does
+  for (auto &predicate : condition.disjuncts) {
+    if (!make(predicate, test)) {
+      filter.disjuncts.clear();
+      break;
+    }
+    filter.disjuncts.push_back(test);
+  }
+}
+
+template<typename Test, typename Check>
+bool PageSummary::mayMatch(PID pid, const Filter<Test> &filter, Check check) {
+  char *entries = pin(pid, false);
+  // entries can not be read, e.g. the side page was appended after a mapped handle was opened, so nothing is ruled out
+  if (!entries) return true;
+  bool match = std::all_of(filter.conjuncts.begin(), filter.conjuncts.end(), [&](const Test &test) {
+    return check(test, entries + test.column * entry_size_);
+  });
+  if (match && !filter.disjuncts.empty()) {
+    match = std::any_of(filter.disjuncts.begin(), filter.disjuncts.end(), [&](const Test &test) {
+      return check(test, entries + test.column * entry_size_);
+    });
+  }
+  unpin(pid, entries, false);
+  return match;
+}
+
+int PageSummary::findColumn(const std::vector<Attribute> &schema, const std::string &name) const {
+  auto column = std::find_if(columns_.begin(), columns_.end(), [&](const Attribute &attr) {
+    return attr.name == name;
+  });
+  auto attr = std::find_if(schema.begin(), schema.end(), [&](const Attribute &attr) {
+    return attr.name == name;
+  });
+  if (column == columns_.end() || attr == schema.end() || attr->type != column->type) return -1;
+  return column - columns_.begin();
+}
+
+/**************************************
+ *
+ * ========= ZoneMap ==========
+ *
+ *************************************/
+
+const std::string ZoneMap::SUFFIX = ".zone";
+const uint32_t ZoneMap::HAS_VALUE = 1;
+const uint32_t ZoneMap::UNBOUNDED = 2;
+
+ZoneMap::ZoneMap() : PageSummary(SUFFIX) {}
+
+void ZoneMap::resolve(const std::vector<Attribute> &schema, const ScanCondition &condition, Filter &filter) const {
+  PageSummary::resolve(condition, filter, [&](const Predicate &predicate, Test &test) {
+    int column = findColumn(schema, predicate.attribute);
+    if (column < 0) return false;
+    AttrType type = columns()[column].type;
+    test.column = column;
+    test.value = predicate.value;
+    test.negate = false;
+    test.lower = test.upper = nullptr;
+    // a page may hold a match if [min, max] overlaps with the values satisfying the predicate
+    switch (predicate.op) {
+      case EQ_OP:
+        test.lower = RecordBasedFileManager::getComparator(type, LE_OP);
+        test.upper = RecordBasedFileManager::getComparator(type, GE_OP);
+        break;
+      case LT_OP:
+      case LE_OP:
+        test.lower = RecordBasedFileManager::getComparator(type, predicate.op);
+        break;
+      case GT_OP:
+      case GE_OP:
+        test.upper = RecordBasedFileManager::getComparator(type, predicate.op);
+        break;
+      case NE_OP:
+        test.lower = test.upper = RecordBasedFileManager::getComparator(type, EQ_OP);
+        test.negate = true;
+        break;
+      default:
+        return false;
+    }
+    return true;
+  });
+}
+
+bool ZoneMap::mayMatch(PID pid, const Filter &filter) {
+  return PageSummary::mayMatch(pid, filter, [](const Test &test, const char *entry) {
+    return ZoneMap::test(test, *reinterpret_cast<const Entry *>(entry));
+  });
+}
+
+bool ZoneMap::accepts(const Attribute &column) const {
+  return column.type != TypeVarChar;
+}
+
+size_t ZoneMap::entrySize(size_t) const {
+  return sizeof(Entry);
+}
+
+bool ZoneMap::fold(char *entry_data, const Attribute &column, AttrType type, const char *value) const {
+  Entry &entry = *reinterpret_cast<Entry *>(entry_data);
+  if (entry.flags & UNBOUNDED) return false;
+  if (type != column.type) {
+    entry.flags |= UNBOUNDED;
+    return true;
+  }
+  if (!(entry.flags & HAS_VALUE)) {
+    memcpy(entry.min, value, sizeof(entry.min));
+    memcpy(entry.max, value, sizeof(entry.max));
+    entry.flags |= HAS_VALUE;
+    return true;
+  }
+  Comparator less = RecordBasedFileManager::getComparator(column.type, LT_OP);
+  bool modified = false;
+  if (less(value, entry.min)) {
+    memcpy(entry.min, value, sizeof(entry.min));
+    modified = true;
+  }
+  if (less(entry.max, value)) {
+    memcpy(entry.max, value, sizeof(entry.max));
+    modified = true;
+  }
+  return modified;
+}
+
+bool ZoneMap::mergeEntry(char *entry_data, const char *from, const Attribute &column) const {
+  Entry &entry = *reinterpret_cast<Entry *>(entry_data);
+  const Entry &moved = *reinterpret_cast<const Entry *>(from);
+  if (moved.flags & UNBOUNDED) {
+    bool modified = !(entry.flags & UNBOUNDED);
+    entry.flags |= UNBOUNDED;
+    return modified;
+  }
+  if (!(moved.flags & HAS_VALUE)) return false;
+  bool modified = fold(entry_data, column, column.type, moved.min);
+  modified |= fold(entry_data, column, column.type, moved.max);
+  return modified;
+}
+
+bool ZoneMap::test(const Test &test, const Entry &entry) {
+  if (entry.flags & UNBOUNDED) return true;
+  // no record of page has a non-NULL value
+  if (!(entry.flags & HAS_VALUE)) return false;
+  if (test.negate) return !(test.lower(entry.min, test.value) && test.upper(entry.max, test.value));
+  return (!test.lower || test.lower(entry.min, test.value)) && (!test.upper || test.upper(entry.max, test.value));
+}
+
+/**************************************
+ *
+ * ========= BloomFilter ==========
+ *
+ *************************************/
+
+const std::string BloomFilter::SUFFIX = ".bloom";
+const unsigned BloomFilter::NUM_HASHES = 3;
+const unsigned BloomFilter::BYTES_PER_PAGE = 32;
+
+BloomFilter::BloomFilter() : PageSummary(SUFFIX) {}
+
+void BloomFilter::resolve(const std::vector<Attribute> &schema, const ScanCondition &condition, Filter &filter) const {
+  PageSummary::resolve(condition, filter, [&](const Predicate &predicate, Test &test) {
+    int column = findColumn(schema, predicate.attribute);
+    if (column < 0 || predicate.op != EQ_OP) return false;
+    uint64_t h = hash(columns()[column].type, static_cast<const char *>(predicate.value));
+    test.column = column;
+    test.bits.clear();
+    for (unsigned i = 0; i < NUM_HASHES; ++i) test.bits.push_back(bit(h, i));
+    return true;
+  });
+}
+
+bool BloomFilter::mayMatch(PID pid, const Filter &filter) {
+  return PageSummary::mayMatch(pid, filter, [](const Test &test, const char *entry) {
+    return std::all_of(test.bits.begin(), test.bits.end(), [&](uint32_t bit) {
+      return entry[bit / 8] & (1 << (bit % 8));
+    });
+  });
+}
+
+bool BloomFilter::accepts(const Attribute &) const {
+  return true;
+}
+
+size_t BloomFilter::entrySize(size_t page_size) const {
+  return page_size / BYTES_PER_PAGE;
+}
+
+bool BloomFilter::fold(char *entry, const Attribute &column, AttrType type, const char *value) const {
+  // a value of another type stored under the column name could equal anything, nothing is skipped
+  if (type != column.type) {
+    bool modified = std::any_of(entry, entry + entry_size_, [](char byte) { return byte != char(0xff); });
+    memset(entry, 0xff, entry_size_);
+    return modified;
+  }
+  uint64_t h = hash(type, value);
+  bool modified = false;
+  for (unsigned i = 0; i < NUM_HASHES; ++i) {
+    uint32_t b = bit(h, i);
+    modified |= !(entry[b / 8] & (1 << (b % 8)));
+    entry[b / 8] |= char(1 << (b % 8));
+  }
+  return modified;
+}
+
+bool BloomFilter::mergeEntry(char *entry, const char *from, const Attribute &) const {
+  bool modified = false;
+  for (size_t i = 0; i < entry_size_; ++i) {
+    modified |= (entry[i] | from[i]) != entry[i];
+    entry[i] |= from[i];
+  }
+  return modified;
+}
+
+uint64_t BloomFilter::hash(AttrType type, const char *value) {
+  size_t size = sizeof(int);
+  float real;
+  if (type == TypeVarChar) {
+    size += *reinterpret_cast<const uint32_t *>(value);
+  } else if (type == TypeReal) {
+    // -0.0 equals 0.0
+    memcpy(&real, value, sizeof(real));
+    if (real == 0) {
+      real = 0;
+      value = reinterpret_cast<const char *>(&real);
+    }
+  }
+  // FNV-1a, then the bits are mixed so that both halves depend on every byte
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    h ^= static_cast<unsigned char>(value[i]);
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/**************************************
+ *
+ * ========= RecordView ==========
+ *
+ *************************************/
+
+directory_t RecordView::parse(const char *record) {
+  return locateFields(record, record_fields_);
+}
+
+directory_t RecordView::parse(const Page &page, PageOffset record_offset) {
+  if (!page.pax_) return parse(page.data + record_offset);
+  // values of minipages are in the same format as fields of an encoded record
+  record_fields_.clear();
+  for (directory_t field = 0; field < page.pax_fields_; ++field) {
+    unsigned size;
+    const char *value = page.paxField(field, record_offset, size);
+    record_fields_.emplace_back(value, size);
+  }
+  return page.pax_version_;
+}
+
+void RecordView::project(const std::vector<int> &projection) {
+  fields_.clear();
+  for (int idx : projection) {
+    if (idx < 0) fields_.emplace_back(nullptr, 0); // new field, old data, set null
+    else fields_.push_back(record_fields_[idx]);
+  }
+}
+
+void RecordView::bind(const std::vector<Attribute> &attrs, const void *data) {
+  page_.reset();
+  fields_.clear();
+  auto *indicator = static_cast<const unsigned char *>(data);
+  const char *pt = static_cast<const char *>(data) + RecordBasedFileManager::nullIndicatorLength(attrs);
+  for (size_t i = 0; i < attrs.size(); ++i) {
+    if (indicator[i / 8] & (1 << (7 - i % 8))) {
+      fields_.emplace_back(nullptr, 0);
+      continue;
+    }
+    unsigned size = attrs[i].type == TypeVarChar ? sizeof(int) + *reinterpret_cast<const int *>(pt) : attrs[i].length;
+    fields_.emplace_back(pt, size);
+    pt += size;
+  }
+}
+
+void RecordView::release() {
+  page_.reset();
+  fields_.clear();
+}
+
+size_t RecordView::length() const {
+  size_t length = (fields_.size() + 7) / 8;
+  for (auto &field : fields_) length += field.second;
+  return length;
+}
+
+void RecordView::copyTo(void *data) const {
+  auto *indicator = static_cast<unsigned char *>(data);
+  size_t indicator_bytes_num = (fields_.size() + 7) / 8;
+  memset(indicator, 0, indicator_bytes_num);
+  char *out_pt = static_cast<char *>(data) + indicator_bytes_num;
+  for (size_t i = 0; i < fields_.size(); ++i) {
+    if (!fields_[i].first) {
+      indicator[i / 8] |= 1 << (7 - i % 8);
+      continue;
+    }
+    memcpy(out_pt, fields_[i].first, fields_[i].second);
+    out_pt += fields_[i].second;
+  }
+}
+
 /**************************************
  *
  * ========= RBFM_ScanIterator ==========
  *
  *************************************/
 
+const unsigned RBFM_ScanIterator::DEFAULT_READ_AHEAD_DEPTH = 8;
+unsigned RBFM_ScanIterator::read_ahead_depth_ = RBFM_ScanIterator::DEFAULT_READ_AHEAD_DEPTH;
+unsigned RBFM_ScanIterator::scan_ring_size_ = ScanRing::DEFAULT_SIZE;
+
 RBFM_ScanIterator::RBFM_ScanIterator() : pid_(INVALID_PID), init_(false), page_(nullptr) {}
 
+void RBFM_ScanIterator::setReadAheadDepth(unsigned depth) {
+  read_ahead_depth_ = depth;
+}
+
+void RBFM_ScanIterator::setScanRingSize(unsigned size) {
+  scan_ring_size_ = size;
+}
+
 RC RBFM_ScanIterator::close() {
   init_ = false;
-  if (page_) page_->freeMem();
+  // a RecordView may still pin it, it's unpinned with the last reference
   page_.reset();
+  redirect_.reset();
+  read_ahead_.reset();
+  ring_.reset();
+  zone_map_.reset();
+  bloom_filter_.reset();
   pid_ = INVALID_PID; // use pid_ == INVALID_PID to marked closed or EOF
   return 0;
 }
@@ -832,90 +2478,155 @@ RC RBFM_ScanIterator::close() {
 RC RBFM_ScanIterator::init(FileHandle &fileHandle,
                            RecordBasedFileManager *rbfm,
                            const std::vector<std::vector<Attribute>> &schemas,
-                           const std::string &conditionAttribute,
-                           CompOp compOp,
-                           const void *value,
+                           const ScanCondition &condition,
                            const std::vector<std::string> &attributeNames) {
   init_ = true;
   rbfm_ = rbfm;
   file_handle_ = &fileHandle;
+  // kernel read-ahead over the mapping instead of a buffer copy per page
+  file_handle_->adviseSequential();
+  // mapped file relies on kernel read-ahead instead
+  read_ahead_.reset();
+  if (read_ahead_depth_ && !fileHandle.isMapped())
+    read_ahead_.reset(new ReadAhead(fileHandle, read_ahead_depth_));
+  // pages of a large file would push everything else out of the pool, recycle a few frames instead
+  ring_.reset();
+  if (scan_ring_size_ && !fileHandle.isMapped() &&
+      fileHandle.getNumberOfPages() > BufferPool::instance().getCapacity() / 4)
+    ring_.reset(new ScanRing(scan_ring_size_));
   pid_ = 0;
   sid_ = 0;
-  schemas_ = schemas;
-  projected_fields_ = attributeNames;
-  cond_field_ = conditionAttribute;
-  comp_op_ = compOp;
-  value_ = value;
+  zone_map_.reset();
+  if (fileHandle.zone_map_) {
+    fileHandle.zone_map_->resolve(schemas.back(), condition, zone_filter_);
+    if (!zone_filter_.empty()) zone_map_ = fileHandle.zone_map_;
+  }
+  bloom_filter_.reset();
+  if (fileHandle.bloom_filter_) {
+    fileHandle.bloom_filter_->resolve(schemas.back(), condition, bloom_tests_);
+    if (!bloom_tests_.empty()) bloom_filter_ = fileHandle.bloom_filter_;
+  }
+  // pages the scan is going to skip are not fetched either
+  if ((zone_map_ || bloom_filter_) && read_ahead_) {
+    read_ahead_->setFilter([this](PageNum page_num) { return mayMatch(page_num); });
+  }
+  // fields are matched by name and the comparisons are resolved once here instead of for every record
+  return codec_.compile(schemas, attributeNames, condition);
+}
 
-  return 0;
+bool RBFM_ScanIterator::mayMatch(PID pid) {
+  return (!zone_map_ || zone_map_->mayMatch(pid, zone_filter_)) &&
+         (!bloom_filter_ || bloom_filter_->mayMatch(pid, bloom_tests_));
 }
 
-RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data) {
+RC RBFM_ScanIterator::nextRecord(RID &rid, Page *&page, PageOffset &offset, bool within_page) {
   if (!init_) {
     DB_ERROR << "iterator not init!";
     return RBFM_EOF;
   }
+  // unpinned unless a RecordView still holds it
+  redirect_.reset();
   while (pid_ != INVALID_PID) {
-    if (pid_ == 0 && sid_ == 0 && !page_) {
-      if (file_handle_->pages_.empty()) {
+    if (!page_ || sid_ + 1 >= page_->numSlots()) {
+      if (within_page) return RBFM_EOF;
+      // load next page, or the first one
+      if (page_) {
+        page_.reset();
+        ++pid_;
+      }
+      // a page whose zone map or Bloom filter entry rules out the condition is never loaded
+      while (pid_ < file_handle_->getNumberOfPages() && !mayMatch(pid_)) ++pid_;
+      // EOF
+      if (pid_ >= file_handle_->getNumberOfPages()) {
         pid_ = INVALID_PID;
         return RBFM_EOF;
       }
-      page_ = file_handle_->pages_[pid_];
-      page_->load(*file_handle_);
-    } else {
-      if (sid_ == page_->records_offset.size() - 1) {
-        // load next page
-        do {
-          page_->freeMem();
-          page_.reset();
-          ++pid_;
-          // EOF
-          if (pid_ == file_handle_->pages_.size()) {
-            pid_ = INVALID_PID;
-            return RBFM_EOF;
-          }
-          page_ = file_handle_->pages_[pid_];
-          page_->load(*file_handle_);
-          sid_ = 0;
-        } while (page_->records_offset.empty());
-      } else ++sid_;
-    }
+      page_ = std::make_shared<Page>(pid_);
+      // fetch following pages while decoding this one
+      if (read_ahead_) read_ahead_->advance(pid_);
+      page_->load(*file_handle_, ring_.get());
+      sid_ = 0;
+      if (page_->numSlots() == 0) continue;
+    } else ++sid_;
     // read next record
 //    DB_DEBUG << "Iterator: reading <" << pid_ << "," << sid_ << ">";
-    auto offset = page_->records_offset[sid_];
+    auto slot = page_->getSlot(sid_);
 
-    std::shared_ptr<Page> actual_page = page_;
+    page = page_.get();
     rid = {pid_, sid_};
-    if (offset.first != page_->pid) {
+    if (slot.first != page_->pid) {
       // redirected from another page, skip
-      if (offset.first == Page::REDIRECT_PID) {
+      if (slot.first == Page::REDIRECT_PID) {
         continue;
       }
       // redirected to another page
-      actual_page = std::make_shared<Page>(offset.first);
-      actual_page->load(*file_handle_);
-      offset.second = actual_page->records_offset[offset.second].second;
+      redirect_ = std::make_shared<Page>(slot.first);
+      redirect_->load(*file_handle_);
+      page = redirect_.get();
+      slot.second = page->getSlot(slot.second).second;
     }
     // deleted
-    if (offset.second == Page::INVALID_OFFSET) continue;
-    RC ret = actual_page->readData(offset.second,
-                                   data,
-                                   schemas_,
-                                   projected_fields_,
-                                   comp_op_,
-                                   cond_field_,
-                                   value_);
-    if (actual_page != page_) {
-      // redirected page
-      actual_page->freeMem();
-    }
-    if (ret == RecordBasedFileManager::COND_NOT_SATISFIED) continue;
-    else return 0;
+    if (slot.second == Page::INVALID_OFFSET) continue;
+    offset = slot.second;
+    return 0;
+  }
+  return RBFM_EOF;
+}
 
+RC RBFM_ScanIterator::getNextRecord(RID &rid, void *data) {
+  Page *page;
+  PageOffset offset;
+  while (nextRecord(rid, page, offset) != RBFM_EOF) {
+    RC ret = page->readData(offset, data, codec_);
+    // a record not matching its schema version is logged and skipped
+    if (ret == 0) return 0;
+  }
+  return RBFM_EOF;
+}
+
+RC RBFM_ScanIterator::getNextRecordView(RID &rid, RecordView &view) {
+  Page *page;
+  PageOffset offset;
+  while (nextRecord(rid, page, offset) != RBFM_EOF) {
+    // rejected records are never parsed, a record not matching its schema version is logged and skipped
+    if (codec_.filter(*page, offset)) continue;
+    directory_t ver = view.parse(*page, offset);
+    view.project(codec_.projection(ver));
+    view.page_ = page == page_.get() ? page_ : redirect_;
+    return 0;
   }
+  view.release();
   return RBFM_EOF;
+}
 
+RC RBFM_ScanIterator::getNextRecords(void *data,
+                                     size_t capacity,
+                                     unsigned maxRecords,
+                                     std::vector<RID> &rids,
+                                     std::vector<size_t> &offsets) {
+  rids.clear();
+  offsets.clear();
+  size_t max_size = codec_.maxDecodedSize();
+  if (capacity < max_size) {
+    DB_ERROR << "buffer of " << capacity << " bytes can not hold a record of " << max_size << " bytes";
+    return RBFM_BUFFER_TOO_SMALL;
+  }
+  char *out = static_cast<char *>(data);
+  size_t used = 0;
+  RID rid;
+  Page *page;
+  PageOffset offset;
+  while (rids.size() < maxRecords && capacity - used >= max_size) {
+    // once a record is fetched, the batch ends with its page
+    if (nextRecord(rid, page, offset, !rids.empty()) == RBFM_EOF) break;
+    size_t length;
+    // a record not matching its schema version is logged and skipped
+    if (codec_.decode(*page, offset, out + used, &length)) continue;
+    rids.push_back(rid);
+    offsets.push_back(used);
+    used += length;
+  }
+  return rids.empty() ? RBFM_EOF : 0;
 }
 
 
@@ -11,7 +11,7 @@
 
 typedef unsigned short SID; // slod it
 typedef unsigned PID; // page id
-typedef unsigned PageOffset; // offset inside page, should be [0,4096)
+typedef unsigned PageOffset; // offset inside page, should be [0, page size)
 typedef short directory_t; // directories before real data, to indicate offset for each field
 
 static const directory_t MAX_FIELD_NUM = INT16_MAX;
@@ -61,47 +61,129 @@ struct EnumHash {
   }
 };
 
+// `lhs op rhs` for values of one AttrType, see RecordBasedFileManager::getComparator
+typedef bool (*Comparator)(const void *lhs, const void *rhs);
+
+// `attribute op value`, value is in the format of a field of insertRecord and must outlive the scan using it
+struct Predicate {
+  std::string attribute;
+  CompOp op;
+  const void *value;
+};
+
+// a record satisfies it if all `conjuncts` hold and, unless `disjuncts` is empty, at least one of `disjuncts` holds.
+// a NULL field, or a field the version of the record doesn't have, satisfies no predicate. a NO_OP predicate holds
+// for every record
+struct ScanCondition {
+  std::vector<Predicate> conjuncts;
+  std::vector<Predicate> disjuncts;
+};
+
 /******************************************
  *
  * =========== CUSTOM CLASSES ============
  *
 *****************************************/
 
+class RecordCodec;
 
 /**
- * abstraction of a page, embedded in a vector in rbfm
+ * abstraction of a page, constructed on demand
+ * `data` points to a pinned frame of BufferPool between `load` and `dump`/`freeMem`,
+ * or directly into the read-only mapping if the file is opened with OPEN_MMAP_READ_ONLY
+ *
+ * a page of a LAYOUT_PAX file stores its records column by column, see `parsePax`. the offset of a slot is then the
+ * row of the record in the minipages instead of a byte offset, so records are read through RecordCodec, RecordView
+ * or `copyRecord` rather than at `data` + offset
  */
 class Page {
   friend class RecordBasedFileManager;
+  friend class RBFM_ScanIterator;
+  friend class HeapBuilder;
   friend class FileHandle;
+  friend class RecordCodec;
+  friend class RecordView;
+
+  /**
+   * on-disk slot directory of a wide page, what `pid` and `offset` mean depends on flags:
+   * 0: record is in this page at `offset`, `pid` is this page
+   * SLOT_FORWARDED: record is moved to slot `offset` of page `pid`
+   * SLOT_MOVED_IN: record at `offset` is moved here from another slot, skipped by scan
+   * SLOT_DELETED: nothing
+   */
+  struct Directory {
+    uint32_t pid;
+    uint16_t offset;
+    uint16_t flags;
+  };
+
+  // beginning of data of a PAX page, all rows of it have the same number of fields and schema version
+  struct PaxHeader {
+    uint16_t num_rows;
+    directory_t num_fields;
+    directory_t version;
+    uint16_t reserved;
+  };
+
+  static const uint16_t SLOT_DELETED;
+  static const uint16_t SLOT_FORWARDED;
+  static const uint16_t SLOT_MOVED_IN;
+
   size_t data_end;
   char *data;
+  FileHandle *handle_; // handle used to pin the frame
+  size_t page_size_;   // page size of the file, known after load
+  unsigned offset_bits_; // low bits of a packed slot directory used by offset, log2(page_size_)
+  bool wide_;          // Directory slots, otherwise packed 32-bit slots of pages written before format version 3
   unsigned real_free_space_;
-  std::unordered_set<SID> invalid_slots_;
+  unsigned fragmented_; // bytes of deleted or shrunk records before data_end, part of real_free_space_
+  size_t dirty_begin_; // [dirty_begin_, dirty_end_) covers record bytes modified since load, logged by dump
+  size_t dirty_end_;
+  unsigned num_slots_;
+  std::vector<uint64_t> free_slots_; // bitmap of deleted slots, built on first use by a modification
+  bool free_slots_built_;
+  bool pax_;                 // columns in minipages, see parsePax
+  unsigned num_rows_;        // of a PAX page, and the number of fields and schema version shared by its rows
+  directory_t pax_fields_;
+  directory_t pax_version_;
+  std::vector<size_t> minipages_; // begin of the minipage of each field of a PAX page
 
  public:
 
-  static const size_t MAX_SIZE;
   static const SID FIND_NEW_SID;
   static const unsigned INVALID_OFFSET;  // PageOffset value to indicate a deleted slot
-  static const unsigned REDIRECT_PID; // PID value to indicate the slot is forwarded from other slot
+  static const unsigned REDIRECT_PID; // PID value to indicate the slot is forwarded from other slot, in memory only
+  static const size_t SLOT_SIZE;         // size of a wide slot directory
+  static const size_t PACKED_SLOT_SIZE;
+  static const unsigned MAX_FRAGMENTED; // page is compacted once more bytes than this are fragmented
 
   PID pid;
   /*
    * free_space = real_free_space_                (there're deleted directory we can reuse,)
-   * free_space = real_free_space_ - sizeof(int)  (all offset directories are full)
+   * free_space = real_free_space_ - slotSize()   (all offset directories are full)
    */
-  unsigned free_space;
-  std::vector<std::pair<PID, PageOffset >> records_offset; // offset (4095 means invalid)
+  unsigned free_space; // valid after a modification, or after RecordBasedFileManager::hasSpace
 
   explicit Page(PID page_id);
 
   ~Page();
 
-  void load(FileHandle &handle);
+  /**
+   * pin the page in BufferPool and parse meta, disk I/O happens only when the page is not cached
+   * @param handle
+   * @param ring frames of the sequential scan loading the page, if any
+   */
+  void load(FileHandle &handle, ScanRing *ring = nullptr);
 
+  /**
+   * write meta into frame, then unpin it as dirty, the frame will be written back by BufferPool later
+   * @param handle
+   */
   void dump(FileHandle &handle);
 
+  /**
+   * unpin the frame without modification
+   */
   void freeMem();
 
   /**
@@ -114,35 +196,88 @@ class Page {
   RID insertData(const char *new_data, size_t size, SID sid = FIND_NEW_SID);
 
   /**
-   * erase data and update free space accordingly
+   * erase data and update free space accordingly, the space becomes a hole reclaimed by a later compaction
    * @param record_begin_offset begin offset of record
    * @return
    */
   RC deleteRecord(size_t record_begin_offset);
 
+  /**
+   * replace record of a slot in this page by a record of another size, caller makes sure the page has enough
+   * free space. a shrunk record leaves a hole, a grown one is moved to the end of data if it can't grow in place
+   * @param sid
+   * @param new_data
+   * @param size
+   */
+  void updateData(SID sid, const char *new_data, size_t size);
+
+  /**
+   * move records together so that all free space is contiguous, offsets of slots are updated
+   */
+  void compact();
+
   /**
    * assume data exist in this page (already redirected, if so)
    * @param record_offset begin offset of record
    * @param out
-   * @param recordDescriptor
-   * @param projected_fields
-   * @param cmp
-   * @param cond_field
-   * @param cond_value
+   * @param codec compiled for the schemas, projected fields and condition of the caller
    * @return if return code is COND_NOT_SATISFIED, nothing will be written to out
    */
-  RC readData(PageOffset record_offset,
-              void *out,
-              const std::vector<std::vector<Attribute>> &recordDescriptors,
-              const std::vector<std::string> &projected_fields,
-              CompOp cmp = CompOp::NO_OP,
-              const std::string &cond_field = "",
-              const void *cond_value = nullptr);
+  RC readData(PageOffset record_offset, void *out, const RecordCodec &codec);
 
 
 //  std::string ToString() const;
 
-  static void initPage(char *page_data);
+  inline SID numSlots() const { return num_slots_; }
+
+  /**
+   * slot directory entry, decoded from the page in place
+   * @return <pid, offset>, offset is INVALID_OFFSET for a deleted slot, pid is REDIRECT_PID for a slot moved in from
+   * another one, and another page for a forwarded slot whose offset is then the slot in that page
+   */
+  inline std::pair<PID, PageOffset> getSlot(SID sid) const;
+
+  inline void setSlot(SID sid, std::pair<PID, PageOffset> slot);    // encoded into the page in place
+
+  static void initPage(char *page_data, size_t page_size, PageLayout layout = LAYOUT_ROW);
+
+  /**
+   * max size of a serialized record, bounded by page size and by field offsets being directory_t. a record of a PAX
+   * page also takes a null bitmap byte and a minipage begin for each of its fields, it still fits into an empty page
+   * @param page_size
+   * @param num_fields of the record, only matters for LAYOUT_PAX
+   * @return
+   */
+  static size_t maxRecordSize(size_t page_size, PageLayout layout = LAYOUT_ROW, size_t num_fields = 0);
+
+  /**
+   * whether an encoded record can be stored in this page at all: rows of a PAX page have to share the number of fields
+   * and the schema version, an empty one takes any record
+   */
+  bool accepts(const char *record) const;
+
+  /**
+   * bytes of free space an encoded record of `size` bytes takes in this page, not counting its slot
+   */
+  size_t dataSize(const char *record, size_t size) const;
+
+  /**
+   * size of the encoded record at `record_offset`
+   */
+  size_t recordSize(PageOffset record_offset) const;
+
+  /**
+   * @param out the encoded record at `record_offset`, reassembled from minipages for a PAX page
+   */
+  void copyRecord(PageOffset record_offset, std::vector<char> &out) const;
+
+  /**
+   * max number of pages in a file, PID values of REDIRECT_PID and INVALID_PID are reserved
+   * @return
+   */
+  static PID maxPageNum();
+
+  inline size_t slotSize() const { return wide_ ? SLOT_SIZE : PACKED_SLOT_SIZE; }
 
   /**
    * all record data after `after_offset` will be shift `switch_offset` bytes forward/backward
@@ -155,19 +290,81 @@ class Page {
 
  private:
 
-  void parseMeta();
+  void parseMeta();                                                   // header fields only, slots stay in page
+
+  /**
+   * data of a PAX page: [PaxHeader][uint16 begin of the minipage of each field][minipage of field 0][hole]...
+   * minipage: [null bitmap of rows][uint16 end of the value of each row][values of the rows back to back]
+   * value ends are relative to the beginning of values, a NULL value is empty. a value has the same bytes as in an
+   * encoded record, so it can be compared or copied in place. the holes between minipages are room for them to grow,
+   * counted by fragmented_, the last one grows towards the slot directory. a page without rows has no fields
+   */
+  void parsePax();
+
+  /**
+   * change row `row` of a PAX page to the encoded `record`, append it if `row` is the number of rows, or remove it if
+   * `record` is null. minipages are changed in place, and only moved by `compactPax` when one of them outgrows its
+   * room. caller makes sure the page accepts the record and has space for it
+   */
+  void writePaxRow(unsigned row, const char *record);
+
+  /**
+   * move the minipages so that each one has room for `sizes` bytes, the space left is shared by them in proportion
+   * to their sizes
+   */
+  void compactPax(const std::vector<size_t> &sizes);
+
+  size_t minipageSize(unsigned field) const;
+
+  void accountPax(); // data_end, fragmented_ and real_free_space_ from the minipages
+
+  /**
+   * value of a field of a row of a PAX page
+   * @param size set to its size, 0 for NULL
+   * @return nullptr for NULL
+   */
+  inline const char *paxField(unsigned field, unsigned row, unsigned &size) const;
 
   void dumpMeta();
 
+  /**
+   * use `buffer` of a page that is not in BufferPool as data, such as one built in memory by HeapBuilder. data has
+   * to be set back to null before destruction
+   */
+  void attach(char *buffer, size_t page_size);
+
+  void buildFreeSlots();
+
+  /**
+   * rewrite packed directory as wide one, which has to fit into contiguous free space
+   */
+  void widenDirectory();
+
   void checkDataend(); // for debug
 
   inline SID findNextSlotID();
 
+  inline void markFreeSlot(SID sid, bool free);
+
+  inline Directory *wideSlot(SID sid) const;
+
+  inline unsigned *packedSlot(SID sid) const;
+
+  inline void markDirty(size_t begin, size_t end);
+
+  inline size_t contiguousFreeSpace() const;
+
+  inline void addFragment(size_t size);
+
   inline void maintainFreeSpace();
 
-  static inline std::pair<PID, PageOffset> decodeDirectory(unsigned directory);
+  inline std::pair<PID, PageOffset> decodeDirectory(const Directory &directory) const;
+
+  inline Directory encodeDirectory(std::pair<PID, PageOffset> page_offset) const;
+
+  inline std::pair<PID, PageOffset> decodePackedDirectory(unsigned directory) const;
 
-  static inline unsigned encodeDirectory(std::pair<PID, PageOffset> page_offset);
+  inline unsigned encodePackedDirectory(std::pair<PID, PageOffset> page_offset) const;
 
   /**
    * the record size include the heading directories
@@ -179,36 +376,476 @@ class Page {
 };
 
 SID Page::findNextSlotID() {
-  if (invalid_slots_.empty()) return records_offset.size();
-  SID ret = *invalid_slots_.begin();
-  invalid_slots_.erase(invalid_slots_.begin());
-  return ret;
+  buildFreeSlots();
+  for (size_t i = 0; i < free_slots_.size(); ++i) {
+    if (free_slots_[i]) return i * 64 + __builtin_ctzll(free_slots_[i]);
+  }
+  return num_slots_;
+}
+
+void Page::markFreeSlot(SID sid, bool free) {
+  if (!free_slots_built_) return;
+  if (sid / 64 >= free_slots_.size()) free_slots_.resize(sid / 64 + 1, 0);
+  if (free) free_slots_[sid / 64] |= uint64_t(1) << sid % 64;
+  else free_slots_[sid / 64] &= ~(uint64_t(1) << sid % 64);
+}
+
+Page::Directory *Page::wideSlot(SID sid) const {
+  return reinterpret_cast<Directory *>(data + page_size_ - 2 * sizeof(unsigned)) - 1 - sid;
+}
+
+unsigned *Page::packedSlot(SID sid) const {
+  return reinterpret_cast<unsigned *>(data + page_size_) - 3 - sid;
+}
+
+std::pair<PID, PageOffset> Page::getSlot(SID sid) const {
+  return wide_ ? decodeDirectory(*wideSlot(sid)) : decodePackedDirectory(*packedSlot(sid));
+}
+
+void Page::setSlot(SID sid, std::pair<PID, PageOffset> slot) {
+  if (wide_) *wideSlot(sid) = encodeDirectory(slot);
+  else *packedSlot(sid) = encodePackedDirectory(slot);
+  markFreeSlot(sid, slot.second == INVALID_OFFSET);
+}
+
+size_t Page::contiguousFreeSpace() const {
+  return page_size_ - 2 * sizeof(unsigned) - num_slots_ * slotSize() - data_end;
+}
+
+void Page::addFragment(size_t size) {
+  fragmented_ += size;
+  if (fragmented_ > MAX_FRAGMENTED) compact();
+}
+
+const char *Page::paxField(unsigned field, unsigned row, unsigned &size) const {
+  const char *minipage = data + minipages_[field];
+  size_t bitmap_size = (num_rows_ + 7) / 8;
+  if (minipage[row / 8] & (1 << row % 8)) {
+    size = 0;
+    return nullptr;
+  }
+  auto ends = reinterpret_cast<const uint16_t *>(minipage + bitmap_size);
+  unsigned begin = row ? ends[row - 1] : 0;
+  size = ends[row] - begin;
+  return minipage + bitmap_size + num_rows_ * sizeof(uint16_t) + begin;
+}
+
+void Page::markDirty(size_t begin, size_t end) {
+  dirty_begin_ = std::min(dirty_begin_, begin);
+  dirty_end_ = std::max(dirty_end_, end);
 }
 
 void Page::maintainFreeSpace() {
-  free_space = invalid_slots_.empty() ? real_free_space_ - sizeof(int) : real_free_space_;
+  buildFreeSlots();
+  if (std::any_of(free_slots_.begin(), free_slots_.end(), [](uint64_t word) { return word != 0; }))
+    free_space = real_free_space_;
+  else free_space = real_free_space_ >= slotSize() ? real_free_space_ - slotSize() : 0;
+  if (handle_) handle_->fsm_.update(pid, free_space);
 }
 
-std::pair<PID, PageOffset> Page::decodeDirectory(unsigned directory) {
-  // high 20 bit represent page num, low 12 bit represent offset in page
-  unsigned first = (directory & 0xfffff000) >> 12; // first 20 bits
+std::pair<PID, PageOffset> Page::decodeDirectory(const Directory &directory) const {
+  if (directory.flags & SLOT_DELETED) return {pid, INVALID_OFFSET};
+  if (directory.flags & SLOT_MOVED_IN) return {REDIRECT_PID, directory.offset};
+  return {directory.pid, directory.offset};
+}
 
-  return {(directory & 0xfffff000) >> 12, directory & 0xfff};
+Page::Directory Page::encodeDirectory(std::pair<PID, PageOffset> page_offset) const {
+  if (page_offset.second == INVALID_OFFSET) return {pid, 0, SLOT_DELETED};
+  if (page_offset.first == REDIRECT_PID) return {pid, uint16_t(page_offset.second), SLOT_MOVED_IN};
+  uint16_t flags = page_offset.first == pid ? 0 : SLOT_FORWARDED;
+  return {page_offset.first, uint16_t(page_offset.second), flags};
 }
 
-unsigned Page::encodeDirectory(std::pair<PID, PageOffset> page_offset) {
-  static const unsigned MAX_PID = 0xfffff;
-  if (page_offset.first > MAX_PID) { // exceed 16 bits
+std::pair<PID, PageOffset> Page::decodePackedDirectory(unsigned directory) const {
+  // high bits represent page num, low `offset_bits_` bits represent offset in page (20/12 bits for 4KB pages).
+  // all ones in either part is the on-disk form of REDIRECT_PID/INVALID_OFFSET
+  unsigned offset_mask = (1u << offset_bits_) - 1;
+  unsigned pid_mask = UINT32_MAX >> offset_bits_;
+  PID pid = directory >> offset_bits_;
+  PageOffset offset = directory & offset_mask;
+  return {pid == pid_mask ? REDIRECT_PID : pid, offset == offset_mask ? INVALID_OFFSET : offset};
+}
+
+unsigned Page::encodePackedDirectory(std::pair<PID, PageOffset> page_offset) const {
+  unsigned offset_mask = (1u << offset_bits_) - 1;
+  unsigned pid_mask = UINT32_MAX >> offset_bits_;
+  PID pid = page_offset.first == REDIRECT_PID ? pid_mask : page_offset.first;
+  PageOffset offset = page_offset.second == INVALID_OFFSET ? offset_mask : page_offset.second;
+  if (pid > pid_mask) {
     throw std::runtime_error("Page id overflow");
   }
-  return (page_offset.first << 12) + page_offset.second;
+  return (pid << offset_bits_) + offset;
 }
 
+/**
+ * translates records between the format of RecordBasedFileManager::insertRecord and the encoded format on page.
+ * name lookups are resolved by `compile`, once for every version of a schema, the projected fields and the condition
+ * field, so encoding or decoding a record is a single pass over its offset directory followed by memcpy of the
+ * fields, without hashing or allocation. a codec is not modified by encode and decode, it can be shared
+ */
+class RecordCodec {
+ public:
+  RecordCodec();
+
+  /**
+   * @param schemas every version of a schema, records are encoded in the last one and decoded into it
+   * @param projected_fields fields decoded, in this order, empty means all fields of the last version
+   * @param condition tested by `filter` and `decode`, fields and comparators of its predicates are resolved here
+   * for each version
+   * @return -1 if a projected field is not in the last version
+   */
+  RC compile(const std::vector<std::vector<Attribute>> &schemas,
+             const std::vector<std::string> &projected_fields = {},
+             const ScanCondition &condition = ScanCondition());
+
+  /**
+   * @param data in the format of RecordBasedFileManager::insertRecord, in the last version of schema
+   * @param ver schema version recorded in the encoded record
+   * @param out encoded record, resized to fit, so its capacity can be reused across calls
+   * @return -1 if a VarChar is longer than its attribute allows
+   */
+  RC encode(const void *data, directory_t ver, std::vector<char> &out) const;
+
+  /**
+   * test the condition on an encoded record in place
+   * @return 0 if satisfied, COND_NOT_SATISFIED if not, -1 if the record doesn't match its schema version
+   */
+  RC filter(const char *src) const;
+
+  /**
+   * @param src encoded record
+   * @param out projected fields in the format of RecordBasedFileManager::insertRecord, a field the version of the
+   * record doesn't have is NULL
+   * @param length if not nullptr, set to the number of bytes written to out
+   * @return same as `filter`, nothing is written to out unless it's 0
+   */
+  RC decode(const char *src, void *out, size_t *length = nullptr) const;
+
+  /**
+   * same as above for the record at `record_offset` of a page of any layout, only the minipages of tested and projected
+   * fields of a PAX page are read
+   */
+  RC filter(const Page &page, PageOffset record_offset) const;
+
+  RC decode(const Page &page, PageOffset record_offset, void *out, size_t *length = nullptr) const;
+
+  // upper bound of the bytes `decode` writes for a record of any version
+  inline size_t maxDecodedSize() const { return max_decoded_size_; }
+
+  inline bool hasVersion(directory_t ver) const { return ver >= 0 && size_t(ver) < versions_.size(); }
+
+  inline size_t numFields(directory_t ver) const { return versions_[ver].num_fields; }
+
+  // field of record for each projected field, -1 for a field the version doesn't have
+  inline const std::vector<int> &projection(directory_t ver) const { return versions_[ver].projection; }
+
+  inline bool hasCondition() const { return has_condition_; }
+
+ private:
+  // a predicate resolved for one version
+  struct Test {
+    int field;
+    Comparator compare;
+    const void *value;
+  };
+
+  struct Version {
+    directory_t num_fields;
+    directory_t header_size;     // size of offset directory, where the first field begins
+    std::vector<int> projection;
+    std::vector<Test> conjuncts;
+    std::vector<Test> disjuncts;
+    bool satisfiable; // false if a conjunct, or every disjunct, is on a field this version doesn't have
+  };
+
+  std::vector<Version> versions_;
+  std::vector<std::pair<AttrType, AttrLength>> fields_; // of the last version, for encoding
+  unsigned encode_indicator_bytes_; // null indicator of a record being encoded
+  unsigned decode_indicator_bytes_; // null indicator of decoded projection
+  size_t max_decoded_size_;
+  bool has_condition_;
+  bool has_disjuncts_;
+
+  inline bool holds(const Test &test, const char *src, const directory_t *ends, directory_t header_size) const;
+
+  /**
+   * @param ver schema version of a record
+   * @param num_fields number of fields the record has
+   * @param holds whether a Test holds for the record
+   * @return same as `filter`
+   */
+  template<typename Holds>
+  RC check(directory_t ver, directory_t num_fields, Holds holds) const;
+};
+
+/**
+ * some summary of the records of every page of a heap file for a few columns, so that a scan can skip pages none of
+ * whose records satisfy its condition.
+ *
+ * it's kept in a side file `<heap file><suffix>` whose pages are cached by BufferPool and logged like heap pages, so an
+ * entry is always committed together with the records it covers. the first page of it lists the columns, entries of
+ * heap pages follow in page order, a fixed number of bytes per column. the entry of a page covers every record whose
+ * RID is in that page, wherever the record is forwarded to. entries only grow on insert and update, so they may cover
+ * values no longer in a page but never miss one, and a page is reset once the last record of it is deleted. an entry of
+ * all zero bytes covers no value. the open handles of a heap file share one instance of each kind
+ */
+class PageSummary {
+ public:
+  // predicates of a ScanCondition a summary can test, same semantics as ScanCondition
+  template<typename Test>
+  struct Filter {
+    std::vector<Test> conjuncts;
+    std::vector<Test> disjuncts; // empty if the OR group can't be tested, e.g. a disjunct on another column
+    inline bool empty() const { return conjuncts.empty() && disjuncts.empty(); }
+  };
+
+  virtual ~PageSummary() = default;
+
+  /**
+   * create the side file of a heap file and build the entries of the records in it. the columns are written last, a
+   * side file whose build was interrupted has none and is ignored
+   * @param fileHandle heap file, must not have a summary of this kind attached
+   * @param schemas every version of schema of the heap file
+   * @param columns fields of the last version
+   */
+  RC create(FileHandle &fileHandle,
+            const std::vector<std::vector<Attribute>> &schemas,
+            const std::vector<std::string> &columns);
+
+  /**
+   * @param fileName heap file
+   * @return -1 if side file can not be read. columns() is empty if its build was interrupted
+   */
+  RC open(const std::string &fileName, OpenMode mode);
+
+  inline const std::vector<Attribute> &columns() const { return columns_; }
+  inline bool isMapped() const { return handle_.isMapped(); }         // opened read-only, see open
+
+  /**
+   * add a record in the format of RecordBasedFileManager::insertRecord to the entry of page `pid`
+   */
+  RC add(PID pid, const std::vector<Attribute> &recordDescriptor, const void *data);
+
+  RC merge(PID to, PID from);                                         // records of page `from` are moved to `to`
+  RC reset(PID pid);                                                  // page has no records any more
+  RC truncate(PID num_pages);                                         // heap file is cut to `num_pages`
+
+ protected:
+  const std::string suffix_;
+  size_t entry_size_;         // bytes of entry of one column
+
+  explicit PageSummary(const std::string &suffix);
+
+  /**
+   * pin the side file page holding the entries of page `pid`, appending empty pages up to it if `create` is set
+   * @return entries of the columns of page `pid`, nullptr if there's no such page
+   */
+  char *pin(PID pid, bool create);
+  void unpin(PID pid, char *entries, bool dirty);
+
+  /**
+   * resolve every predicate of `condition` by `make`, which returns false if it can't test the predicate
+   */
+  template<typename Test, typename Make>
+  static void resolve(const ScanCondition &condition, Filter<Test> &filter, Make make);
+
+  /**
+   * @param check tests the entries of a page
+   * @return false if no record of page `pid` can satisfy the condition `filter` is resolved from
+   */
+  template<typename Test, typename Check>
+  bool mayMatch(PID pid, const Filter<Test> &filter, Check check);
+
+  /**
+   * @return index of the column a predicate on `name` can be tested on, -1 if there's none or the field of that name
+   * in `schema` has another type
+   */
+  int findColumn(const std::vector<Attribute> &schema, const std::string &name) const;
+
+  virtual bool accepts(const Attribute &column) const = 0;             // whether a field can be a column
+  virtual size_t entrySize(size_t page_size) const = 0;               // entry_size_ of side file of page size
+
+  /**
+   * @param type type of the field with the column name in the record
+   * @return whether entry is modified
+   */
+  virtual bool fold(char *entry, const Attribute &column, AttrType type, const char *value) const = 0;
+
+  /**
+   * add the values covered by entry `from` to `entry`
+   * @return whether entry is modified
+   */
+  virtual bool mergeEntry(char *entry, const char *from, const Attribute &column) const = 0;
+
+ private:
+  FileHandle handle_;
+  std::mutex append_mutex_;   // the instance is shared by the handles of heap file
+  std::vector<Attribute> columns_;
+  unsigned entries_per_page_; // heap pages covered by one page of side file
+};
+
+/**
+ * min and max of some Int or Real columns over the records of every page, for comparisons, see PageSummary
+ */
+class ZoneMap : public PageSummary {
+ public:
+  static const std::string SUFFIX;
+
+  // one predicate of a ScanCondition on a column of the zone map
+  struct Test {
+    unsigned column;
+    Comparator lower; // applied to min of page, nullptr if the operator doesn't bound it
+    Comparator upper; // applied to max of page
+    bool negate;      // NE_OP, page is skipped only if every record in it equals value
+    const void *value;
+  };
+
+  typedef PageSummary::Filter<Test> Filter;
+
+  ZoneMap();
+
+  /**
+   * @param schema current schema, which the values of predicates are in
+   * @param filter out, predicates on columns of the zone map whose type matches
+   */
+  void resolve(const std::vector<Attribute> &schema, const ScanCondition &condition, Filter &filter) const;
+
+  bool mayMatch(PID pid, const Filter &filter);
+
+ protected:
+  bool accepts(const Attribute &column) const override;
+  size_t entrySize(size_t page_size) const override;
+  bool fold(char *entry, const Attribute &column, AttrType type, const char *value) const override;
+  bool mergeEntry(char *entry, const char *from, const Attribute &column) const override;
+
+ private:
+  struct Entry {
+    uint32_t flags;
+    char min[sizeof(int)];
+    char max[sizeof(int)];
+  };
+
+  static const uint32_t HAS_VALUE; // some record of the page has a non-NULL value
+  static const uint32_t UNBOUNDED; // a value of another type was stored under the column name, nothing is skipped
+
+  static bool test(const Test &test, const Entry &entry);
+};
+
+/**
+ * a Bloom filter of the values of some columns of any type for every page, for equality, see PageSummary.
+ * it's 1/32 of a page per column, 1024 bits with 4KB pages, so a point predicate reads a page that doesn't hold the
+ * value with a chance of about 2% if the page has 100 records
+ */
+class BloomFilter : public PageSummary {
+ public:
+  static const std::string SUFFIX;
+
+  // EQ_OP on a column of the filter, by the bits its value sets
+  struct Test {
+    unsigned column;
+    std::vector<uint32_t> bits;
+  };
+
+  typedef PageSummary::Filter<Test> Filter;
+
+  BloomFilter();
+
+  /**
+   * @param schema current schema, which the values of predicates are in
+   * @param filter out, equality predicates on columns of the filter whose type matches
+   */
+  void resolve(const std::vector<Attribute> &schema, const ScanCondition &condition, Filter &filter) const;
+
+  bool mayMatch(PID pid, const Filter &filter);
+
+ protected:
+  bool accepts(const Attribute &column) const override;
+  size_t entrySize(size_t page_size) const override;
+  bool fold(char *entry, const Attribute &column, AttrType type, const char *value) const override;
+  bool mergeEntry(char *entry, const char *from, const Attribute &column) const override;
+
+ private:
+  static const unsigned NUM_HASHES;
+  static const unsigned BYTES_PER_PAGE; // bytes of entry are page size divided by this
+
+  /**
+   * @param value field in the record format
+   */
+  static uint64_t hash(AttrType type, const char *value);
+
+  /**
+   * @return the i-th of NUM_HASHES bits of a value of `hash`, by double hashing
+   */
+  inline uint32_t bit(uint64_t hash, unsigned i) const {
+    return uint32_t((uint32_t(hash) + uint64_t(i) * (uint32_t(hash >> 32) | 1)) % (entry_size_ * 8));
+  }
+};
+
+/**
+ * read-only view of a record, fields are located in place instead of being copied into a buffer.
+ * a view bound by RBFM_ScanIterator::getNextRecordView or RecordBasedFileManager::readRecordView points into a page
+ * and keeps it pinned until the view is bound to another record, released or destroyed, so it has to be released
+ * before its file is closed, and is not valid across modifications of the file.
+ * field i is the i-th projected field, for VarChar it begins with the 4-byte length as in the record format.
+ */
+class RecordView {
+  friend class RBFM_ScanIterator;
+  friend class RecordBasedFileManager;
+
+  std::shared_ptr<Page> page_;                                 // lifetime guard, empty when viewing a plain buffer
+  std::vector<std::pair<const char *, unsigned>> fields_;     // begin and size of each field, begin is null for NULL
+  std::vector<std::pair<const char *, unsigned>> record_fields_; // all fields of the record as stored on page
+
+  /**
+   * locate all fields of an encoded record from its offset directory into record_fields_
+   * @param record begin of record on page
+   * @return schema version of record
+   */
+  directory_t parse(const char *record);
+
+  directory_t parse(const Page &page, PageOffset record_offset);     // of a page of any layout
+
+  /**
+   * pick projected fields out of what `parse` located
+   * @param projection field of record for each projected field, -1 for a field the record doesn't have
+   */
+  void project(const std::vector<int> &projection);
+
+ public:
+  RecordView() = default;
+
+  /**
+   * view of a record in the format of RecordBasedFileManager::insertRecord
+   */
+  void bind(const std::vector<Attribute> &attrs, const void *data);
+
+  void release();
+
+  inline unsigned size() const { return fields_.size(); }
+
+  inline bool isNull(unsigned i) const { return !fields_[i].first; }
+
+  inline const char *field(unsigned i) const { return fields_[i].first; }
+
+  inline unsigned fieldSize(unsigned i) const { return fields_[i].second; }
+
+  /**
+   * bytes `copyTo` writes
+   */
+  size_t length() const;
+
+  /**
+   * materialise the record in the format of RecordBasedFileManager::insertRecord
+   */
+  void copyTo(void *data) const;
+};
+
 /********************************************************************
 * The scan iterator is NOT required to be implemented for Project 1 *
 ********************************************************************/
 
 # define RBFM_EOF (-1)  // end of a scan operator
+# define RBFM_BUFFER_TOO_SMALL (-2)  // buffer of a batch can't hold a record of the largest size
 
 //  RBFM_ScanIterator is an iterator to go through records
 //  The way to use it is like the following:
@@ -227,16 +864,38 @@ class RBFM_ScanIterator {
   RecordBasedFileManager *rbfm_;
   FileHandle *file_handle_;
   std::shared_ptr<Page> page_;
+  std::shared_ptr<Page> redirect_; // page of the forwarded record last returned by nextRecord
   PID pid_;
   SID sid_;
-  std::vector<std::vector<Attribute>> schemas_;
-  std::vector<std::string> projected_fields_;
-  std::string cond_field_;
-  CompOp comp_op_;
-  const void *value_;
+  RecordCodec codec_;
   bool init_;
+  std::unique_ptr<ReadAhead> read_ahead_;
+  std::unique_ptr<ScanRing> ring_;
+  std::shared_ptr<ZoneMap> zone_map_; // nullptr if the condition can't skip pages
+  ZoneMap::Filter zone_filter_;
+  std::shared_ptr<BloomFilter> bloom_filter_; // nullptr if the condition can't skip pages
+  BloomFilter::Filter bloom_tests_;
+
+  static unsigned read_ahead_depth_;
+
+  /**
+   * @return false if the zone map or Bloom filter of the file rules out every record of page `pid`
+   */
+  bool mayMatch(PID pid);
+
+  /**
+   * advance to next live record
+   * @param page set to the page holding the record, page_ or redirect_ for a forwarded record, valid until next call
+   * @param offset set to offset of the record in `page`
+   * @param within_page return RBFM_EOF at the end of page_ instead of loading the next page
+   * @return RBFM_EOF at the end
+   */
+  RC nextRecord(RID &rid, Page *&page, PageOffset &offset, bool within_page = false);
+  static unsigned scan_ring_size_;
 
  public:
+  static const unsigned DEFAULT_READ_AHEAD_DEPTH;
+
   RBFM_ScanIterator();
 
   ~RBFM_ScanIterator() = default;;
@@ -246,21 +905,105 @@ class RBFM_ScanIterator {
   // "data" follows the same format as RecordBasedFileManager::insertRecord().
   RC getNextRecord(RID &rid, void *data);
 
+  /**
+   * same as getNextRecord, but `view` is bound to the record on its page instead of copying it out
+   */
+  RC getNextRecordView(RID &rid, RecordView &view);
+
+  /**
+   * fetch the following satisfying records of the page being scanned in one call, a batch never spans two pages
+   * unless the rest of a page has no satisfying record
+   * @param data records are decoded back to back, each in the format of getNextRecord
+   * @param capacity bytes of data, records are decoded while at least RecordCodec::maxDecodedSize of the projection
+   * are left, which is the null indicator plus 4 bytes for each projected Int or Real and 4 + length for each VarChar
+   * @param maxRecords at most this many records are fetched
+   * @param rids set to the RID of each record
+   * @param offsets set to where each record begins in data
+   * @return RBFM_EOF at the end, RBFM_BUFFER_TOO_SMALL if capacity is less than the size above
+   */
+  RC getNextRecords(void *data,
+                    size_t capacity,
+                    unsigned maxRecords,
+                    std::vector<RID> &rids,
+                    std::vector<size_t> &offsets);
+
   RC close();
 
+  /**
+   * number of pages fetched in background ahead of the page being scanned, 0 disables read-ahead.
+   * takes effect for scans initialized afterwards
+   */
+  static void setReadAheadDepth(unsigned depth);
+
+  /**
+   * frames a scan over a file larger than a quarter of BufferPool may use, see ScanRing. 0 lets such scans evict
+   * from the whole pool. takes effect for scans initialized afterwards
+   */
+  static void setScanRingSize(unsigned size);
+
   RC init(
       FileHandle &fileHandle,
       RecordBasedFileManager *rbfm,
       const std::vector<std::vector<Attribute>> &schemas,
-      const std::string &conditionAttribute,
-      CompOp compOp,
-      const void *value,
+      const ScanCondition &condition,
       const std::vector<std::string> &attributeNames);
 
 };
 
+/**
+ * builds the heap of an initial load by appending pages to the end of a file: records are packed into a page in
+ * memory, which is appended by FileHandle::appendPage once the next record doesn't fit, so every page is written
+ * exactly once and there's neither free space search nor slot reuse. metadata of the file, such as free space map,
+ * is written once when the file is closed.
+ * the file must not be modified otherwise between init and close
+ */
+class HeapBuilder {
+ public:
+  /**
+   * records appended to one page, they are in slots [0, numSlots)
+   */
+  struct RIDRange {
+    PID pageNum;
+    SID numSlots;
+  };
+
+  HeapBuilder();
+
+  ~HeapBuilder();                                                     // close if not closed yet
+
+  RC init(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor);
+
+  /**
+   * @param data in the format of RecordBasedFileManager::insertRecord
+   * @param rid final RID of record, even though its page is appended later
+   */
+  RC append(const void *data, RID &rid);
+
+  RC close();                                                         // append the last page
+
+  // RIDs handed out so far, in order, e.g. to build indexes afterwards
+  inline const std::vector<RIDRange> &getRanges() const { return ranges_; }
+
+ private:
+  FileHandle *file_handle_;
+  std::vector<Attribute> record_descriptor_;
+  RecordCodec codec_;
+  std::vector<char> record_; // encoded record, reused
+  char *buffer_; // aligned, as the file might be opened with OPEN_DIRECT
+  Page page_;
+  std::vector<RIDRange> ranges_;
+
+  void startPage();
+
+  RC appendPage();
+};
+
 class RecordBasedFileManager {
+  friend class Page;
   friend class RBFM_ScanIterator;
+  friend class RecordView;
+  friend class RecordCodec;
+  friend class HeapBuilder;
   friend class RelationManager;
  public:
 
@@ -268,11 +1011,13 @@ class RecordBasedFileManager {
 
   static RecordBasedFileManager &instance();                          // Access to the _rbf_manager instance
 
-  RC createFile(const std::string &fileName);                         // Create a new record-based file
+  // Create a new record-based file, records are stored by column inside each page with LAYOUT_PAX, see Page
+  RC createFile(const std::string &fileName, size_t pageSize = PAGE_SIZE, PageLayout layout = LAYOUT_ROW);
 
   RC destroyFile(const std::string &fileName);                        // Destroy a record-based file
 
-  RC openFile(const std::string &fileName, FileHandle &fileHandle);   // Open a record-based file
+  // Open a record-based file, OPEN_MMAP_READ_ONLY suits read-mostly scans: pages are views onto the mapping of file
+  RC openFile(const std::string &fileName, FileHandle &fileHandle, OpenMode mode = OPEN_READ_WRITE);
 
   RC closeFile(FileHandle &fileHandle);                               // Close a record-based file
 
@@ -294,9 +1039,22 @@ class RecordBasedFileManager {
   // Insert a record into a file
   RC insertRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor, const void *data, RID &rid);
 
+  // Insert records in the same format as insertRecord, each page is filled with as many of them as fit and written
+  // once. nothing is inserted if any record is invalid, rids are in the order of batch
+  RC insertRecords(FileHandle &fileHandle,
+                   const std::vector<Attribute> &recordDescriptor,
+                   const std::vector<const void *> &batch,
+                   std::vector<RID> &rids);
+
   // Read a record identified by the given rid.
   RC readRecord(FileHandle &fileHandle, const std::vector<Attribute> &recordDescriptor, const RID &rid, void *data);
 
+  // Bind `view` to the record identified by the given rid on its pinned page, nothing is copied. see RecordView
+  RC readRecordView(FileHandle &fileHandle,
+                    const std::vector<Attribute> &recordDescriptor,
+                    const RID &rid,
+                    RecordView &view);
+
   // Print the record that is passed to this utility method.
   // This method will be mainly used for debugging/testing.
   // The format is as follows:
@@ -329,6 +1087,40 @@ class RecordBasedFileManager {
           const std::vector<std::string> &attributeNames, // a list of projected attributes
           RBFM_ScanIterator &rbfm_ScanIterator);
 
+  // Same as above, but records are filtered by several predicates, see ScanCondition. they are tested on the
+  // encoded record in the page, so a rejected record is never copied
+  RC scan(FileHandle &fileHandle,
+          const std::vector<Attribute> &recordDescriptor,
+          const ScanCondition &condition,
+          const std::vector<std::string> &attributeNames,
+          RBFM_ScanIterator &rbfm_ScanIterator);
+
+  // Move every forwarded record back to its origin slot so that its RID still holds. a record that doesn't fit there
+  // any more is inserted wherever there's space and gets a new RID, reported through `onMove` before the next page
+  // is processed, the old RID is invalid from then on. fragmented pages are compacted, and trailing pages without
+  // records are cut off the file. no scan should be open on the file meanwhile. if moving a record fails, it returns
+  // after the strays of that page are all moved, and cuts nothing off
+  RC vacuum(FileHandle &fileHandle,
+            const std::function<RC(const RID &oldRid, const RID &newRid)> &onMove = nullptr);
+
+  // Keep min and max of some Int or Real attributes for every page, so that scans with a comparison on them skip pages
+  // that can't hold a match, see ZoneMap. an existing zone map of the file is replaced. it's maintained through every
+  // handle opened by openFile from now on
+  RC createZoneMap(FileHandle &fileHandle,
+                   const std::vector<Attribute> &recordDescriptor,
+                   const std::vector<std::string> &attributeNames);
+
+  RC destroyZoneMap(FileHandle &fileHandle);
+
+  // Keep a Bloom filter of the values of some attributes of any type for every page, so that scans with an equality on
+  // them skip pages that don't hold the value, see BloomFilter. an existing Bloom filter of the file is replaced. it's
+  // maintained like a zone map
+  RC createBloomFilter(FileHandle &fileHandle,
+                       const std::vector<Attribute> &recordDescriptor,
+                       const std::vector<std::string> &attributeNames);
+
+  RC destroyBloomFilter(FileHandle &fileHandle);
+
  protected:
   RecordBasedFileManager();                                                   // Prevent construction
   ~RecordBasedFileManager();                                                  // Prevent unwanted destruction
@@ -388,12 +1180,62 @@ class RecordBasedFileManager {
                       const RID &rid,
                       const directory_t ver);
 
+  /**
+   * @param recordDescriptors schema of different versions, entries of records of all of them are built
+   */
+  RC createZoneMapImpl(FileHandle &fileHandle,
+                       const std::vector<std::vector<Attribute>> &recordDescriptors,
+                       const std::vector<std::string> &attributeNames);
+
+  RC createBloomFilterImpl(FileHandle &fileHandle,
+                           const std::vector<std::vector<Attribute>> &recordDescriptors,
+                           const std::vector<std::string> &attributeNames);
 
   /**
-   * load meta of next page into memory
-   * @param fileHandle
+   * replace the side file of `summary` of a file with a new one and attach it
    */
-  void loadNextPage(FileHandle &fileHandle);
+  RC createSummary(FileHandle &fileHandle,
+                   PageSummary &summary,
+                   const std::string &suffix,
+                   const std::vector<std::vector<Attribute>> &recordDescriptors,
+                   const std::vector<std::string> &attributeNames);
+
+  /**
+   * attach the zone map and Bloom filter of a file just opened, if it has complete ones
+   */
+  RC attachSummaries(FileHandle &fileHandle);
+
+  /**
+   * @param attached out, the summary of kind `Summary` shared by the open handles of the file, nullptr if the file
+   * has no complete one
+   */
+  template<typename Summary>
+  static RC attachSummary(FileHandle &fileHandle, std::shared_ptr<Summary> &attached);
+
+  static void forgetSummary(const std::string &sideFile);            // later handles open the side file anew
+
+  /**
+   * @return zone map and Bloom filter attached to a file
+   */
+  static std::vector<PageSummary *> summariesOf(const FileHandle &fileHandle);
+
+  /**
+   * codec of `schemas` decoding `projected_fields`, compiled by the first call and shared by later calls with the
+   * same schemas and projection. the cache starts over once it holds CODEC_CACHE_SIZE codecs
+   * @return nullptr if a projected field is not in the last version
+   */
+  static std::shared_ptr<const RecordCodec> codecOf(const std::vector<std::vector<Attribute>> &schemas,
+                                                    const std::vector<std::string> &projected_fields = {});
+
+  static const size_t CODEC_CACHE_SIZE;
+  static std::unordered_map<std::string, std::shared_ptr<const RecordCodec>> codecs_; // by schemas and projection
+  static std::mutex codecs_mutex_;
+
+  // summaries by side file, every handle of a file shares them so that the side pages appended through one handle are
+  // seen by the others. mapped handles read them through the pool too, so that their entries are never behind the heap
+  // pages written back
+  static std::map<std::string, std::weak_ptr<PageSummary>> summaries_;
+  static std::mutex summaries_mutex_;
 
   /**
    * append a new page and return the pid
@@ -405,21 +1247,47 @@ class RecordBasedFileManager {
    * find Available page to insert `size` data, will append new page if all pages are full
    * @param size
    * @param file_handle
-   * @return
+   * @return pid of the page
    */
-  Page *findAvailableSlot(size_t size, FileHandle &file_handle);
+  PID findAvailableSlot(size_t size, FileHandle &file_handle);
+
+  /**
+   * load a page chosen by findAvailableSlot into `page`. free space map is only a hint after crash recovery, loading
+   * a page corrects its entry, so retry until the page really has enough space
+   * @param record encoded record to be put into the page
+   * @param size
+   * @param file_handle
+   * @param page not loaded, its pid is overwritten
+   */
+  void loadAvailablePage(const char *record, size_t size, FileHandle &file_handle, Page &page);
+
+  /**
+   * whether a loaded page has space for an encoded record of `size` bytes, free space map is corrected with what the
+   * page says. a PAX page that doesn't accept the record, or whose null bitmaps would outgrow its space, is left out of
+   * searches for such records until it's modified again
+   */
+  static bool hasSpace(Page &page, const char *record, size_t size);
 
   static inline directory_t entryDirectoryOverheadLength(int fields_num) {
     return sizeof(directory_t) * (fields_num + 2); // one for field_num, one for version
   }
 
   /**
-   * check Rid and load page, if check valid, Page pointer will be returned, otherwise nullptr
+   * check Rid and load page, page is left unloaded if check invalid
    * @param rid
    * @param file_handle
+   * @param page constructed with rid.pageNum
+   * @return true if valid
+   */
+  bool loadPageWithRid(const RID &rid, FileHandle &file_handle, Page &page);
+
+  /**
+   * rewrite packed slot directories of a file older than format version 3 as wide ones. a page that can not make
+   * room for the wider directories forwards its largest records to appended pages, so all RIDs stay valid
+   * @param file_handle
    * @return
    */
-  std::pair<bool, Page *> loadPageWithRid(const RID &rid, FileHandle &file_handle);
+  RC upgradeDirectories(FileHandle &file_handle);
 
   static int inline myStrcmp(const char *s1, const char *s2, int l1, int l2) {
     int min_l = std::min(l1, l2);
@@ -427,10 +1295,20 @@ class RecordBasedFileManager {
     return ret == 0 ? l1 - l2 : ret;
   }
 
+  /**
+   * one instance per type and operator, both are constants so the comparison inlines into it
+   */
+  template<AttrType type, CompOp cmp>
+  static bool compareValues(const void *lhs, const void *rhs);
+
+  template<AttrType type>
+  static Comparator comparatorOf(CompOp cmp);
+
  public:
 
   /**
-   * encode raw data to std::vector<char> which is ready to be inserted into page
+   * encode raw data to std::vector<char> which is ready to be inserted into page, see RecordCodec::encode for a
+   * codec compiled once for many records
    * @param recordDescriptor
    * @param data
    * @param ver
@@ -441,7 +1319,7 @@ class RecordBasedFileManager {
                                                           const directory_t ver);
 
   /**
-   * decode data from record on page
+   * decode data from record on page, see RecordCodec::decode for a codec compiled once for many records
    * @param recordDescriptor
    * @param out
    * @param src
@@ -455,7 +1333,7 @@ class RecordBasedFileManager {
   static RC deserializeRecord(const std::vector<std::vector<Attribute>> &recordDescriptors,
                               void *out,
                               const char *src,
-                              std::vector<std::string> projected_fields,
+                              const std::vector<std::string> &projected_fields,
                               CompOp cmp,
                               const std::string &cond_field,
                               const void *cond_value);
@@ -465,6 +1343,12 @@ class RecordBasedFileManager {
                       const void *val1,
                       const void *val2);
 
+  /**
+   * comparison of a type and an operator, resolved once per scan or filter instead of per record as cmpAttr does
+   * @return nullptr for NO_OP or an unknown type
+   */
+  static Comparator getComparator(AttrType type, CompOp cmp);
+
   static std::vector<bool> parseNullIndicator(const unsigned char *data, unsigned fields_num);
 
   static std::vector<char> makeNullIndicator(const std::vector<bool> &null_indicators);
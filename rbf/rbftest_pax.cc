@@ -0,0 +1,195 @@
+#include <map>
+
+#include "pfm.h"
+#include "rbfm.h"
+#include "test_util.h"
+
+// Prepare record i, some fields are null and the name length changes with `round`
+static int prepareRecordForPax(const std::vector<Attribute> &recordDescriptor, int i, int round, void *buffer) {
+    int nullFieldsIndicatorActualSize = getActualByteForNullsIndicator(recordDescriptor.size());
+    auto *nullsIndicator = (unsigned char *) malloc(nullFieldsIndicatorActualSize);
+    memset(nullsIndicator, 0, nullFieldsIndicatorActualSize);
+    if (i % 5 == 1) nullsIndicator[0] |= (unsigned) 1 << (unsigned) 7;   // EmpName
+    if (i % 7 == 2) nullsIndicator[0] |= (unsigned) 1 << (unsigned) 5;   // Height
+
+    std::string name((i * 7 + round * 11) % 30, (char) ('a' + (i + round) % 26));
+    int recordSize = 0;
+    prepareRecord(recordDescriptor.size(), nullsIndicator, name.size(), name, i, (float) i / 2, i + round,
+                  buffer, &recordSize);
+    free(nullsIndicator);
+    return recordSize;
+}
+
+int RBFTest_pax(RecordBasedFileManager &rbfm) {
+    // Functions tested
+    // 1. Create a LAYOUT_PAX Record-Based File
+    // 2. Insert, update and delete records, then read them back
+    // 3. Vacuum and read them back, also through a RecordView
+    // 4. Projected scan with a condition
+    // The same is done to a LAYOUT_ROW file
+    std::cout << std::endl << "***** In RBF Test Case pax *****" << std::endl;
+
+    const int numRecords = 3000;
+    std::vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    std::vector<RID> rids[2];
+    std::vector<int> rounds(numRecords, 0);
+    std::vector<bool> deleted(numRecords, false);
+    void *record = malloc(PAGE_SIZE);
+    void *returnedData = malloc(PAGE_SIZE);
+
+    const std::string fileNames[2] = {"test_pax_row", "test_pax"};
+    for (int layout = LAYOUT_ROW; layout <= LAYOUT_PAX; ++layout) {
+        std::string fileName = fileNames[layout];
+        RC rc = rbfm.createFile(fileName, PAGE_SIZE, (PageLayout) layout);
+        assert(rc == success && "Creating the file should not fail.");
+        rc = createFileShouldSucceed(fileName);
+        assert(rc == success && "Creating the file should not fail.");
+
+        FileHandle fileHandle;
+        rc = rbfm.openFile(fileName, fileHandle);
+        assert(rc == success && "Opening the file should not fail.");
+
+        for (int i = 0; i < numRecords; ++i) {
+            prepareRecordForPax(recordDescriptor, i, 0, record);
+            RID rid;
+            rc = rbfm.insertRecord(fileHandle, recordDescriptor, record, rid);
+            assert(rc == success && "Inserting a record should not fail.");
+            rids[layout].push_back(rid);
+        }
+
+        // Grow and shrink every 4th record, delete every 9th
+        for (int i = 0; i < numRecords; i += 4) {
+            rounds[i] = i % 8 ? 1 : 2;
+            prepareRecordForPax(recordDescriptor, i, rounds[i], record);
+            rc = rbfm.updateRecord(fileHandle, recordDescriptor, record, rids[layout][i]);
+            assert(rc == success && "Updating a record should not fail.");
+        }
+        for (int i = 3; i < numRecords; i += 9) {
+            rc = rbfm.deleteRecord(fileHandle, recordDescriptor, rids[layout][i]);
+            assert(rc == success && "Deleting a record should not fail.");
+            deleted[i] = true;
+        }
+
+        for (int i = 0; i < numRecords; ++i) {
+            if (deleted[i]) continue;
+            int recordSize = prepareRecordForPax(recordDescriptor, i, rounds[i], record);
+            rc = rbfm.readRecord(fileHandle, recordDescriptor, rids[layout][i], returnedData);
+            assert(rc == success && "Reading a record should not fail.");
+            if (memcmp(record, returnedData, recordSize) != 0) {
+                std::cout << "[Fail] Record " << i << " differs after update. " << std::endl;
+                std::cout << "[Fail] Test Case pax Failed!" << std::endl << std::endl;
+                free(record);
+                free(returnedData);
+                return -1;
+            }
+        }
+
+        std::map<std::pair<unsigned, unsigned>, RID> moved;
+        rc = rbfm.vacuum(fileHandle, [&](const RID &oldRid, const RID &newRid) {
+            moved[std::make_pair(oldRid.pageNum, (unsigned) oldRid.slotNum)] = newRid;
+            return 0;
+        });
+        assert(rc == success && "Vacuum should not fail.");
+        for (auto &rid : rids[layout]) {
+            auto it = moved.find(std::make_pair(rid.pageNum, (unsigned) rid.slotNum));
+            if (it != moved.end()) rid = it->second;
+        }
+
+        rc = rbfm.closeFile(fileHandle);
+        assert(rc == success && "Closing the file should not fail.");
+        rc = rbfm.openFile(fileName, fileHandle);
+        assert(rc == success && "Opening the file should not fail.");
+
+        for (int i = 0; i < numRecords; ++i) {
+            if (deleted[i]) continue;
+            int recordSize = prepareRecordForPax(recordDescriptor, i, rounds[i], record);
+            rc = rbfm.readRecord(fileHandle, recordDescriptor, rids[layout][i], returnedData);
+            assert(rc == success && "Reading a record should not fail.");
+            RecordView view;
+            rc = rbfm.readRecordView(fileHandle, recordDescriptor, rids[layout][i], view);
+            assert(rc == success && "Reading a record view should not fail.");
+            std::vector<char> viewData(view.length());
+            view.copyTo(viewData.data());
+            if (memcmp(record, returnedData, recordSize) != 0 || (int) viewData.size() != recordSize
+                || memcmp(record, viewData.data(), recordSize) != 0) {
+                std::cout << "[Fail] Record " << i << " differs after vacuum. " << std::endl;
+                std::cout << "[Fail] Test Case pax Failed!" << std::endl << std::endl;
+                free(record);
+                free(returnedData);
+                return -1;
+            }
+        }
+
+        // Projected scan with a condition
+        std::map<std::pair<unsigned, unsigned>, int> ids;
+        for (int i = 0; i < numRecords; ++i) {
+            if (!deleted[i]) ids[std::make_pair(rids[layout][i].pageNum, (unsigned) rids[layout][i].slotNum)] = i;
+        }
+        RBFM_ScanIterator rbfmScanIterator;
+        int ageLimit = numRecords / 3;
+        std::vector<std::string> attributeNames = {"Salary", "EmpName"};
+        rc = rbfm.scan(fileHandle, recordDescriptor, "Age", GE_OP, &ageLimit, attributeNames, rbfmScanIterator);
+        assert(rc == success && "Scanning a file should not fail.");
+        RID rid;
+        int count = 0;
+        while (rbfmScanIterator.getNextRecord(rid, returnedData) != RBFM_EOF) {
+            int i = ids.at(std::make_pair(rid.pageNum, (unsigned) rid.slotNum));
+            std::string name((i * 7 + rounds[i] * 11) % 30, (char) ('a' + (i + rounds[i]) % 26));
+            int salary = i + rounds[i];
+            int nameLength = name.size();
+            char *projected = (char *) record;
+            int recordSize = 0;
+            projected[recordSize++] = (char) (i % 5 == 1 ? 1 << 6 : 0);
+            memcpy(projected + recordSize, &salary, sizeof(int));
+            recordSize += sizeof(int);
+            if (i % 5 != 1) {
+                memcpy(projected + recordSize, &nameLength, sizeof(int));
+                recordSize += sizeof(int);
+                memcpy(projected + recordSize, name.data(), nameLength);
+                recordSize += nameLength;
+            }
+            if (i < ageLimit || memcmp(record, returnedData, recordSize) != 0) {
+                std::cout << "[Fail] The scan returns a wrong tuple for record " << i << std::endl;
+                std::cout << "[Fail] Test Case pax Failed!" << std::endl << std::endl;
+                free(record);
+                free(returnedData);
+                return -1;
+            }
+            ++count;
+        }
+        rbfmScanIterator.close();
+        int expected = 0;
+        for (int i = ageLimit; i < numRecords; ++i) expected += !deleted[i];
+        if (count != expected) {
+            std::cout << "[Fail] The scan returns " << count << " tuples, expected " << expected << std::endl;
+            std::cout << "[Fail] Test Case pax Failed!" << std::endl << std::endl;
+            free(record);
+            free(returnedData);
+            return -1;
+        }
+
+        rc = rbfm.closeFile(fileHandle);
+        assert(rc == success && "Closing the file should not fail.");
+        rc = rbfm.destroyFile(fileName);
+        assert(rc == success && "Destroying the file should not fail.");
+        rc = destroyFileShouldSucceed(fileName);
+        assert(rc == success && "Destroying the file should not fail.");
+    }
+
+    free(record);
+    free(returnedData);
+
+    std::cout << "RBF Test Case pax Finished! The result will be examined." << std::endl << std::endl;
+    return success;
+}
+
+int main() {
+    // To test the functionality of the record-based file manager
+    RecordBasedFileManager &rbfm = RecordBasedFileManager::instance();
+
+    remove("test_pax_row");
+    remove("test_pax");
+
+    return RBFTest_pax(rbfm);
+}
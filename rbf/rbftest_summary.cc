@@ -0,0 +1,185 @@
+#include "pfm.h"
+#include "rbfm.h"
+#include "test_util.h"
+
+// Prepare a record whose name has always 8 characters, so that updating it never moves the record
+static void prepareRecordForSummary(const std::vector<Attribute> &recordDescriptor, const std::string &name, int age,
+                                    void *buffer) {
+    int nullFieldsIndicatorActualSize = getActualByteForNullsIndicator(recordDescriptor.size());
+    auto *nullsIndicator = (unsigned char *) malloc(nullFieldsIndicatorActualSize);
+    memset(nullsIndicator, 0, nullFieldsIndicatorActualSize);
+    int recordSize = 0;
+    prepareRecord(recordDescriptor.size(), nullsIndicator, name.size(), name, age, (float) age, age, buffer,
+                  &recordSize);
+    free(nullsIndicator);
+}
+
+static int countMatches(RecordBasedFileManager &rbfm, FileHandle &fileHandle,
+                        const std::vector<Attribute> &recordDescriptor, const std::string &conditionAttribute,
+                        CompOp compOp, const void *value) {
+    RBFM_ScanIterator rbfmScanIterator;
+    RC rc = rbfm.scan(fileHandle, recordDescriptor, conditionAttribute, compOp, value, {"Age"}, rbfmScanIterator);
+    assert(rc == success && "Scanning a file should not fail.");
+    RID rid;
+    char returnedData[PAGE_SIZE];
+    int count = 0;
+    while (rbfmScanIterator.getNextRecord(rid, returnedData) != RBFM_EOF) {
+        ++count;
+    }
+    rbfmScanIterator.close();
+    return count;
+}
+
+static int checkMatches(RecordBasedFileManager &rbfm, FileHandle &fileHandle,
+                        const std::vector<Attribute> &recordDescriptor, int updated, int appended) {
+    int age = 100000;
+    int count = countMatches(rbfm, fileHandle, recordDescriptor, "Age", GE_OP, &age);
+    if (count != updated + appended) {
+        std::cout << "[Fail] The zone map scan returns " << count << " records, expected " << updated + appended
+                  << std::endl;
+        return -1;
+    }
+    std::string names[2] = {"updated!", "appended"};
+    int expected[2] = {updated, appended};
+    for (int k = 0; k < 2; ++k) {
+        char value[PAGE_SIZE];
+        int length = names[k].size();
+        memcpy(value, &length, sizeof(int));
+        memcpy(value + sizeof(int), names[k].data(), length);
+        count = countMatches(rbfm, fileHandle, recordDescriptor, "EmpName", EQ_OP, value);
+        if (count != expected[k]) {
+            std::cout << "[Fail] The Bloom filter scan for " << names[k] << " returns " << count
+                      << " records, expected " << expected[k] << std::endl;
+            return -1;
+        }
+    }
+    return success;
+}
+
+int RBFTest_summary(RecordBasedFileManager &rbfm) {
+    // Functions tested
+    // 1. Create a zone map and a Bloom filter of a file
+    // 2. Update and insert records through a second handle of the file
+    // 3. Scans skipping pages through the first handle, and through a mapped handle, still see all the matches
+    std::cout << std::endl << "***** In RBF Test Case summary *****" << std::endl;
+
+    std::string fileName = "test_summary";
+    RC rc = rbfm.createFile(fileName);
+    assert(rc == success && "Creating the file should not fail.");
+    rc = createFileShouldSucceed(fileName);
+    assert(rc == success && "Creating the file should not fail.");
+
+    FileHandle fileHandle;
+    rc = rbfm.openFile(fileName, fileHandle);
+    assert(rc == success && "Opening the file should not fail.");
+
+    const int numRecords = 2000;
+    const int numAppended = 500;
+    std::vector<Attribute> recordDescriptor;
+    createRecordDescriptor(recordDescriptor);
+    void *record = malloc(PAGE_SIZE);
+    std::vector<RID> rids;
+    for (int i = 0; i < numRecords; ++i) {
+        char name[16];
+        sprintf(name, "name%04d", i);
+        prepareRecordForSummary(recordDescriptor, name, i, record);
+        RID rid;
+        rc = rbfm.insertRecord(fileHandle, recordDescriptor, record, rid);
+        assert(rc == success && "Inserting a record should not fail.");
+        rids.push_back(rid);
+    }
+
+    rc = rbfm.createZoneMap(fileHandle, recordDescriptor, {"EmpName"});
+    assert(rc != success && "Creating a zone map of a VarChar attribute should fail.");
+    rc = rbfm.createZoneMap(fileHandle, recordDescriptor, {"Age"});
+    assert(rc == success && "Creating a zone map should not fail.");
+    rc = rbfm.createBloomFilter(fileHandle, recordDescriptor, {"EmpName"});
+    assert(rc == success && "Creating a Bloom filter should not fail.");
+    rc = checkMatches(rbfm, fileHandle, recordDescriptor, 0, 0);
+    assert(rc == success && "Nothing should match yet.");
+
+    // Handles opened later count the pages on disk
+    rc = rbfm.closeFile(fileHandle);
+    assert(rc == success && "Closing the file should not fail.");
+    rc = rbfm.openFile(fileName, fileHandle);
+    assert(rc == success && "Opening the file should not fail.");
+
+    FileHandle otherHandle, mappedHandle;
+    rc = rbfm.openFile(fileName, otherHandle);
+    assert(rc == success && "Opening the file should not fail.");
+    rc = rbfm.openFile(fileName, mappedHandle, OPEN_MMAP_READ_ONLY);
+    assert(rc == success && "Opening the file should not fail.");
+
+    // Move values of existing pages out of their ranges, and append pages through the other handle
+    int numUpdated = 0;
+    for (int i = 0; i < numRecords; i += 50) {
+        prepareRecordForSummary(recordDescriptor, "updated!", 100000 + i, record);
+        rc = rbfm.updateRecord(otherHandle, recordDescriptor, record, rids[i]);
+        assert(rc == success && "Updating a record should not fail.");
+        ++numUpdated;
+    }
+    rc = checkMatches(rbfm, fileHandle, recordDescriptor, numUpdated, 0);
+    if (rc != success) {
+        std::cout << "[Fail] Test Case summary Failed!" << std::endl << std::endl;
+        free(record);
+        return -1;
+    }
+    for (int i = 0; i < numAppended; ++i) {
+        prepareRecordForSummary(recordDescriptor, "appended", 200000 + i, record);
+        RID rid;
+        rc = rbfm.insertRecord(otherHandle, recordDescriptor, record, rid);
+        assert(rc == success && "Inserting a record should not fail.");
+    }
+    rc = checkMatches(rbfm, otherHandle, recordDescriptor, numUpdated, numAppended);
+    if (rc != success) {
+        std::cout << "[Fail] Test Case summary Failed!" << std::endl << std::endl;
+        free(record);
+        return -1;
+    }
+    free(record);
+
+    // The first handle only counts the pages appended through itself, so it's closed before the other one
+    rc = rbfm.closeFile(fileHandle);
+    assert(rc == success && "Closing the file should not fail.");
+
+    // Pages appended are seen by the mapped handle once written back, while the other handle is still open
+    rc = BufferPool::instance().flushFile(fileName);
+    assert(rc == success && "Writing back the pages should not fail.");
+    rc = checkMatches(rbfm, mappedHandle, recordDescriptor, numUpdated, numAppended);
+    if (rc != success) {
+        std::cout << "[Fail] Test Case summary Failed!" << std::endl << std::endl;
+        return -1;
+    }
+    rc = rbfm.closeFile(otherHandle);
+    assert(rc == success && "Closing the file should not fail.");
+    rc = rbfm.closeFile(mappedHandle);
+    assert(rc == success && "Closing the file should not fail.");
+
+    // The summaries are kept on disk
+    rc = rbfm.openFile(fileName, fileHandle);
+    assert(rc == success && "Opening the file should not fail.");
+    rc = checkMatches(rbfm, fileHandle, recordDescriptor, numUpdated, numAppended);
+    if (rc != success) {
+        std::cout << "[Fail] Test Case summary Failed!" << std::endl << std::endl;
+        return -1;
+    }
+
+    rc = rbfm.closeFile(fileHandle);
+    assert(rc == success && "Closing the file should not fail.");
+    rc = rbfm.destroyFile(fileName);
+    assert(rc == success && "Destroying the file should not fail.");
+    rc = destroyFileShouldSucceed(fileName);
+    assert(rc == success && "Destroying the file should not fail.");
+
+    std::cout << "RBF Test Case summary Finished! The result will be examined." << std::endl << std::endl;
+    return success;
+}
+
+int main() {
+    // To test the functionality of the record-based file manager
+    RecordBasedFileManager &rbfm = RecordBasedFileManager::instance();
+
+    remove("test_summary");
+
+    return RBFTest_summary(rbfm);
+}
@@ -7,6 +7,7 @@ const int RelationManager::SYSTEM_FLAG = 1;
 const std::string RelationManager::DEFAULT_DB_DIR_ = "./db_files/";
 const std::string RelationManager::TABLE_CATALOG_NAME_ = "Tables";
 const std::string RelationManager::COLUMN_CATALOG_NAME_ = "Columns";
+const std::string RelationManager::LOG_FILE_NAME_ = "wal.log";
 const std::vector<Attribute> RelationManager::TABLE_CATALOG_DESC_ = {{"table-id", AttrType::TypeInt, 4},
                                                                      {"table-name", AttrType::TypeVarChar, 50},
                                                                      {"file-name", AttrType::TypeVarChar, 50},
@@ -42,6 +43,7 @@ RC RelationManager::createCatalog() {
   if (ifDBExists()) {
     return -1;
   }
+  LogManager::instance().open(DEFAULT_DB_DIR_ + LOG_FILE_NAME_);
 
   rbfm_->createFile(getTableFileName(TABLE_CATALOG_NAME_, true));
   rbfm_->createFile(getTableFileName(COLUMN_CATALOG_NAME_, true));
@@ -72,14 +74,20 @@ RC RelationManager::deleteCatalog() {
   table_ids_.clear();
   system_tables_.clear();
   max_tid_ = -1;
+  LogManager::instance().close();
+  remove((DEFAULT_DB_DIR_ + LOG_FILE_NAME_).c_str());
   return 0;
 }
 
-RC RelationManager::createTable(const std::string &tableName, const std::vector<Attribute> &attrs) {
+RC RelationManager::createTable(const std::string &tableName,
+                                const std::vector<Attribute> &attrs,
+                                size_t pageSize,
+                                PageLayout layout) {
   loadDbIfExist();
   if (!ifDBExists() || ifTableExists(tableName)) return -1;
   if (system_tables_.count(tableName)) return -1;
-  return createTableImpl(tableName, attrs);
+  if (!PageIO::isValidPageSize(pageSize)) return -1;
+  return createTableImpl(tableName, attrs, false, pageSize, layout);
 }
 
 RC RelationManager::deleteTable(const std::string &tableName) {
@@ -155,6 +163,8 @@ RC RelationManager::insertTupleImpl(const std::string &tableName, const void *da
   const auto &table_file = table_files_.at(tableName);
   const auto &recordDescriptor = table_schema_.at(tableName).back();
   directory_t cur_ver = table_schema_.at(tableName).size() - 1;
+  // record and its index entries are committed as one group
+  LogScope log_scope;
   FileHandle fh;
   rbfm_->openFile(table_file, fh);
   RC ret = rbfm_->insertRecordImpl(fh, recordDescriptor, data, rid, cur_ver);
@@ -189,12 +199,13 @@ RC RelationManager::deleteTupleImpl(const std::string &tableName, const RID &rid
   if (!ifDBExists() || !ifTableExists(tableName)) return -1;
   const auto &table_file = table_files_.at(tableName);
   const auto &recordDescriptor = table_schema_.at(tableName).back(); // actually we don't need schema when deleting
+  LogScope log_scope;
   FileHandle fh;
   RC ret = rbfm_->openFile(table_file, fh);
   // update b+ tree
   if (table_index_.count(tableName)) {
     IndexManager &im = IndexManager::instance();
-    char buffer[PAGE_SIZE];
+    char buffer[MAX_PAGE_SIZE];
     ret += readTuple(tableName, rid, buffer); // read data to parse key
     for (auto &index : table_index_.at(tableName)) {
       IXFileHandle ixfh;
@@ -223,6 +234,7 @@ RC RelationManager::updateTupleImpl(const std::string &tableName, const void *da
   }
   if (!ifDBExists() || !ifTableExists(tableName)) return -1;
   const auto &table_file = table_files_.at(tableName);
+  LogScope log_scope;
   // when update, we don't need old schema, we only need to calculate the old size
   const auto &recordDescriptor = table_schema_.at(tableName).back();
   directory_t cur_ver = table_schema_.at(tableName).size() - 1;
@@ -231,7 +243,7 @@ RC RelationManager::updateTupleImpl(const std::string &tableName, const void *da
   // update b+ tree
   if (table_index_.count(tableName)) {
     IndexManager &im = IndexManager::instance();
-    char buffer[PAGE_SIZE];
+    char buffer[MAX_PAGE_SIZE];
     ret += readTuple(tableName, rid, buffer); // read data to parse key
     for (auto &index : table_index_.at(tableName)) {
       IXFileHandle ixfh;
@@ -251,6 +263,90 @@ RC RelationManager::updateTupleImpl(const std::string &tableName, const void *da
   return ret;
 }
 
+RC RelationManager::vacuum(const std::string &tableName) {
+  loadDbIfExist();
+  if (!ifDBExists() || !ifTableExists(tableName)) return -1;
+  if (system_tables_.count(tableName)) {
+    DB_ERROR << "Not allowed to vacuum system table " << tableName;
+    return -1;
+  }
+  const auto &table_file = table_files_.at(tableName);
+  const auto &recordDescriptors = table_schema_.at(tableName);
+  FileHandle fh;
+  if (rbfm_->openFile(table_file, fh)) return -1;
+  std::function<RC(const RID &, const RID &)> on_move;
+  if (table_index_.count(tableName)) {
+    on_move = [&](const RID &old_rid, const RID &new_rid) {
+      // read through the handle being vacuumed, another one wouldn't see pages it appended yet
+      IndexManager &im = IndexManager::instance();
+      char buffer[MAX_PAGE_SIZE];
+      RC ret = rbfm_->readRecordImpl(fh, recordDescriptors, new_rid, buffer, {});
+      if (ret) return ret;
+      auto &curr_schema = recordDescriptors.back();
+      for (auto &index : table_index_.at(tableName)) {
+        IXFileHandle ixfh;
+        im.openFile(getIndexFileName(tableName, index.first), ixfh);
+        char *key = buffer + RecordBasedFileManager::getFieldOffset(curr_schema, buffer, index.second);
+        ret += im.deleteEntry(ixfh, curr_schema.at(index.second), key, old_rid);
+        ret += im.insertEntry(ixfh, curr_schema.at(index.second), key, new_rid);
+        im.closeFile(ixfh);
+      }
+      return ret;
+    };
+  }
+  RC ret = rbfm_->vacuum(fh, on_move);
+  ret += rbfm_->closeFile(fh);
+  return ret;
+}
+
+RC RelationManager::createZoneMap(const std::string &tableName, const std::vector<std::string> &attributeNames) {
+  loadDbIfExist();
+  if (!ifDBExists() || !ifTableExists(tableName)) return -1;
+  if (system_tables_.count(tableName)) {
+    DB_ERROR << "Not allowed to create zone map of system table " << tableName;
+    return -1;
+  }
+  FileHandle fh;
+  if (rbfm_->openFile(table_files_.at(tableName), fh)) return -1;
+  RC ret = rbfm_->createZoneMapImpl(fh, table_schema_.at(tableName), attributeNames);
+  ret += rbfm_->closeFile(fh);
+  return ret;
+}
+
+RC RelationManager::destroyZoneMap(const std::string &tableName) {
+  loadDbIfExist();
+  if (!ifDBExists() || !ifTableExists(tableName)) return -1;
+  FileHandle fh;
+  if (rbfm_->openFile(table_files_.at(tableName), fh)) return -1;
+  RC ret = rbfm_->destroyZoneMap(fh);
+  ret += rbfm_->closeFile(fh);
+  return ret;
+}
+
+RC RelationManager::createBloomFilter(const std::string &tableName, const std::vector<std::string> &attributeNames) {
+  loadDbIfExist();
+  if (!ifDBExists() || !ifTableExists(tableName)) return -1;
+  if (system_tables_.count(tableName)) {
+    DB_ERROR << "Not allowed to create Bloom filter of system table " << tableName;
+    return -1;
+  }
+  FileHandle fh;
+  if (rbfm_->openFile(table_files_.at(tableName), fh)) return -1;
+  RC ret = rbfm_->createBloomFilterImpl(fh, table_schema_.at(tableName), attributeNames);
+  ret += rbfm_->closeFile(fh);
+  return ret;
+}
+
+RC RelationManager::destroyBloomFilter(const std::string &tableName) {
+  loadDbIfExist();
+  if (!ifDBExists() || !ifTableExists(tableName)) return -1;
+  FileHandle fh;
+  if (rbfm_->openFile(table_files_.at(tableName), fh)) return -1;
+  RC ret = rbfm_->destroyBloomFilter(fh);
+  ret += rbfm_->closeFile(fh);
+  return ret;
+}
+
 RC RelationManager::readTuple(const std::string &tableName, const RID &rid, void *data) {
   loadDbIfExist();
   if (!ifDBExists() || !ifTableExists(tableName)) return -1;
@@ -286,25 +382,36 @@ RC RelationManager::scan(const std::string &tableName,
                          const void *value,
                          const std::vector<std::string> &attributeNames,
                          RM_ScanIterator &rm_ScanIterator) {
+  ScanCondition condition;
+  if (compOp != CompOp::NO_OP) condition.conjuncts.push_back({conditionAttribute, compOp, value});
+  return scan(tableName, condition, attributeNames, rm_ScanIterator);
+}
+
+RC RelationManager::scan(const std::string &tableName,
+                         const ScanCondition &condition,
+                         const std::vector<std::string> &attributeNames,
+                         RM_ScanIterator &rm_ScanIterator) {
   loadDbIfExist();
   if (!ifDBExists() || !ifTableExists(tableName)) return -1;
   const auto &table_file = table_files_.at(tableName);
   const auto &schemas = table_schema_.at(tableName);
   const std::vector<Attribute> &cur_schema = schemas.back();
-  if (compOp != CompOp::NO_OP
-      && std::find_if(cur_schema.begin(), cur_schema.end(), [&](const Attribute &attr) {
-        return attr.name == conditionAttribute;
-      }) == cur_schema.end()) {
-    DB_ERROR << "Condition attribute `" << conditionAttribute << "` not found in table `" << tableName << "`";
-    return -1;
+  for (auto *predicates : {&condition.conjuncts, &condition.disjuncts}) {
+    for (auto &predicate : *predicates) {
+      if (predicate.op != CompOp::NO_OP
+          && std::find_if(cur_schema.begin(), cur_schema.end(), [&](const Attribute &attr) {
+            return attr.name == predicate.attribute;
+          }) == cur_schema.end()) {
+        DB_ERROR << "Condition attribute `" << predicate.attribute << "` not found in table `" << tableName << "`";
+        return -1;
+      }
+    }
   }
   rbfm_->openFile(table_file, rm_ScanIterator.file_handle_);
   RC ret = rm_ScanIterator.rbfm_scan_iterator_.init(rm_ScanIterator.file_handle_,
                                                     rbfm_,
                                                     schemas,
-                                                    conditionAttribute,
-                                                    compOp,
-                                                    value,
+                                                    condition,
                                                     attributeNames);
 
   return ret;
@@ -349,10 +456,11 @@ RC RelationManager::addAttribute(const std::string &tableName, const Attribute &
 }
 
 // QE IX related
-RC RelationManager::createIndex(const std::string &tableName, const std::string &attributeName) {
+RC RelationManager::createIndex(const std::string &tableName, const std::string &attributeName, size_t pageSize) {
   loadDbIfExist();
   if (!ifDBExists() || !ifTableExists(tableName)) return -1;
   if (system_tables_.count(tableName)) return -1;
+  if (!PageIO::isValidPageSize(pageSize)) return -1;
   std::vector<Attribute> &cur_schema = table_schema_[tableName].back();
   auto attr_it = std::find_if(cur_schema.begin(),
                            cur_schema.end(),
@@ -373,7 +481,7 @@ RC RelationManager::createIndex(const std::string &tableName, const std::string
   memcpy(attr_name_buf + sizeof(int), attributeName.data(), attributeName.size());
   if (scan(COLUMN_CATALOG_NAME_, "table-id", CompOp::EQ_OP, &tid, {"column-name", "column-position"}, rm_it)) return -1;
   RID rid{INVALID_PID, 0};
-  char tuple[PAGE_SIZE];
+  char tuple[MAX_PAGE_SIZE];
   while (!rm_it.getNextTuple(rid, tuple)) {
     if (RecordBasedFileManager::cmpAttr(CompOp::EQ_OP,
                                         AttrType::TypeVarChar,
@@ -396,7 +504,7 @@ RC RelationManager::createIndex(const std::string &tableName, const std::string
   auto new_entry = makeColumnRecord(tableName, pos, table_schema_[tableName].size() - 1, *attr_it, true);
   if (updateTupleImpl(COLUMN_CATALOG_NAME_, new_entry.data(), rid, true)) return -1;
   // create index file
-  auto res = IndexManager::instance().createFile(getIndexFileName(tableName, attributeName));
+  auto res = IndexManager::instance().createFile(getIndexFileName(tableName, attributeName), pageSize);
   table_index_[tableName][attributeName] = pos;
 
   // dump current data into index file
@@ -482,7 +590,9 @@ RC RelationManager::indexScan(const std::string &tableName,
 
 RC RelationManager::createTableImpl(const std::string &tableName,
                                     const std::vector<Attribute> &attrs,
-                                    bool is_system_table) {
+                                    bool is_system_table,
+                                    size_t page_size,
+                                    PageLayout layout) {
   directory_t ver = 0; // by default, system table will always has one version
   if (!is_system_table) {
     // for system table, these must be created before hand
@@ -494,7 +604,7 @@ RC RelationManager::createTableImpl(const std::string &tableName,
     table_schema_[tableName].push_back(attrs);
     if (!ver) {
       table_files_[tableName] = getTableFileName(tableName, is_system_table);
-      rbfm_->createFile(table_files_[tableName]);
+      rbfm_->createFile(table_files_[tableName], page_size, layout);
       table_ids_[tableName] = ++max_tid_;
       DB_DEBUG << "Create table `" << tableName << "` with tid " << max_tid_;
     }
@@ -745,15 +855,27 @@ void RelationManager::printTables() {
 }
 
 RC RM_ScanIterator::close() {
-  int ret = file_handle_.closeFile();
-  if (ret) return ret;
-  return rbfm_scan_iterator_.close();
+  // page being scanned is unpinned before its file is closed
+  rbfm_scan_iterator_.close();
+  return file_handle_.closeFile();
 }
 
 RC RM_ScanIterator::getNextTuple(RID &rid, void *data) {
   return rbfm_scan_iterator_.getNextRecord(rid, data);
 }
 
+RC RM_ScanIterator::getNextTupleView(RID &rid, RecordView &view) {
+  return rbfm_scan_iterator_.getNextRecordView(rid, view);
+}
+
+RC RM_ScanIterator::getNextTuples(void *data,
+                                  size_t capacity,
+                                  unsigned maxTuples,
+                                  std::vector<RID> &rids,
+                                  std::vector<size_t> &offsets) {
+  return rbfm_scan_iterator_.getNextRecords(data, capacity, maxTuples, rids, offsets);
+}
+
 RC RM_IndexScanIterator::init(const std::string &indexFileName,
                               const Attribute &attribute,
                               const void *lowKey,
@@ -9,6 +9,7 @@
 #include "../ix/ix.h"
 
 # define RM_EOF (-1)  // end of a scan operator
+# define RM_BUFFER_TOO_SMALL RBFM_BUFFER_TOO_SMALL  // see getNextTuples
 
 // RM_ScanIterator is an iterator to go through tuples
 class RM_ScanIterator {
@@ -21,6 +22,18 @@ class RM_ScanIterator {
   // "data" follows the same format as RelationManager::insertTuple()
   RC getNextTuple(RID &rid, void *data);
 
+  // bind `view` to the tuple on its page instead of copying it, see RecordView
+  RC getNextTupleView(RID &rid, RecordView &view);
+
+  // up to `maxTuples` tuples of the page being scanned at once, see RBFM_ScanIterator::getNextRecords. `capacity`
+  // has to hold the largest projected tuple: the null indicator, 4 bytes for each Int or Real and 4 + length for each
+  // VarChar attribute, otherwise RM_BUFFER_TOO_SMALL is returned
+  RC getNextTuples(void *data,
+                   size_t capacity,
+                   unsigned maxTuples,
+                   std::vector<RID> &rids,
+                   std::vector<size_t> &offsets);
+
   RC close();
 
  private:
@@ -60,7 +73,12 @@ class RelationManager {
 
   RC deleteCatalog();
 
-  RC createTable(const std::string &tableName, const std::vector<Attribute> &attrs);
+  // pageSize is fixed for the lifetime of table, larger pages fit wider rows. so is layout, LAYOUT_PAX suits scans
+  // reading a few columns of a wide table
+  RC createTable(const std::string &tableName,
+                 const std::vector<Attribute> &attrs,
+                 size_t pageSize = PAGE_SIZE,
+                 PageLayout layout = LAYOUT_ROW);
 
   RC deleteTable(const std::string &tableName);
 
@@ -72,6 +90,22 @@ class RelationManager {
 
   RC updateTuple(const std::string &tableName, const void *data, const RID &rid);
 
+  // Bring forwarded tuples home and shrink the table file, see RecordBasedFileManager::vacuum. index entries of a
+  // tuple that gets a new RID are moved along
+  RC vacuum(const std::string &tableName);
+
+  // Keep min and max of Int or Real attributes for every page of the table, so that scans comparing them skip pages,
+  // see RecordBasedFileManager::createZoneMap. an existing zone map of the table is replaced
+  RC createZoneMap(const std::string &tableName, const std::vector<std::string> &attributeNames);
+
+  RC destroyZoneMap(const std::string &tableName);
+
+  // Keep a Bloom filter of attributes of any type for every page of the table, so that scans with an equality on them
+  // skip pages, see RecordBasedFileManager::createBloomFilter. an existing Bloom filter of the table is replaced
+  RC createBloomFilter(const std::string &tableName, const std::vector<std::string> &attributeNames);
+
+  RC destroyBloomFilter(const std::string &tableName);
+
   RC readTuple(const std::string &tableName, const RID &rid, void *data);
 
   // Print a tuple that is passed to this utility method.
@@ -89,13 +123,19 @@ class RelationManager {
           const std::vector<std::string> &attributeNames, // a list of projected attributes
           RM_ScanIterator &rm_ScanIterator);
 
+  // Same as above, filtered by several predicates, see ScanCondition. every predicate attribute must be in the table
+  RC scan(const std::string &tableName,
+          const ScanCondition &condition,
+          const std::vector<std::string> &attributeNames,
+          RM_ScanIterator &rm_ScanIterator);
+
 // Extra credit work (10 points)
   RC addAttribute(const std::string &tableName, const Attribute &attr);
 
   RC dropAttribute(const std::string &tableName, const std::string &attributeName);
 
   // QE IX related
-  RC createIndex(const std::string &tableName, const std::string &attributeName);
+  RC createIndex(const std::string &tableName, const std::string &attributeName, size_t pageSize = PAGE_SIZE);
 
   RC destroyIndex(const std::string &tableName, const std::string &attributeName);
 
@@ -123,6 +163,7 @@ class RelationManager {
 
   static const std::string TABLE_CATALOG_NAME_;
   static const std::string COLUMN_CATALOG_NAME_;
+  static const std::string LOG_FILE_NAME_; // write-ahead log of the DB, in DEFAULT_DB_DIR_
   static const std::vector<Attribute> TABLE_CATALOG_DESC_;
   static const std::vector<Attribute> COLUMN_CATALOG_DESC_;
   RecordBasedFileManager *rbfm_;
@@ -149,7 +190,11 @@ class RelationManager {
   static std::string inline getTableFileName(const std::string &tableName, bool is_system_table);
   static std::string inline getIndexFileName(const std::string &tableName, const std::string &attrName);
 
-  RC createTableImpl(const std::string &tableName, const std::vector<Attribute> &attrs, bool is_system_table = false);
+  RC createTableImpl(const std::string &tableName,
+                     const std::vector<Attribute> &attrs,
+                     bool is_system_table = false,
+                     size_t page_size = PAGE_SIZE,
+                     PageLayout layout = LAYOUT_ROW);
 
   RC insertTupleImpl(const std::string &tableName, const void *data, RID &rid, bool is_system = false);
 
@@ -193,6 +238,8 @@ void RelationManager::loadDbIfExist() {
       PagedFileManager::ifFileExists(getTableFileName(TABLE_CATALOG_NAME_, true)) &&
       PagedFileManager::ifFileExists(getTableFileName(COLUMN_CATALOG_NAME_, true))) {
 //    DB_INFO << "loading existing DB..";
+    // redo what a crash left in the log before anything is read
+    LogManager::instance().open(DEFAULT_DB_DIR_ + LOG_FILE_NAME_);
     parseCatalog();
     init_ = true;
   }
@@ -0,0 +1,152 @@
+#include "rm_test_util.h"
+
+// Tuple i of the test, projected to Age and EmpName when `projected` is set
+static void prepareTupleForBatch(int i, bool projected, void *tuple, int *tupleSize) {
+    std::string name(i % 31, (char) ('a' + i % 26));
+    if (!projected) {
+        int nullAttributesIndicatorActualSize = getActualByteForNullsIndicator(4);
+        auto *nullsIndicator = (unsigned char *) malloc(nullAttributesIndicatorActualSize);
+        memset(nullsIndicator, 0, nullAttributesIndicatorActualSize);
+        unsigned size = 0;
+        prepareTuple(4, nullsIndicator, name.size(), name, i, (float) i, i * 10, tuple, &size);
+        *tupleSize = size;
+        free(nullsIndicator);
+        return;
+    }
+    int offset = 0;
+    int nameLength = name.size();
+    *((char *) tuple) = 0;
+    offset += 1;
+    memcpy((char *) tuple + offset, &i, sizeof(int));
+    offset += sizeof(int);
+    memcpy((char *) tuple + offset, &nameLength, sizeof(int));
+    offset += sizeof(int);
+    memcpy((char *) tuple + offset, name.data(), nameLength);
+    offset += nameLength;
+    *tupleSize = offset;
+}
+
+int TEST_RM_batch(const std::string &tableName) {
+    // Functions Tested
+    // 1. Scan a table in batches of tuples, with several buffer sizes and batch sizes
+    // 2. Every batch has the same tuples, in the same order, as getNextTuple()
+    // 3. A buffer that can't hold the largest projected tuple is refused
+    std::cout << std::endl << "***** In RM Test Case batch *****" << std::endl;
+
+    rm.deleteTable(tableName);
+    rm.deleteCatalog();
+    RC rc = rm.createCatalog();
+    assert(rc == success && "Creating the Catalog should not fail.");
+    rc = createTable(tableName);
+    assert(rc == success && "Creating a table should not fail.");
+
+    const int numTuples = 2000;
+    void *tuple = malloc(PAGE_SIZE);
+    void *returnedData = malloc(PAGE_SIZE);
+    int tupleSize = 0;
+    std::vector<RID> rids;
+    for (int i = 0; i < numTuples; ++i) {
+        RID rid;
+        prepareTupleForBatch(i, false, tuple, &tupleSize);
+        rc = rm.insertTuple(tableName, tuple, rid);
+        assert(rc == success && "rm::insertTuple() should not fail.");
+        rids.push_back(rid);
+    }
+    // Deleted tuples leave holes in the batches
+    for (int i = 0; i < numTuples; i += 7) {
+        rc = rm.deleteTuple(tableName, rids[i]);
+        assert(rc == success && "rm::deleteTuple() should not fail.");
+    }
+
+    int age = numTuples / 4;
+    std::vector<std::string> attributes = {"Age", "EmpName"};
+    // the null indicator, Age, and the length and characters of EmpName
+    const size_t largestTuple = 1 + sizeof(int) + sizeof(int) + 30;
+    const size_t capacities[] = {largestTuple, 200, PAGE_SIZE};
+    const unsigned batchSizes[] = {1, 5, 1000};
+    std::vector<char> batch(PAGE_SIZE);
+    std::vector<RID> batchRids;
+    std::vector<size_t> offsets;
+    for (size_t capacity : capacities) {
+        for (unsigned maxTuples : batchSizes) {
+            RM_ScanIterator rmsi, rmsiBatch;
+            rc = rm.scan(tableName, "Age", GE_OP, &age, attributes, rmsi);
+            assert(rc == success && "rm::scan() should not fail.");
+            rc = rm.scan(tableName, "Age", GE_OP, &age, attributes, rmsiBatch);
+            assert(rc == success && "rm::scan() should not fail.");
+            int count = 0;
+            RID rid;
+            while (rmsiBatch.getNextTuples(batch.data(), capacity, maxTuples, batchRids, offsets) != RM_EOF) {
+                if (batchRids.empty() || batchRids.size() > maxTuples || batchRids.size() != offsets.size()) {
+                    std::cout << "[Fail] A batch has " << batchRids.size() << " tuples and " << offsets.size()
+                              << " offsets, at most " << maxTuples << " are asked for." << std::endl;
+                    std::cout << "***** [FAIL] Test Case batch Failed *****" << std::endl << std::endl;
+                    free(tuple);
+                    free(returnedData);
+                    return -1;
+                }
+                for (size_t k = 0; k < batchRids.size(); ++k) {
+                    rc = rmsi.getNextTuple(rid, returnedData);
+                    assert(rc == success && "rm::getNextTuple() should not fail.");
+                    int key;
+                    memcpy(&key, (char *) returnedData + 1, sizeof(int));
+                    prepareTupleForBatch(key, true, tuple, &tupleSize);
+                    if (rid.pageNum != batchRids[k].pageNum || rid.slotNum != batchRids[k].slotNum
+                        || offsets[k] + tupleSize > capacity
+                        || memcmp(tuple, returnedData, tupleSize) != 0
+                        || memcmp(tuple, batch.data() + offsets[k], tupleSize) != 0) {
+                        std::cout << "[Fail] The batch differs from getNextTuple() at tuple " << count
+                                  << ", capacity " << capacity << ", batch size " << maxTuples << std::endl;
+                        std::cout << "***** [FAIL] Test Case batch Failed *****" << std::endl << std::endl;
+                        free(tuple);
+                        free(returnedData);
+                        return -1;
+                    }
+                    ++count;
+                }
+            }
+            if (rmsi.getNextTuple(rid, returnedData) != RM_EOF) {
+                std::cout << "[Fail] The batches end before getNextTuple() does, capacity " << capacity
+                          << ", batch size " << maxTuples << std::endl;
+                std::cout << "***** [FAIL] Test Case batch Failed *****" << std::endl << std::endl;
+                free(tuple);
+                free(returnedData);
+                return -1;
+            }
+            rmsi.close();
+            rmsiBatch.close();
+
+            int expected = 0;
+            for (int i = age; i < numTuples; ++i) expected += i % 7 != 0;
+            if (count != expected) {
+                std::cout << "[Fail] The batches have " << count << " tuples, expected " << expected << std::endl;
+                std::cout << "***** [FAIL] Test Case batch Failed *****" << std::endl << std::endl;
+                free(tuple);
+                free(returnedData);
+                return -1;
+            }
+        }
+    }
+    free(tuple);
+    free(returnedData);
+
+    RM_ScanIterator rmsi;
+    rc = rm.scan(tableName, "Age", GE_OP, &age, attributes, rmsi);
+    assert(rc == success && "rm::scan() should not fail.");
+    rc = rmsi.getNextTuples(batch.data(), largestTuple - 1, 10, batchRids, offsets);
+    assert(rc == RM_BUFFER_TOO_SMALL && "A buffer smaller than the largest tuple should be refused.");
+    assert(batchRids.empty() && "Nothing should be returned in a buffer too small.");
+    rmsi.close();
+
+    rc = rm.deleteTable(tableName);
+    assert(rc == success && "Deleting a table should not fail.");
+    rc = rm.deleteCatalog();
+    assert(rc == success && "Deleting the Catalog should not fail.");
+
+    std::cout << "***** RM Test Case batch finished. The result will be examined. *****" << std::endl << std::endl;
+    return success;
+}
+
+int main() {
+    return TEST_RM_batch("tbl_batch");
+}
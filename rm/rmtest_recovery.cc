@@ -0,0 +1,194 @@
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "rm_test_util.h"
+
+// Tuple i of the workload, `updated` ones have a longer name
+static void prepareTupleForRecovery(int i, bool updated, void *tuple, int *tupleSize) {
+    int nullAttributesIndicatorActualSize = getActualByteForNullsIndicator(4);
+    auto *nullsIndicator = (unsigned char *) malloc(nullAttributesIndicatorActualSize);
+    memset(nullsIndicator, 0, nullAttributesIndicatorActualSize);
+    std::string name(updated ? 30 : i % 20 + 1, (char) ('a' + i % 26));
+    unsigned size = 0;
+    prepareTuple(4, nullsIndicator, name.size(), name, i, (float) i, i * 10, tuple, &size);
+    *tupleSize = size;
+    free(nullsIndicator);
+}
+
+// deleteTable() leaves the index files of the table behind
+static std::string indexFileName(const std::string &tableName) {
+    return "db_files/" + tableName + "_Age.idx";
+}
+
+static bool isDeleted(int i) {
+    return i % 9 == 3;
+}
+
+static bool isUpdated(int i) {
+    return i % 4 == 0;
+}
+
+// Run the workload and crash, nothing is closed and dirty pages are never written back
+static void runAndCrash(const std::string &tableName, int numTuples) {
+    // a few frames, so that some pages are written back before the crash
+    BufferPool::instance().setCapacity(8);
+
+    rm.deleteTable(tableName);
+    rm.deleteCatalog();
+    remove(indexFileName(tableName).c_str());
+    RC rc = rm.createCatalog();
+    assert(rc == success && "Creating the Catalog should not fail.");
+    rc = createTable(tableName);
+    assert(rc == success && "Creating a table should not fail.");
+    rc = rm.createIndex(tableName, "Age");
+    assert(rc == success && "Creating an index should not fail.");
+    rc = rm.createZoneMap(tableName, {"Age"});
+    assert(rc == success && "Creating a zone map should not fail.");
+    rc = rm.createBloomFilter(tableName, {"EmpName"});
+    assert(rc == success && "Creating a Bloom filter should not fail.");
+
+    void *tuple = malloc(PAGE_SIZE);
+    int tupleSize = 0;
+    std::vector<RID> rids;
+    for (int i = 0; i < numTuples; ++i) {
+        RID rid;
+        prepareTupleForRecovery(i, false, tuple, &tupleSize);
+        rc = rm.insertTuple(tableName, tuple, rid);
+        assert(rc == success && "rm::insertTuple() should not fail.");
+        rids.push_back(rid);
+    }
+    for (int i = 0; i < numTuples; ++i) {
+        if (isUpdated(i)) {
+            prepareTupleForRecovery(i, true, tuple, &tupleSize);
+            rc = rm.updateTuple(tableName, tuple, rids[i]);
+            assert(rc == success && "rm::updateTuple() should not fail.");
+        }
+        if (isDeleted(i)) {
+            rc = rm.deleteTuple(tableName, rids[i]);
+            assert(rc == success && "rm::deleteTuple() should not fail.");
+        }
+    }
+    writeRIDsToDisk(rids);
+    free(tuple);
+    _exit(success);
+}
+
+int TEST_RM_recovery(const std::string &tableName) {
+    // Functions Tested
+    // 1. Insert, update and delete tuples of a table with an index, a zone map and a Bloom filter
+    // 2. Crash without closing anything
+    // 3. Replay the log on the next start, every committed change is there, in the index and summaries too
+    std::cout << std::endl << "***** In RM Test Case recovery *****" << std::endl;
+
+    const int numTuples = 3000;
+    pid_t pid = fork();
+    assert(pid >= 0 && "fork() should not fail.");
+    if (pid == 0) {
+        runAndCrash(tableName, numTuples);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != success) {
+        std::cout << "[Fail] The workload failed before the crash." << std::endl;
+        std::cout << "***** [FAIL] Test Case recovery Failed *****" << std::endl << std::endl;
+        return -1;
+    }
+
+    std::vector<RID> rids;
+    readRIDsFromDisk(rids, numTuples);
+    void *tuple = malloc(PAGE_SIZE);
+    void *returnedData = malloc(PAGE_SIZE);
+    int tupleSize = 0;
+    int numLive = 0;
+    for (int i = 0; i < numTuples; ++i) {
+        RC rc = rm.readTuple(tableName, rids[i], returnedData);
+        if (isDeleted(i)) {
+            if (rc == success) {
+                std::cout << "[Fail] Tuple " << i << " deleted before the crash is back." << std::endl;
+                std::cout << "***** [FAIL] Test Case recovery Failed *****" << std::endl << std::endl;
+                free(tuple);
+                free(returnedData);
+                return -1;
+            }
+            continue;
+        }
+        ++numLive;
+        prepareTupleForRecovery(i, isUpdated(i), tuple, &tupleSize);
+        if (rc != success || memcmp(tuple, returnedData, tupleSize) != 0) {
+            std::cout << "[Fail] Tuple " << i << " is lost or differs after the crash." << std::endl;
+            std::cout << "***** [FAIL] Test Case recovery Failed *****" << std::endl << std::endl;
+            free(tuple);
+            free(returnedData);
+            return -1;
+        }
+    }
+
+    // The same tuples through a full scan, the index, the zone map and the Bloom filter
+    RID rid;
+    RM_ScanIterator rmsi;
+    int age = numTuples / 2;
+    int counts[4] = {0, 0, 0, 0};
+    RC rc = rm.scan(tableName, "", NO_OP, nullptr, {"Age"}, rmsi);
+    assert(rc == success && "rm::scan() should not fail.");
+    while (rmsi.getNextTuple(rid, returnedData) != RM_EOF) ++counts[0];
+    rmsi.close();
+    RM_IndexScanIterator rmisi;
+    rc = rm.indexScan(tableName, "Age", nullptr, nullptr, true, true, rmisi);
+    assert(rc == success && "rm::indexScan() should not fail.");
+    while (rmisi.getNextEntry(rid, returnedData) != RM_EOF) ++counts[1];
+    rmisi.close();
+    rc = rm.scan(tableName, "Age", GE_OP, &age, {"Age"}, rmsi);
+    assert(rc == success && "rm::scan() should not fail.");
+    while (rmsi.getNextTuple(rid, returnedData) != RM_EOF) ++counts[2];
+    rmsi.close();
+    std::string name(30, 'a');
+    int nameLength = name.size();
+    memcpy(tuple, &nameLength, sizeof(int));
+    memcpy((char *) tuple + sizeof(int), name.data(), nameLength);
+    rc = rm.scan(tableName, "EmpName", EQ_OP, tuple, {"Age"}, rmsi);
+    assert(rc == success && "rm::scan() should not fail.");
+    while (rmsi.getNextTuple(rid, returnedData) != RM_EOF) ++counts[3];
+    rmsi.close();
+
+    int expected[4] = {numLive, numLive, 0, 0};
+    for (int i = 0; i < numTuples; ++i) {
+        if (isDeleted(i)) continue;
+        expected[2] += i >= age;
+        expected[3] += isUpdated(i) && i % 26 == 0;
+    }
+    for (int k = 0; k < 4; ++k) {
+        if (counts[k] != expected[k]) {
+            std::cout << "[Fail] Scan " << k << " returns " << counts[k] << " tuples, expected " << expected[k]
+                      << std::endl;
+            std::cout << "***** [FAIL] Test Case recovery Failed *****" << std::endl << std::endl;
+            free(tuple);
+            free(returnedData);
+            return -1;
+        }
+    }
+
+    // Still writable
+    prepareTupleForRecovery(numTuples, false, tuple, &tupleSize);
+    rc = rm.insertTuple(tableName, tuple, rid);
+    assert(rc == success && "rm::insertTuple() should not fail.");
+    rc = rm.readTuple(tableName, rid, returnedData);
+    assert(rc == success && "rm::readTuple() should not fail.");
+    assert(memcmp(tuple, returnedData, tupleSize) == 0 && "The tuple inserted after recovery should be read back.");
+
+    free(tuple);
+    free(returnedData);
+    rc = rm.deleteTable(tableName);
+    assert(rc == success && "Deleting a table should not fail.");
+    rc = rm.deleteCatalog();
+    assert(rc == success && "Deleting the Catalog should not fail.");
+    remove(indexFileName(tableName).c_str());
+    remove("rids_file");
+
+    std::cout << "***** RM Test Case recovery finished. The result will be examined. *****" << std::endl
+              << std::endl;
+    return success;
+}
+
+int main() {
+    return TEST_RM_recovery("tbl_recovery");
+}
@@ -0,0 +1,114 @@
+#include "rm_test_util.h"
+
+// Tuple i of the test, `grown` ones have a longer name
+static void prepareTupleForVacuum(int i, bool grown, void *tuple, int *tupleSize) {
+    int nullAttributesIndicatorActualSize = getActualByteForNullsIndicator(4);
+    auto *nullsIndicator = (unsigned char *) malloc(nullAttributesIndicatorActualSize);
+    memset(nullsIndicator, 0, nullAttributesIndicatorActualSize);
+    std::string name(grown ? 30 : 2, (char) ('a' + i % 26));
+    unsigned size = 0;
+    prepareTuple(4, nullsIndicator, name.size(), name, i, (float) i, i * 10, tuple, &size);
+    *tupleSize = size;
+    free(nullsIndicator);
+}
+
+// deleteTable() leaves the index files of the table behind
+static std::string indexFileName(const std::string &tableName) {
+    return "db_files/" + tableName + "_Age.idx";
+}
+
+int TEST_RM_vacuum(const std::string &tableName) {
+    // Functions Tested
+    // 1. Grow tuples of a table with an index until they are forwarded, and delete the later ones
+    // 2. Vacuum the table
+    // 3. Every index entry points to its tuple, and the file is shorter
+    std::cout << std::endl << "***** In RM Test Case vacuum *****" << std::endl;
+
+    rm.deleteTable(tableName);
+    rm.deleteCatalog();
+    remove(indexFileName(tableName).c_str());
+    RC rc = rm.createCatalog();
+    assert(rc == success && "Creating the Catalog should not fail.");
+    rc = createTable(tableName);
+    assert(rc == success && "Creating a table should not fail.");
+    rc = rm.createIndex(tableName, "Age");
+    assert(rc == success && "Creating an index should not fail.");
+
+    const int numTuples = 3000;
+    void *tuple = malloc(PAGE_SIZE);
+    void *returnedData = malloc(PAGE_SIZE);
+    int tupleSize = 0;
+    std::vector<RID> rids;
+    for (int i = 0; i < numTuples; ++i) {
+        RID rid;
+        prepareTupleForVacuum(i, false, tuple, &tupleSize);
+        rc = rm.insertTuple(tableName, tuple, rid);
+        assert(rc == success && "rm::insertTuple() should not fail.");
+        rids.push_back(rid);
+    }
+    for (int i = 0; i < numTuples; i += 3) {
+        prepareTupleForVacuum(i, true, tuple, &tupleSize);
+        rc = rm.updateTuple(tableName, tuple, rids[i]);
+        assert(rc == success && "rm::updateTuple() should not fail.");
+    }
+    for (int i = numTuples / 2; i < numTuples; ++i) {
+        rc = rm.deleteTuple(tableName, rids[i]);
+        assert(rc == success && "rm::deleteTuple() should not fail.");
+    }
+
+    std::string fileName = "db_files/" + tableName;
+    std::ifstream::pos_type sizeBefore = getFileSize(fileName);
+    rc = rm.vacuum(tableName);
+    assert(rc == success && "rm::vacuum() should not fail.");
+    rc = rm.vacuum("Tables");
+    assert(rc != success && "Vacuuming a system table should fail.");
+    std::ifstream::pos_type sizeAfter = getFileSize(fileName);
+
+    // Tuples may have new RIDs now, the index knows them
+    RM_IndexScanIterator rmisi;
+    rc = rm.indexScan(tableName, "Age", nullptr, nullptr, true, true, rmisi);
+    assert(rc == success && "rm::indexScan() should not fail.");
+    RID rid;
+    int key = 0;
+    int count = 0;
+    while (rmisi.getNextEntry(rid, &key) != RM_EOF) {
+        rc = rm.readTuple(tableName, rid, returnedData);
+        prepareTupleForVacuum(key, key % 3 == 0, tuple, &tupleSize);
+        if (rc != success || key >= numTuples / 2 || memcmp(tuple, returnedData, tupleSize) != 0) {
+            std::cout << "[Fail] The index entry of key " << key << " doesn't point to its tuple." << std::endl;
+            std::cout << "***** [FAIL] Test Case vacuum Failed *****" << std::endl << std::endl;
+            rmisi.close();
+            free(tuple);
+            free(returnedData);
+            return -1;
+        }
+        ++count;
+    }
+    rmisi.close();
+    free(tuple);
+    free(returnedData);
+    if (count != numTuples / 2) {
+        std::cout << "[Fail] The index scan returns " << count << " entries, expected " << numTuples / 2 << std::endl;
+        std::cout << "***** [FAIL] Test Case vacuum Failed *****" << std::endl << std::endl;
+        return -1;
+    }
+    if (sizeAfter >= sizeBefore) {
+        std::cout << "[Fail] The table file is " << sizeAfter << " bytes after vacuum, " << sizeBefore
+                  << " before." << std::endl;
+        std::cout << "***** [FAIL] Test Case vacuum Failed *****" << std::endl << std::endl;
+        return -1;
+    }
+
+    rc = rm.deleteTable(tableName);
+    assert(rc == success && "Deleting a table should not fail.");
+    rc = rm.deleteCatalog();
+    assert(rc == success && "Deleting the Catalog should not fail.");
+    remove(indexFileName(tableName).c_str());
+
+    std::cout << "***** RM Test Case vacuum finished. The result will be examined. *****" << std::endl << std::endl;
+    return success;
+}
+
+int main() {
+    return TEST_RM_vacuum("tbl_vacuum");
+}